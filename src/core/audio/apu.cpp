@@ -0,0 +1,675 @@
+#include "apu.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace LibDMG;
+
+const int Apu::SAMPLE_RATE;
+const int Apu::SEQUENCER_PERIOD;
+const int Apu::CATCH_UP_CYCLES;
+
+namespace
+{
+    // Square duty cycles, one bit per step
+    const uint8_t DUTY_TABLE[4] = { 0x80, 0x81, 0xE1, 0x7E };
+
+    const int NOISE_DIVISORS[8] = { 8, 16, 32, 48, 64, 80, 96, 112 };
+}
+
+Apu::Apu() :
+    m_ch(),
+    m_synthesis(true)
+{
+    memset(m_wave, 0, sizeof(m_wave));
+    memset(m_gainLeft, 0, sizeof(m_gainLeft));
+    memset(m_gainRight, 0, sizeof(m_gainRight));
+    reset();
+}
+
+void Apu::reset()
+{
+    clearRegisters();
+    m_power = false;
+    m_sequencerStep = 0;
+    m_sequencerCounter = SEQUENCER_PERIOD;
+    m_lfsr = 0x7FFF;
+
+    m_pendingCycles = 0;
+    m_time = 0;
+    m_left.clear();
+    m_right.clear();
+}
+
+void Apu::clearRegisters()
+{
+    for (int i = 0; i < CHANNEL_COUNT; i++)
+    {
+        m_ch[i].enabled = false;
+        updateAmp(i, m_time);
+        m_ch[i] = Channel();
+        m_ch[i].timer = 1;
+    }
+    m_sweepShadow = 0;
+    m_sweepTimer = 0;
+    m_sweepEnabled = false;
+    m_regNR10 = 0;
+    m_regNR50 = 0;
+    m_regNR51 = 0;
+    updateGains();
+}
+
+void Apu::step(int cycles)
+{
+    m_pendingCycles += cycles;
+    if (m_pendingCycles >= CATCH_UP_CYCLES)
+    {
+        catchUp();
+    }
+}
+
+void Apu::catchUp()
+{
+    if (m_pendingCycles > 0)
+    {
+        run(m_pendingCycles);
+        m_pendingCycles = 0;
+    }
+}
+
+void Apu::run(int cycles)
+{
+    while (cycles > 0)
+    {
+        // Channels run between frame sequencer steps, which may change their level
+        int chunk = std::min(cycles, m_power ? m_sequencerCounter : SEQUENCER_PERIOD);
+
+        if (m_synthesis)
+        {
+            makeRoom(chunk);
+            if (m_power)
+            {
+                runSquare(CH_SQUARE1, chunk);
+                runSquare(CH_SQUARE2, chunk);
+                runWave(chunk);
+                runNoise(chunk);
+            }
+            m_time += chunk;
+        }
+
+        if (m_power)
+        {
+            m_sequencerCounter -= chunk;
+        }
+        cycles -= chunk;
+
+        if (m_power && m_sequencerCounter == 0)
+        {
+            m_sequencerCounter = SEQUENCER_PERIOD;
+            clockSequencer();
+        }
+    }
+}
+
+void Apu::makeRoom(int cycles)
+{
+    size_t end = (m_time + cycles) / BlipBuffer::CLOCKS_PER_SAMPLE;
+    if (end < BlipBuffer::CAPACITY)
+    {
+        return;
+    }
+
+    // Nobody reads the samples, drop the oldest ones
+    size_t count = end - BlipBuffer::CAPACITY + 1;
+    m_left.endFrame(m_time);
+    m_right.endFrame(m_time);
+    m_left.removeSamples(count);
+    m_right.removeSamples(count);
+    m_time -= static_cast<uint32_t>(count * BlipBuffer::CLOCKS_PER_SAMPLE);
+}
+
+void Apu::setSynthesisEnabled(bool enabled)
+{
+    if (enabled == m_synthesis)
+    {
+        return;
+    }
+
+    catchUp();
+    m_synthesis = enabled;
+    restartOutput();
+}
+
+void Apu::restartOutput()
+{
+    m_left.clear();
+    m_right.clear();
+    m_time = 0;
+    for (int i = 0; i < CHANNEL_COUNT; i++)
+    {
+        m_ch[i].amp = 0;
+    }
+    updateGains();
+    for (int i = 0; i < CHANNEL_COUNT; i++)
+    {
+        updateAmp(i, m_time);
+    }
+}
+
+void Apu::runSquare(int ch, int cycles)
+{
+    Channel &c = m_ch[ch];
+    if (!c.enabled)
+    {
+        return;
+    }
+
+    int p = period(ch);
+    int t = c.timer;
+    if (t <= cycles)
+    {
+        if (c.amp == 0 && c.volume == 0)
+        {
+            // Silent, only the duty position has to move forward
+            int steps = (cycles - t) / p + 1;
+            c.position = (c.position + steps) & 0x07;
+            t += steps * p;
+        }
+        else
+        {
+            while (t <= cycles)
+            {
+                c.position = (c.position + 1) & 0x07;
+                updateAmp(ch, m_time + t);
+                t += p;
+            }
+        }
+    }
+    c.timer = t - cycles;
+}
+
+void Apu::runWave(int cycles)
+{
+    Channel &c = m_ch[CH_WAVE];
+    if (!c.enabled)
+    {
+        return;
+    }
+
+    int p = period(CH_WAVE);
+    int t = c.timer;
+    if (t <= cycles)
+    {
+        if (c.amp == 0 && (c.regEnvelope & 0x60) == 0)
+        {
+            int steps = (cycles - t) / p + 1;
+            c.position = (c.position + steps) & 0x1F;
+            t += steps * p;
+        }
+        else
+        {
+            while (t <= cycles)
+            {
+                c.position = (c.position + 1) & 0x1F;
+                updateAmp(CH_WAVE, m_time + t);
+                t += p;
+            }
+        }
+    }
+    c.timer = t - cycles;
+}
+
+void Apu::runNoise(int cycles)
+{
+    Channel &c = m_ch[CH_NOISE];
+    if (!c.enabled)
+    {
+        return;
+    }
+
+    int p = period(CH_NOISE);
+    int t = c.timer;
+    if (t <= cycles)
+    {
+        if (c.amp == 0 && c.volume == 0)
+        {
+            // The LFSR is not visible to software, no need to clock it while silent
+            t += ((cycles - t) / p + 1) * p;
+        }
+        else
+        {
+            bool narrow = (c.freq & 0x08) != 0;
+            while (t <= cycles)
+            {
+                uint16_t bit = (m_lfsr ^ (m_lfsr >> 1)) & 0x01;
+                m_lfsr = (m_lfsr >> 1) | (bit << 14);
+                if (narrow)
+                {
+                    m_lfsr = (m_lfsr & ~0x40) | (bit << 6);
+                }
+                updateAmp(CH_NOISE, m_time + t);
+                t += p;
+            }
+        }
+    }
+    c.timer = t - cycles;
+}
+
+void Apu::clockSequencer()
+{
+    if ((m_sequencerStep & 0x01) == 0)
+    {
+        clockLength();
+    }
+    if (m_sequencerStep == 2 || m_sequencerStep == 6)
+    {
+        clockSweep();
+    }
+    if (m_sequencerStep == 7)
+    {
+        clockEnvelope();
+    }
+    m_sequencerStep = (m_sequencerStep + 1) & 0x07;
+}
+
+void Apu::clockLength()
+{
+    for (int i = 0; i < CHANNEL_COUNT; i++)
+    {
+        Channel &c = m_ch[i];
+        if (c.lengthEnabled && c.length > 0)
+        {
+            if (--c.length == 0)
+            {
+                disable(i);
+            }
+        }
+    }
+}
+
+void Apu::clockEnvelope()
+{
+    static const int channels[] = { CH_SQUARE1, CH_SQUARE2, CH_NOISE };
+    for (int i : channels)
+    {
+        Channel &c = m_ch[i];
+        int envPeriod = c.regEnvelope & 0x07;
+        if (!c.enabled || envPeriod == 0)
+        {
+            continue;
+        }
+
+        if (--c.envelopeTimer <= 0)
+        {
+            c.envelopeTimer = envPeriod;
+            if ((c.regEnvelope & 0x08) && c.volume < 15)
+            {
+                c.volume++;
+                updateAmp(i, m_time);
+            }
+            else if (!(c.regEnvelope & 0x08) && c.volume > 0)
+            {
+                c.volume--;
+                updateAmp(i, m_time);
+            }
+        }
+    }
+}
+
+void Apu::clockSweep()
+{
+    if (--m_sweepTimer > 0)
+    {
+        return;
+    }
+
+    int sweepPeriod = (m_regNR10 >> 4) & 0x07;
+    m_sweepTimer = sweepPeriod ? sweepPeriod : 8;
+    if (m_sweepEnabled && sweepPeriod != 0)
+    {
+        uint16_t freq = sweepTarget();
+        if (freq <= 2047 && (m_regNR10 & 0x07) != 0)
+        {
+            m_sweepShadow = freq;
+            m_ch[CH_SQUARE1].freq = freq;
+            // The new frequency is checked for overflow again
+            sweepTarget();
+        }
+    }
+}
+
+uint16_t Apu::sweepTarget()
+{
+    int delta = m_sweepShadow >> (m_regNR10 & 0x07);
+    int freq = (m_regNR10 & 0x08) ? m_sweepShadow - delta : m_sweepShadow + delta;
+    if (freq > 2047)
+    {
+        disable(CH_SQUARE1);
+    }
+    return static_cast<uint16_t>(freq);
+}
+
+void Apu::trigger(int ch)
+{
+    Channel &c = m_ch[ch];
+    c.enabled = c.dacEnabled;
+    if (c.length == 0)
+    {
+        c.length = (ch == CH_WAVE) ? 256 : 64;
+    }
+    c.timer = period(ch);
+
+    if (ch == CH_WAVE)
+    {
+        c.position = 0;
+    }
+    else
+    {
+        c.volume = c.regEnvelope >> 4;
+        c.envelopeTimer = (c.regEnvelope & 0x07) ? (c.regEnvelope & 0x07) : 8;
+    }
+
+    if (ch == CH_NOISE)
+    {
+        m_lfsr = 0x7FFF;
+    }
+
+    if (ch == CH_SQUARE1)
+    {
+        int sweepPeriod = (m_regNR10 >> 4) & 0x07;
+        m_sweepShadow = c.freq;
+        m_sweepTimer = sweepPeriod ? sweepPeriod : 8;
+        m_sweepEnabled = sweepPeriod != 0 || (m_regNR10 & 0x07) != 0;
+        if (m_regNR10 & 0x07)
+        {
+            sweepTarget();
+        }
+    }
+
+    updateAmp(ch, m_time);
+}
+
+void Apu::disable(int ch)
+{
+    m_ch[ch].enabled = false;
+    updateAmp(ch, m_time);
+}
+
+void Apu::setFreqLow(int ch, uint8_t val)
+{
+    m_ch[ch].freq = (m_ch[ch].freq & 0x0700) | val;
+}
+
+void Apu::setFreqHigh(int ch, uint8_t val)
+{
+    Channel &c = m_ch[ch];
+    c.freq = (c.freq & 0x00FF) | ((val & 0x07) << 8);
+    c.lengthEnabled = (val & 0x40) != 0;
+    if (val & 0x80)
+    {
+        trigger(ch);
+    }
+}
+
+void Apu::setEnvelope(int ch, uint8_t val)
+{
+    Channel &c = m_ch[ch];
+    c.regEnvelope = val;
+    c.dacEnabled = (val & 0xF8) != 0;
+    if (!c.dacEnabled)
+    {
+        disable(ch);
+    }
+}
+
+int Apu::period(int ch) const
+{
+    switch (ch)
+    {
+    case CH_SQUARE1:
+    case CH_SQUARE2:
+        return (2048 - m_ch[ch].freq) * 4;
+    case CH_WAVE:
+        return (2048 - m_ch[ch].freq) * 2;
+    default:
+        // NR43 is kept in the frequency field of the noise channel
+        return NOISE_DIVISORS[m_ch[ch].freq & 0x07] << (m_ch[ch].freq >> 4);
+    }
+}
+
+int Apu::output(int ch) const
+{
+    const Channel &c = m_ch[ch];
+    if (!c.enabled || !c.dacEnabled)
+    {
+        return 0;
+    }
+
+    switch (ch)
+    {
+    case CH_SQUARE1:
+    case CH_SQUARE2:
+        return ((DUTY_TABLE[c.regDuty >> 6] >> (7 - c.position)) & 0x01) ? c.volume : 0;
+    case CH_WAVE:
+    {
+        int shift = (c.regEnvelope >> 5) & 0x03;
+        if (shift == 0)
+        {
+            return 0;
+        }
+        uint8_t sample = m_wave[c.position >> 1];
+        sample = (c.position & 0x01) ? (sample & 0x0F) : (sample >> 4);
+        return sample >> (shift - 1);
+    }
+    default:
+        return (m_lfsr & 0x01) ? 0 : c.volume;
+    }
+}
+
+void Apu::updateAmp(int ch, uint32_t time)
+{
+    if (!m_synthesis)
+    {
+        return;
+    }
+
+    int amp = output(ch);
+    int delta = amp - m_ch[ch].amp;
+    if (delta == 0)
+    {
+        return;
+    }
+
+    m_ch[ch].amp = amp;
+    if (m_gainLeft[ch])
+    {
+        m_left.addDelta(time, delta * m_gainLeft[ch]);
+    }
+    if (m_gainRight[ch])
+    {
+        m_right.addDelta(time, delta * m_gainRight[ch]);
+    }
+}
+
+void Apu::updateGains()
+{
+    for (int i = 0; i < CHANNEL_COUNT; i++)
+    {
+        int left = (m_regNR51 & (0x10 << i)) ? ((m_regNR50 >> 4) & 0x07) + 1 : 0;
+        int right = (m_regNR51 & (0x01 << i)) ? (m_regNR50 & 0x07) + 1 : 0;
+
+        // The channel level does not change, but its contribution does
+        if (m_ch[i].amp != 0)
+        {
+            if (left != m_gainLeft[i])
+            {
+                m_left.addDelta(m_time, m_ch[i].amp * (left - m_gainLeft[i]));
+            }
+            if (right != m_gainRight[i])
+            {
+                m_right.addDelta(m_time, m_ch[i].amp * (right - m_gainRight[i]));
+            }
+        }
+        m_gainLeft[i] = left;
+        m_gainRight[i] = right;
+    }
+}
+
+uint8_t Apu::channelStatus() const
+{
+    uint8_t status = 0;
+    for (int i = 0; i < CHANNEL_COUNT; i++)
+    {
+        if (m_ch[i].enabled)
+        {
+            status |= 1 << i;
+        }
+    }
+    return status;
+}
+
+size_t Apu::samplesAvailable()
+{
+    catchUp();
+    m_left.endFrame(m_time);
+    m_right.endFrame(m_time);
+    return m_left.samplesAvailable();
+}
+
+size_t Apu::readSamples(int16_t *out, size_t count)
+{
+    count = std::min(count, samplesAvailable());
+    m_left.readSamples(out, count, 2);
+    m_right.readSamples(out + 1, count, 2);
+    m_time -= static_cast<uint32_t>(count * BlipBuffer::CLOCKS_PER_SAMPLE);
+    return count;
+}
+
+uint8_t Apu::reg(uint8_t offset)
+{
+    catchUp();
+
+    if (offset >= APU_WAVE_RAM && offset <= APU_WAVE_RAM_END)
+    {
+        return m_wave[offset - APU_WAVE_RAM];
+    }
+
+    // Write-only bits read as 1
+    switch (offset)
+    {
+    case APU_REG_NR10: return m_regNR10 | 0x80;
+    case APU_REG_NR11: return m_ch[CH_SQUARE1].regDuty | 0x3F;
+    case APU_REG_NR12: return m_ch[CH_SQUARE1].regEnvelope;
+    case APU_REG_NR14: return m_ch[CH_SQUARE1].lengthEnabled ? 0xFF : 0xBF;
+    case APU_REG_NR21: return m_ch[CH_SQUARE2].regDuty | 0x3F;
+    case APU_REG_NR22: return m_ch[CH_SQUARE2].regEnvelope;
+    case APU_REG_NR24: return m_ch[CH_SQUARE2].lengthEnabled ? 0xFF : 0xBF;
+    case APU_REG_NR30: return m_ch[CH_WAVE].dacEnabled ? 0xFF : 0x7F;
+    case APU_REG_NR32: return m_ch[CH_WAVE].regEnvelope | 0x9F;
+    case APU_REG_NR34: return m_ch[CH_WAVE].lengthEnabled ? 0xFF : 0xBF;
+    case APU_REG_NR42: return m_ch[CH_NOISE].regEnvelope;
+    case APU_REG_NR43: return static_cast<uint8_t>(m_ch[CH_NOISE].freq);
+    case APU_REG_NR44: return m_ch[CH_NOISE].lengthEnabled ? 0xFF : 0xBF;
+    case APU_REG_NR50: return m_regNR50;
+    case APU_REG_NR51: return m_regNR51;
+    case APU_REG_NR52: return (m_power ? 0x80 : 0x00) | 0x70 | channelStatus();
+    default:
+        return 0xFF;
+    }
+}
+
+void Apu::setReg(uint8_t offset, uint8_t val)
+{
+    catchUp();
+
+    if (offset >= APU_WAVE_RAM && offset <= APU_WAVE_RAM_END)
+    {
+        m_wave[offset - APU_WAVE_RAM] = val;
+        return;
+    }
+
+    if (offset == APU_REG_NR52)
+    {
+        bool power = (val & 0x80) != 0;
+        if (!power && m_power)
+        {
+            // Powering off clears every register but the wave RAM
+            clearRegisters();
+        }
+        else if (power && !m_power)
+        {
+            m_sequencerStep = 0;
+            m_sequencerCounter = SEQUENCER_PERIOD;
+        }
+        m_power = power;
+        return;
+    }
+
+    if (!m_power)
+    {
+        return;
+    }
+
+    switch (offset)
+    {
+    // Square 1
+    case APU_REG_NR10: m_regNR10 = val & 0x7F; break;
+    case APU_REG_NR11:
+        m_ch[CH_SQUARE1].regDuty = val & 0xC0;
+        m_ch[CH_SQUARE1].length = 64 - (val & 0x3F);
+        break;
+    case APU_REG_NR12: setEnvelope(CH_SQUARE1, val); break;
+    case APU_REG_NR13: setFreqLow(CH_SQUARE1, val); break;
+    case APU_REG_NR14: setFreqHigh(CH_SQUARE1, val); break;
+
+    // Square 2
+    case APU_REG_NR21:
+        m_ch[CH_SQUARE2].regDuty = val & 0xC0;
+        m_ch[CH_SQUARE2].length = 64 - (val & 0x3F);
+        break;
+    case APU_REG_NR22: setEnvelope(CH_SQUARE2, val); break;
+    case APU_REG_NR23: setFreqLow(CH_SQUARE2, val); break;
+    case APU_REG_NR24: setFreqHigh(CH_SQUARE2, val); break;
+
+    // Wave
+    case APU_REG_NR30:
+        m_ch[CH_WAVE].dacEnabled = (val & 0x80) != 0;
+        if (!m_ch[CH_WAVE].dacEnabled)
+        {
+            disable(CH_WAVE);
+        }
+        break;
+    case APU_REG_NR31: m_ch[CH_WAVE].length = 256 - val; break;
+    case APU_REG_NR32:
+        m_ch[CH_WAVE].regEnvelope = val & 0x60;
+        updateAmp(CH_WAVE, m_time);
+        break;
+    case APU_REG_NR33: setFreqLow(CH_WAVE, val); break;
+    case APU_REG_NR34: setFreqHigh(CH_WAVE, val); break;
+
+    // Noise
+    case APU_REG_NR41: m_ch[CH_NOISE].length = 64 - (val & 0x3F); break;
+    case APU_REG_NR42: setEnvelope(CH_NOISE, val); break;
+    case APU_REG_NR43: m_ch[CH_NOISE].freq = val; break;
+    case APU_REG_NR44:
+        m_ch[CH_NOISE].lengthEnabled = (val & 0x40) != 0;
+        if (val & 0x80)
+        {
+            trigger(CH_NOISE);
+        }
+        break;
+
+    // Control
+    case APU_REG_NR50:
+        m_regNR50 = val;
+        updateGains();
+        break;
+    case APU_REG_NR51:
+        m_regNR51 = val;
+        updateGains();
+        break;
+
+    default:
+        break;
+    }
+}
@@ -0,0 +1,190 @@
+#ifndef LIBDMG_APU_HPP
+#define LIBDMG_APU_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cereal/archives/xml.hpp>
+
+#include "blip_buffer.hpp"
+#include "state/binary_archive.hpp"
+
+namespace LibDMG
+{
+    // Four channel sound controller. The APU is not clocked cycle by cycle:
+    // step() only accumulates cycles, which are simulated when software
+    // touches a sound register, when samples are read, or when too many
+    // cycles are pending. Channels are simulated from one waveform
+    // transition to the next, and each change of output level is added to
+    // a pair of blip buffers as a band-limited step.
+    class Apu
+    {
+    public:
+        // Register offsets, relative to $FF00
+        enum RegOffset
+        {
+            APU_REG_NR10 = 0x10,
+            APU_REG_NR11 = 0x11,
+            APU_REG_NR12 = 0x12,
+            APU_REG_NR13 = 0x13,
+            APU_REG_NR14 = 0x14,
+            APU_REG_NR21 = 0x16,
+            APU_REG_NR22 = 0x17,
+            APU_REG_NR23 = 0x18,
+            APU_REG_NR24 = 0x19,
+            APU_REG_NR30 = 0x1A,
+            APU_REG_NR31 = 0x1B,
+            APU_REG_NR32 = 0x1C,
+            APU_REG_NR33 = 0x1D,
+            APU_REG_NR34 = 0x1E,
+            APU_REG_NR41 = 0x20,
+            APU_REG_NR42 = 0x21,
+            APU_REG_NR43 = 0x22,
+            APU_REG_NR44 = 0x23,
+            APU_REG_NR50 = 0x24,
+            APU_REG_NR51 = 0x25,
+            APU_REG_NR52 = 0x26,
+            APU_WAVE_RAM = 0x30,
+            APU_WAVE_RAM_END = 0x3F
+        };
+
+        static const int SAMPLE_RATE = BlipBuffer::SAMPLE_RATE;
+        static const int SEQUENCER_PERIOD = 8192;   // 512 Hz frame sequencer
+        // Pending cycles are simulated once they reach about one frame
+        static const int CATCH_UP_CYCLES = 70224;
+
+        Apu();
+
+        void reset();
+        void step(int cycles);
+        // Simulates the pending cycles
+        void catchUp();
+
+        uint8_t reg(uint8_t offset);
+        void setReg(uint8_t offset, uint8_t val);
+
+        // Stereo frames ready to be read, after catching up
+        size_t samplesAvailable();
+        // Reads up to count interleaved stereo frames (left, right)
+        size_t readSamples(int16_t *out, size_t count);
+
+        // Without synthesis, only the state visible to software is kept up to
+        // date: channel enable bits, length counters and sweep overflow. No
+        // samples are produced, the channel waveforms are not simulated.
+        void setSynthesisEnabled(bool enabled);
+        bool isSynthesisEnabled() const { return m_synthesis; }
+
+        // Enable bits of the four channels, as in NR52
+        uint8_t channelStatus() const;
+        bool isPowered() const { return m_power; }
+
+        void saveState(std::ostream& out) { cereal::XMLOutputArchive ar(out); serialize(ar); }
+        void loadState(std::istream& in) { cereal::XMLInputArchive ar(in); serialize(ar); }
+        template<class Archive>
+        void serialize(Archive & ar)
+        {
+            catchUp();
+            ar(CEREAL_NVP(m_ch),
+               CEREAL_NVP(m_wave),
+               CEREAL_NVP(m_power),
+               CEREAL_NVP(m_sequencerStep),
+               CEREAL_NVP(m_sequencerCounter),
+               CEREAL_NVP(m_sweepShadow),
+               CEREAL_NVP(m_sweepTimer),
+               CEREAL_NVP(m_sweepEnabled),
+               CEREAL_NVP(m_lfsr),
+               CEREAL_NVP(m_regNR10),
+               CEREAL_NVP(m_regNR50),
+               CEREAL_NVP(m_regNR51));
+
+            // Samples already synthesized do not belong to the restored state
+            if (ArchiveIsLoading<Archive>::value)
+            {
+                restartOutput();
+            }
+        }
+
+    private:
+        static const int CHANNEL_COUNT = 4;
+        enum ChannelId { CH_SQUARE1, CH_SQUARE2, CH_WAVE, CH_NOISE };
+
+        struct Channel
+        {
+            bool     enabled;
+            bool     dacEnabled;
+            bool     lengthEnabled;
+            int      length;        // Frame sequencer ticks before the channel stops
+            int      timer;         // Cycles before the next waveform step
+            int      position;      // Duty step or wave sample index
+            int      volume;
+            int      envelopeTimer;
+            uint16_t freq;
+            uint8_t  regDuty;       // NRx1
+            uint8_t  regEnvelope;   // NRx2
+            int      amp;           // Current digital output, 0-15
+
+            template<class Archive>
+            void serialize(Archive & ar)
+            {
+                ar(CEREAL_NVP(enabled),
+                   CEREAL_NVP(dacEnabled),
+                   CEREAL_NVP(lengthEnabled),
+                   CEREAL_NVP(length),
+                   CEREAL_NVP(timer),
+                   CEREAL_NVP(position),
+                   CEREAL_NVP(volume),
+                   CEREAL_NVP(envelopeTimer),
+                   CEREAL_NVP(freq),
+                   CEREAL_NVP(regDuty),
+                   CEREAL_NVP(regEnvelope));
+            }
+        };
+
+        Channel  m_ch[CHANNEL_COUNT];
+        uint8_t  m_wave[16];
+        bool     m_power;
+        int      m_sequencerStep;
+        int      m_sequencerCounter;
+        uint16_t m_sweepShadow;
+        int      m_sweepTimer;
+        bool     m_sweepEnabled;
+        uint16_t m_lfsr;
+
+        uint8_t  m_regNR10;
+        uint8_t  m_regNR50;
+        uint8_t  m_regNR51;
+
+        bool       m_synthesis;
+        int        m_pendingCycles;
+        uint32_t   m_time;  // Clocks since the start of the blip buffers
+        int        m_gainLeft[CHANNEL_COUNT];
+        int        m_gainRight[CHANNEL_COUNT];
+        BlipBuffer m_left;
+        BlipBuffer m_right;
+
+        void run(int cycles);
+        void runSquare(int ch, int cycles);
+        void runWave(int cycles);
+        void runNoise(int cycles);
+        void clockSequencer();
+        void clockLength();
+        void clockEnvelope();
+        void clockSweep();
+        uint16_t sweepTarget();
+
+        void trigger(int ch);
+        void setFreqLow(int ch, uint8_t val);
+        void setFreqHigh(int ch, uint8_t val);
+        void setEnvelope(int ch, uint8_t val);
+        void disable(int ch);
+        void clearRegisters();
+
+        int period(int ch) const;
+        int output(int ch) const;
+        void updateAmp(int ch, uint32_t time);
+        void updateGains();
+        void makeRoom(int cycles);
+        void restartOutput();
+    };
+}
+
+#endif // LIBDMG_APU_HPP
@@ -0,0 +1,64 @@
+#include "audio_output.hpp"
+
+#include <algorithm>
+
+#include "apu.hpp"
+
+using namespace LibDMG;
+
+const size_t AudioOutput::CAPACITY;
+const double AudioOutput::MAX_RATE_DELTA = 0.005;
+
+AudioOutput::AudioOutput(int sampleRate) :
+    m_sampleRate(sampleRate),
+    m_resampler(Apu::SAMPLE_RATE, sampleRate),
+    m_rateControl(false),
+    m_latency(CAPACITY / 2),
+    m_droppedFrames(0)
+{
+}
+
+void AudioOutput::setRateControl(bool enabled, size_t latencyFrames)
+{
+    m_rateControl = enabled;
+    m_latency = std::min(std::max<size_t>(latencyFrames, 1), CAPACITY / 2);
+    if (!enabled)
+    {
+        m_resampler.setRateAdjust(1.0);
+    }
+}
+
+void AudioOutput::update(Apu& apu)
+{
+    size_t frames = apu.samplesAvailable();
+    if (frames == 0)
+    {
+        return;
+    }
+
+    if (m_rateControl)
+    {
+        // Fuller than the target: take larger steps and produce fewer samples
+        double fill = static_cast<double>(framesAvailable());
+        double error = (fill - m_latency) / m_latency;
+        error = std::min(std::max(error, -1.0), 1.0);
+        m_resampler.setRateAdjust(1.0 + MAX_RATE_DELTA * error);
+    }
+
+    m_input.resize(frames * 2);
+    frames = apu.readSamples(m_input.data(), frames);
+
+    m_output.resize(m_resampler.maxOutput(frames) * 2);
+    size_t produced = m_resampler.process(m_input.data(), frames, m_output.data());
+
+    size_t written = m_ring.write(m_output.data(), produced * 2) / 2;
+    if (written < produced)
+    {
+        m_droppedFrames += static_cast<uint32_t>(produced - written);
+    }
+}
+
+size_t AudioOutput::read(int16_t *out, size_t count)
+{
+    return m_ring.read(out, count * 2) / 2;
+}
@@ -0,0 +1,62 @@
+#ifndef LIBDMG_AUDIO_OUTPUT_HPP
+#define LIBDMG_AUDIO_OUTPUT_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "resampler.hpp"
+#include "utils/spsc_ring.hpp"
+
+namespace LibDMG
+{
+    class Apu;
+
+    // Carries APU samples to a host consumer. The emulation thread pulls
+    // the samples synthesized since the last frame, resamples them to the
+    // host rate and pushes them into a lock-free ring; an audio thread or
+    // an offline writer drains the ring with read(). The emulation thread
+    // never blocks: when the ring is full, samples are dropped.
+    //
+    // With rate control, the resampling ratio is nudged by up to
+    // MAX_RATE_DELTA so that the ring hovers around the target latency,
+    // absorbing the drift between the emulated and the host clocks.
+    class AudioOutput
+    {
+    public:
+        static const size_t CAPACITY = 16384;   // Stereo frames
+        static const double MAX_RATE_DELTA;
+
+        AudioOutput(int sampleRate = 48000);
+
+        int sampleRate() const { return m_sampleRate; }
+
+        // Target fill level of the ring, in frames, for rate control
+        void setRateControl(bool enabled, size_t latencyFrames = 2048);
+        bool rateControl() const { return m_rateControl; }
+
+        // Emulation thread: moves the pending APU samples into the ring
+        void update(Apu& apu);
+
+        // Consumer thread: reads up to count interleaved stereo frames
+        size_t read(int16_t *out, size_t count);
+        size_t framesAvailable() const { return m_ring.size() / 2; }
+
+        uint32_t droppedFrames() const { return m_droppedFrames; }
+
+    private:
+        int       m_sampleRate;
+        Resampler m_resampler;
+        bool      m_rateControl;
+        size_t    m_latency;
+
+        std::vector<int16_t> m_input;
+        std::vector<int16_t> m_output;
+
+        SpscRing<int16_t, CAPACITY * 2> m_ring;
+        std::atomic<uint32_t>           m_droppedFrames;
+    };
+}
+
+#endif // LIBDMG_AUDIO_OUTPUT_HPP
@@ -0,0 +1,152 @@
+#include "blip_buffer.hpp"
+
+#include <cmath>
+#include <cstring>
+
+using namespace LibDMG;
+
+const int BlipBuffer::CLOCKS_PER_SAMPLE;
+const int BlipBuffer::SAMPLE_RATE;
+const size_t BlipBuffer::CAPACITY;
+const int BlipBuffer::KERNEL_SIZE;
+
+namespace
+{
+    const double PI = 3.14159265358979323846;
+
+    // Band-limited impulse for each sub-sample phase, each phase sums to 1.0
+    struct BlipKernel
+    {
+        int16_t taps[32][BlipBuffer::KERNEL_SIZE];
+
+        BlipKernel()
+        {
+            const int size = BlipBuffer::KERNEL_SIZE;
+            const double cutoff = 0.9;  // Fraction of the Nyquist frequency
+            const int scale = 1 << 14;
+
+            for (int phase = 0; phase < 32; phase++)
+            {
+                double frac = phase / 32.0;
+                double values[BlipBuffer::KERNEL_SIZE];
+                double sum = 0;
+
+                for (int i = 0; i < size; i++)
+                {
+                    // Centered on the middle of the kernel
+                    double x = i - size / 2 + 1 - frac;
+                    double sinc = (x == 0) ? 1.0 : sin(PI * cutoff * x) / (PI * cutoff * x);
+                    double w = (x + size / 2) / size;
+                    double blackman = 0.42 - 0.5 * cos(2 * PI * w) + 0.08 * cos(4 * PI * w);
+                    values[i] = sinc * blackman;
+                    sum += values[i];
+                }
+
+                // Normalize and put the rounding error on the center tap
+                int total = 0;
+                for (int i = 0; i < size; i++)
+                {
+                    taps[phase][i] = static_cast<int16_t>(floor(values[i] / sum * scale + 0.5));
+                    total += taps[phase][i];
+                }
+                taps[phase][size / 2 - 1] += static_cast<int16_t>(scale - total);
+            }
+        }
+    };
+}
+
+BlipBuffer::BlipBuffer()
+{
+    clear();
+}
+
+void BlipBuffer::clear()
+{
+    memset(m_buffer, 0, sizeof(m_buffer));
+    m_available = 0;
+    m_integrator = 0;
+}
+
+const int16_t * BlipBuffer::kernel(int phase)
+{
+    static const BlipKernel kernel;
+    return kernel.taps[phase];
+}
+
+void BlipBuffer::addDelta(uint32_t time, int delta)
+{
+    size_t index = time / CLOCKS_PER_SAMPLE;
+    if (index >= CAPACITY)
+    {
+        return;
+    }
+
+    const int16_t *taps = kernel(time % CLOCKS_PER_SAMPLE);
+    int32_t *out = m_buffer + index;
+    for (int i = 0; i < KERNEL_SIZE; i++)
+    {
+        out[i] += delta * taps[i];
+    }
+}
+
+void BlipBuffer::endFrame(uint32_t time)
+{
+    size_t available = time / CLOCKS_PER_SAMPLE;
+    m_available = (available < CAPACITY) ? available : CAPACITY;
+}
+
+size_t BlipBuffer::readSamples(int16_t *out, size_t count, int stride)
+{
+    if (count > m_available)
+    {
+        count = m_available;
+    }
+
+    int32_t integrator = m_integrator;
+    for (size_t i = 0; i < count; i++)
+    {
+        integrator += m_buffer[i];
+        int32_t sample = (integrator >> KERNEL_BITS) * OUTPUT_GAIN;
+
+        // Leaky integrator, removes the DC offset
+        integrator -= integrator >> BASS_SHIFT;
+
+        if (sample > INT16_MAX)
+        {
+            sample = INT16_MAX;
+        }
+        else if (sample < INT16_MIN)
+        {
+            sample = INT16_MIN;
+        }
+        out[i * stride] = static_cast<int16_t>(sample);
+    }
+    m_integrator = integrator;
+
+    discard(count);
+    return count;
+}
+
+void BlipBuffer::removeSamples(size_t count)
+{
+    if (count > m_available)
+    {
+        count = m_available;
+    }
+
+    // Keep the integrator in step with the dropped deltas
+    for (size_t i = 0; i < count; i++)
+    {
+        m_integrator += m_buffer[i];
+        m_integrator -= m_integrator >> BASS_SHIFT;
+    }
+    discard(count);
+}
+
+void BlipBuffer::discard(size_t count)
+{
+    size_t remaining = CAPACITY + KERNEL_SIZE - count;
+    memmove(m_buffer, m_buffer + count, remaining * sizeof(int32_t));
+    memset(m_buffer + remaining, 0, count * sizeof(int32_t));
+    m_available -= count;
+}
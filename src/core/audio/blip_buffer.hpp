@@ -0,0 +1,54 @@
+#ifndef LIBDMG_BLIP_BUFFER_HPP
+#define LIBDMG_BLIP_BUFFER_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+namespace LibDMG
+{
+    // Band-limited synthesis buffer. Instead of generating one sample per
+    // clock, a channel only reports the times at which its output changes;
+    // each change is added as a band-limited step (windowed sinc kernel) at
+    // sub-sample precision. The cost is proportional to the number of
+    // waveform transitions, not to the number of clocks.
+    class BlipBuffer
+    {
+    public:
+        static const int CLOCKS_PER_SAMPLE = 32;
+        static const int SAMPLE_RATE = 4194304 / CLOCKS_PER_SAMPLE;
+        static const size_t CAPACITY = 8192;    // Samples, about 62 ms
+        static const int KERNEL_SIZE = 16;
+
+        BlipBuffer();
+
+        void clear();
+
+        // Time is in clocks since the oldest unread sample
+        void addDelta(uint32_t time, int delta);
+
+        // Samples ending before time (in clocks) can be read
+        void endFrame(uint32_t time);
+        size_t samplesAvailable() const { return m_available; }
+
+        // Samples are written with the given stride, to interleave channels.
+        // Reading moves the time origin forward by count samples.
+        size_t readSamples(int16_t *out, size_t count, int stride = 1);
+        // Drops the oldest samples without reading them
+        void removeSamples(size_t count);
+
+    private:
+        static const int PHASES = 32;
+        static const int KERNEL_BITS = 14;
+        static const int OUTPUT_GAIN = 64;
+        static const int BASS_SHIFT = 9;
+
+        int32_t m_buffer[CAPACITY + KERNEL_SIZE];
+        size_t  m_available;
+        int32_t m_integrator;
+
+        static const int16_t * kernel(int phase);
+        void discard(size_t count);
+    };
+}
+
+#endif // LIBDMG_BLIP_BUFFER_HPP
@@ -0,0 +1,176 @@
+#include "resampler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LIBDMG_RESAMPLER_SSE2
+#endif
+
+using namespace LibDMG;
+
+const int Resampler::TAPS;
+const int Resampler::PHASES;
+
+namespace
+{
+    const double PI = 3.14159265358979323846;
+
+#ifdef LIBDMG_RESAMPLER_SSE2
+    // Filters both channels with the same kernel, four taps at a time
+    inline void filter(const float *left, const float *right, const float *kernel, float& outLeft, float& outRight)
+    {
+        __m128 sumLeft = _mm_setzero_ps();
+        __m128 sumRight = _mm_setzero_ps();
+        for (int i = 0; i < Resampler::TAPS; i += 4)
+        {
+            __m128 k = _mm_load_ps(kernel + i);
+            sumLeft = _mm_add_ps(sumLeft, _mm_mul_ps(_mm_loadu_ps(left + i), k));
+            sumRight = _mm_add_ps(sumRight, _mm_mul_ps(_mm_loadu_ps(right + i), k));
+        }
+
+        // Horizontal sums, lanes 0+2 and 1+3 then the two halves
+        __m128 lo = _mm_unpacklo_ps(sumLeft, sumRight);   // l0 r0 l1 r1
+        __m128 hi = _mm_unpackhi_ps(sumLeft, sumRight);   // l2 r2 l3 r3
+        __m128 sum = _mm_add_ps(lo, hi);
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        outLeft = _mm_cvtss_f32(sum);
+        outRight = _mm_cvtss_f32(_mm_shuffle_ps(sum, sum, 1));
+    }
+#else
+    inline void filter(const float *left, const float *right, const float *kernel, float& outLeft, float& outRight)
+    {
+        float sumLeft = 0;
+        float sumRight = 0;
+        for (int i = 0; i < Resampler::TAPS; i++)
+        {
+            sumLeft += left[i] * kernel[i];
+            sumRight += right[i] * kernel[i];
+        }
+        outLeft = sumLeft;
+        outRight = sumRight;
+    }
+#endif
+
+    inline int16_t toSample(float val)
+    {
+        if (val >= 32767.0f)
+        {
+            return INT16_MAX;
+        }
+        if (val <= -32768.0f)
+        {
+            return INT16_MIN;
+        }
+        return static_cast<int16_t>(lrintf(val));
+    }
+}
+
+Resampler::Resampler(int inputRate, int outputRate) :
+    m_step(static_cast<double>(inputRate) / outputRate),
+    m_adjust(1.0)
+{
+    // Cutoff in cycles per input sample, with some room for the transition band
+    double cutoff = 0.45 * std::min(1.0, static_cast<double>(outputRate) / inputRate);
+
+    for (int phase = 0; phase < PHASES; phase++)
+    {
+        double frac = static_cast<double>(phase) / PHASES;
+        double values[TAPS];
+        double sum = 0;
+
+        for (int i = 0; i < TAPS; i++)
+        {
+            double x = i - (TAPS / 2 - 1) - frac;
+            double arg = 2 * PI * cutoff * x;
+            double sinc = (x == 0) ? 1.0 : sin(arg) / arg;
+            double w = (x + TAPS / 2) / TAPS;
+            double blackman = 0.42 - 0.5 * cos(2 * PI * w) + 0.08 * cos(4 * PI * w);
+            values[i] = sinc * blackman;
+            sum += values[i];
+        }
+
+        // Unity gain at DC for every phase
+        for (int i = 0; i < TAPS; i++)
+        {
+            m_kernel[phase][i] = static_cast<float>(values[i] / sum);
+        }
+    }
+
+    reset();
+}
+
+void Resampler::reset()
+{
+    // Start with a full history of silence
+    memset(m_left, 0, sizeof(m_left));
+    memset(m_right, 0, sizeof(m_right));
+    m_count = TAPS - 1;
+    m_pos = 0;
+}
+
+void Resampler::setRateAdjust(double adjust)
+{
+    m_adjust = adjust;
+}
+
+size_t Resampler::maxOutput(size_t inFrames) const
+{
+    return static_cast<size_t>(inFrames / (m_step * m_adjust)) + 3;
+}
+
+size_t Resampler::process(const int16_t *in, size_t inFrames, int16_t *out)
+{
+    size_t written = 0;
+    while (inFrames > 0)
+    {
+        size_t count = std::min(inFrames, TAPS + BLOCK - m_count);
+        for (size_t i = 0; i < count; i++)
+        {
+            m_left[m_count + i] = in[2 * i];
+            m_right[m_count + i] = in[2 * i + 1];
+        }
+        m_count += count;
+        in += 2 * count;
+        inFrames -= count;
+
+        written += filterBlock(out + 2 * written);
+    }
+    return written;
+}
+
+size_t Resampler::filterBlock(int16_t *out)
+{
+    double step = m_step * m_adjust;
+    size_t produced = 0;
+
+    for (;;)
+    {
+        size_t index = static_cast<size_t>(m_pos);
+        if (index + TAPS > m_count)
+        {
+            break;
+        }
+
+        int phase = static_cast<int>((m_pos - index) * PHASES);
+        float left;
+        float right;
+        filter(m_left + index, m_right + index, m_kernel[phase], left, right);
+        out[2 * produced] = toSample(left);
+        out[2 * produced + 1] = toSample(right);
+
+        produced++;
+        m_pos += step;
+    }
+
+    // Drop the history that no further output needs
+    size_t consumed = std::min(static_cast<size_t>(m_pos), m_count);
+    memmove(m_left, m_left + consumed, (m_count - consumed) * sizeof(float));
+    memmove(m_right, m_right + consumed, (m_count - consumed) * sizeof(float));
+    m_count -= consumed;
+    m_pos -= consumed;
+
+    return produced;
+}
@@ -0,0 +1,51 @@
+#ifndef LIBDMG_RESAMPLER_HPP
+#define LIBDMG_RESAMPLER_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+namespace LibDMG
+{
+    // Polyphase FIR resampler for interleaved 16-bit stereo. The filter is
+    // a windowed sinc with its cutoff below the lower of the two Nyquist
+    // frequencies, tabulated for PHASES fractional positions. The dot
+    // products use SSE2 when available, with a scalar fallback.
+    class Resampler
+    {
+    public:
+        static const int TAPS = 32;
+        static const int PHASES = 256;
+
+        Resampler(int inputRate, int outputRate);
+
+        // Scales the step between output samples, to slightly speed up or
+        // slow down the output for rate control. 1.0 is the nominal ratio.
+        void setRateAdjust(double adjust);
+        double rateAdjust() const { return m_adjust; }
+
+        // Upper bound of the number of frames produced for inFrames frames
+        size_t maxOutput(size_t inFrames) const;
+
+        // Consumes all the input frames and returns the number of frames
+        // written to out, which must hold at least maxOutput(inFrames).
+        size_t process(const int16_t *in, size_t inFrames, int16_t *out);
+
+        void reset();
+
+    private:
+        static const int BLOCK = 512;   // Input frames filtered at a time
+
+        double m_step;          // Input frames per output frame
+        double m_adjust;
+        double m_pos;           // Position of the next output in the history
+        size_t m_count;         // Frames in the history
+
+        alignas(16) float m_kernel[PHASES][TAPS];
+        alignas(16) float m_left[TAPS + BLOCK];
+        alignas(16) float m_right[TAPS + BLOCK];
+
+        size_t filterBlock(int16_t *out);
+    };
+}
+
+#endif // LIBDMG_RESAMPLER_HPP
@@ -0,0 +1,108 @@
+#include "wav_writer.hpp"
+
+#include <cstring>
+
+#include "audio_output.hpp"
+
+using namespace LibDMG;
+using namespace std;
+
+namespace
+{
+    void putLe16(uint8_t *buf, uint16_t val)
+    {
+        buf[0] = static_cast<uint8_t>(val);
+        buf[1] = static_cast<uint8_t>(val >> 8);
+    }
+
+    void putLe32(uint8_t *buf, uint32_t val)
+    {
+        putLe16(buf, static_cast<uint16_t>(val));
+        putLe16(buf + 2, static_cast<uint16_t>(val >> 16));
+    }
+
+    const int CHANNELS = 2;
+    const int BYTES_PER_FRAME = CHANNELS * 2;
+    const size_t HEADER_SIZE = 44;
+}
+
+void WavWriter::open(const string& path, int sampleRate)
+{
+    close();
+
+    m_file.open(path.c_str(), ios_base::out | ios_base::binary | ios_base::trunc);
+    if (!m_file.is_open())
+    {
+        throw WavWriterException("Invalid file");
+    }
+
+    m_sampleRate = sampleRate;
+    m_frames = 0;
+    writeHeader();
+}
+
+void WavWriter::close()
+{
+    if (!m_file.is_open())
+    {
+        return;
+    }
+
+    m_file.seekp(0);
+    writeHeader();
+    m_file.close();
+}
+
+void WavWriter::writeHeader()
+{
+    uint32_t dataSize = m_frames * BYTES_PER_FRAME;
+    uint8_t header[HEADER_SIZE];
+
+    memcpy(header, "RIFF", 4);
+    putLe32(header + 4, static_cast<uint32_t>(HEADER_SIZE - 8) + dataSize);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    putLe32(header + 16, 16);       // Format chunk size
+    putLe16(header + 20, 1);        // PCM
+    putLe16(header + 22, CHANNELS);
+    putLe32(header + 24, m_sampleRate);
+    putLe32(header + 28, m_sampleRate * BYTES_PER_FRAME);
+    putLe16(header + 32, BYTES_PER_FRAME);
+    putLe16(header + 34, 16);       // Bits per sample
+    memcpy(header + 36, "data", 4);
+    putLe32(header + 40, dataSize);
+
+    m_file.write(reinterpret_cast<const char *>(header), HEADER_SIZE);
+}
+
+void WavWriter::write(const int16_t *samples, size_t frames)
+{
+    if (!m_file.is_open())
+    {
+        return;
+    }
+
+    uint8_t buf[256 * BYTES_PER_FRAME];
+    while (frames > 0)
+    {
+        size_t count = (frames < 256) ? frames : 256;
+        for (size_t i = 0; i < count * CHANNELS; i++)
+        {
+            putLe16(buf + 2 * i, static_cast<uint16_t>(samples[i]));
+        }
+        m_file.write(reinterpret_cast<const char *>(buf), count * BYTES_PER_FRAME);
+
+        samples += count * CHANNELS;
+        frames -= count;
+        m_frames += static_cast<uint32_t>(count);
+    }
+}
+
+void WavWriter::drain(AudioOutput& output)
+{
+    int16_t buf[1024 * CHANNELS];
+    size_t count;
+    while ((count = output.read(buf, 1024)) > 0)
+    {
+        write(buf, count);
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef LIBDMG_WAV_WRITER_HPP
+#define LIBDMG_WAV_WRITER_HPP
+
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <string>
+
+namespace LibDMG
+{
+    class AudioOutput;
+
+    // Writes 16-bit stereo PCM to a RIFF WAVE file. The chunk sizes are
+    // patched in when the file is closed.
+    class WavWriter
+    {
+    public:
+        WavWriter() : m_sampleRate(0), m_frames(0) {}
+        ~WavWriter() { close(); }
+
+        void open(const std::string& path, int sampleRate);
+        void close();
+        bool isOpen() const { return m_file.is_open(); }
+
+        // Interleaved stereo frames
+        void write(const int16_t *samples, size_t frames);
+        // Writes everything available in the output ring
+        void drain(AudioOutput& output);
+
+        uint32_t frames() const { return m_frames; }
+
+    private:
+        std::ofstream m_file;
+        int           m_sampleRate;
+        uint32_t      m_frames;
+
+        void writeHeader();
+    };
+
+    class WavWriterException : public std::exception
+    {
+    public:
+        WavWriterException(const std::string& msg)
+            : std::exception(),
+              m_msg("WavWriterException - " + msg)
+        { }
+
+        const char* what() const throw() { return m_msg.c_str(); }
+
+    private:
+        std::string m_msg;
+    };
+}
+
+#endif // LIBDMG_WAV_WRITER_HPP
@@ -0,0 +1,284 @@
+#include "batch_runner.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <thread>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "emulator.hpp"
+#include "logger.hpp"
+#include "test_rom_monitor.hpp"
+
+using namespace LibDMG;
+using namespace std;
+
+namespace
+{
+    // Per job, further messages are dropped
+    const size_t MAX_LOG_SIZE = 64 * 1024;
+
+    void appendLog(string& log, const char *prefix, const string& msg)
+    {
+        if (log.size() < MAX_LOG_SIZE)
+        {
+            log += prefix;
+            log += msg;
+            log += '\n';
+        }
+    }
+
+    // Installs a thread logger, and puts back the one the caller had
+    class ThreadLoggerScope
+    {
+    public:
+        explicit ThreadLoggerScope(Logger *logger) :
+            m_previous(Logger::threadLogger())
+        {
+            Logger::setThreadLogger(logger);
+        }
+        ~ThreadLoggerScope() { Logger::setThreadLogger(m_previous); }
+
+    private:
+        Logger *m_previous;
+    };
+}
+
+BatchRunner::BatchRunner(int threads, bool pinThreads) :
+    m_threads(threads),
+    m_pinThreads(pinThreads),
+    m_cores(availableCores())
+{
+    if (m_threads <= 0)
+    {
+        m_threads = max(1, static_cast<int>(m_cores.size()));
+    }
+}
+
+vector<BatchResult> BatchRunner::run(const vector<BatchJob>& jobs)
+{
+    vector<BatchResult> results(jobs.size());
+    int threads = min(m_threads, static_cast<int>(jobs.size()));
+    if (threads == 0)
+    {
+        return results;
+    }
+
+    // Deal the jobs out, workers steal from each other once their own run out
+    vector<unique_ptr<WorkQueue> > queues;
+    for (int i = 0; i < threads; i++)
+    {
+        queues.push_back(make_unique<WorkQueue>());
+    }
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        queues[i % threads]->jobs.push_back(i);
+    }
+
+    vector<thread> workers;
+    for (int i = 0; i < threads; i++)
+    {
+        workers.push_back(thread(&BatchRunner::worker, this, i, ref(queues), cref(jobs), ref(results)));
+    }
+    for (thread& worker : workers)
+    {
+        worker.join();
+    }
+    return results;
+}
+
+void BatchRunner::worker(int index, vector<unique_ptr<WorkQueue> >& queues,
+                         const vector<BatchJob>& jobs, vector<BatchResult>& results)
+{
+    if (m_pinThreads && queues.size() <= m_cores.size())
+    {
+        pinToCore(m_cores[index]);
+    }
+
+    int count = static_cast<int>(queues.size());
+    while (true)
+    {
+        // Own jobs from the front, stolen ones from the back
+        size_t job;
+        bool found = popJob(*queues[index], false, job);
+        for (int i = 1; i < count && !found; i++)
+        {
+            found = popJob(*queues[(index + i) % count], true, job);
+        }
+        if (!found)
+        {
+            // No job is ever added during a run
+            break;
+        }
+
+        results[job] = runJob(jobs[job]);
+        results[job].worker = index;
+    }
+}
+
+bool BatchRunner::popJob(WorkQueue& queue, bool steal, size_t& job)
+{
+    lock_guard<mutex> lock(queue.mutex);
+    if (queue.jobs.empty())
+    {
+        return false;
+    }
+
+    if (steal)
+    {
+        job = queue.jobs.back();
+        queue.jobs.pop_back();
+    }
+    else
+    {
+        job = queue.jobs.front();
+        queue.jobs.pop_front();
+    }
+    return true;
+}
+
+vector<int> BatchRunner::availableCores()
+{
+    vector<int> cores;
+#if defined(__linux__)
+    // Containers and taskset can restrict the process to some cores
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+    {
+        for (int core = 0; core < CPU_SETSIZE; core++)
+        {
+            if (CPU_ISSET(core, &set))
+            {
+                cores.push_back(core);
+            }
+        }
+    }
+#endif
+    if (cores.empty())
+    {
+        int count = max(1, static_cast<int>(thread::hardware_concurrency()));
+        for (int core = 0; core < count; core++)
+        {
+            cores.push_back(core);
+        }
+    }
+    return cores;
+}
+
+void BatchRunner::pinToCore(int core)
+{
+#if defined(__linux__)
+    // On failure the worker just stays unpinned
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)core;
+#endif
+}
+
+BatchResult BatchRunner::runJob(const BatchJob& job)
+{
+    BatchResult result;
+
+    // Messages of the job go to its result
+    Logger logger;
+    logger.setInfoCb([&result](const string& msg) { appendLog(result.log, "[INFO ]  ", msg); });
+    logger.setErrorCb([&result](const string& msg) { appendLog(result.log, "[ERROR] ", msg); });
+    logger.setWarnCb([&result](const string& msg) { appendLog(result.log, "[WARN ] ", msg); });
+    ThreadLoggerScope loggerScope(&logger);
+
+    try
+    {
+        unique_ptr<Emulator> emuPtr = job.defaultBootRom ? make_unique<Emulator>()
+                                                         : make_unique<Emulator>(job.bootRomPath);
+        Emulator& emu = *emuPtr;
+        if (job.setup)
+        {
+            job.setup(emu);
+        }
+
+        unique_ptr<TestRomMonitor> monitor;
+        auto captureSerial = [&result](uint8_t val) { result.serial.push_back(static_cast<char>(val)); };
+        if (job.stopOnTestResult)
+        {
+            monitor = make_unique<TestRomMonitor>(emu, captureSerial);
+        }
+        else
+        {
+            emu.periph()->serial()->setOutputCallback(captureSerial);
+        }
+        emu.periph()->lcd()->setFrameHashEnabled(job.frameHashes);
+
+        result.status = BatchResult::STATUS_COMPLETED;
+        size_t nextInput = 0;
+        while (true)
+        {
+            // The input queue is bounded, it is fed as the job goes
+            while (nextInput < job.inputs.size())
+            {
+                const InputEvent& event = job.inputs[nextInput];
+                if (!emu.pushInput(event.cycle, event.buttons, event.pressed))
+                {
+                    break;
+                }
+                nextInput++;
+            }
+
+            // Come back in time to push the events that did not fit
+            uint64_t target = job.maxCycles;
+            if (nextInput < job.inputs.size())
+            {
+                target = min(target, max(job.inputs[nextInput].cycle, emu.cycles() + 1));
+            }
+
+            Emulator::StopReason reason = emu.runUntil(target, true);
+            if (reason == Emulator::STOP_CYCLE && emu.cycles() < job.maxCycles)
+            {
+                continue;
+            }
+            if (reason == Emulator::STOP_VBLANK)
+            {
+                result.frames++;
+                if (job.frameHashes)
+                {
+                    result.frameHashes.push_back(emu.periph()->lcd()->frameHash());
+                }
+                continue;
+            }
+
+            if (reason == Emulator::STOP_BREAKPOINT)
+            {
+                result.status = BatchResult::STATUS_BREAKPOINT;
+            }
+            else if (monitor != nullptr)
+            {
+                switch (monitor->result())
+                {
+                case TestRomMonitor::RESULT_PASSED: result.status = BatchResult::STATUS_PASSED; break;
+                case TestRomMonitor::RESULT_FAILED: result.status = BatchResult::STATUS_FAILED; break;
+                default: result.status = BatchResult::STATUS_TIMEOUT; break;
+                }
+            }
+            break;
+        }
+
+        result.cycles = emu.cycles();
+        for (uint32_t i = 0; i < job.ramDumpSize; i++)
+        {
+            result.ram.push_back(emu.mem().read(static_cast<uint16_t>(job.ramDumpStart + i)));
+        }
+    }
+    catch (const exception& e)
+    {
+        result.status = BatchResult::STATUS_ERROR;
+        result.error = e.what();
+    }
+
+    return result;
+}
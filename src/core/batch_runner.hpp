@@ -0,0 +1,108 @@
+#ifndef LIBDMG_BATCH_RUNNER_HPP
+#define LIBDMG_BATCH_RUNNER_HPP
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace LibDMG
+{
+    class Emulator;
+
+    // Button change at an emulated cycle, see Emulator::pushInput()
+    struct InputEvent
+    {
+        uint64_t cycle;
+        uint8_t  buttons;   // Joypad::Button mask
+        bool     pressed;
+    };
+
+    struct BatchJob
+    {
+        std::string name;
+        // The emulator boots through the default boot ROM, unless
+        // defaultBootRom is false: then through bootRomPath, or from 0x100
+        // if it is empty
+        bool        defaultBootRom = true;
+        std::string bootRomPath;
+        // Prepares a fresh emulator: program, state, breakpoints...
+        std::function<void(Emulator&)> setup;
+        std::vector<InputEvent> inputs;
+        // Timeout, in emulated cycles
+        uint64_t maxCycles = 60ULL * 70224;
+        // Ends the job as soon as a TestRomMonitor knows the verdict
+        bool     stopOnTestResult = false;
+        bool     frameHashes = false;
+        // Memory copied at the end of the job, from ramDumpStart
+        uint16_t ramDumpStart = 0xC000;
+        uint16_t ramDumpSize = 0;
+    };
+
+    struct BatchResult
+    {
+        enum Status
+        {
+            STATUS_COMPLETED,   // Ran for maxCycles
+            STATUS_PASSED,
+            STATUS_FAILED,
+            STATUS_TIMEOUT,     // No test verdict within maxCycles
+            STATUS_BREAKPOINT,
+            STATUS_ERROR        // The job threw, see error
+        };
+
+        Status                status = STATUS_ERROR;
+        uint64_t              cycles = 0;
+        uint32_t              frames = 0;
+        std::string           serial;
+        std::vector<uint32_t> frameHashes;
+        std::vector<uint8_t>  ram;
+        std::string           log;
+        std::string           error;
+        int                   worker = -1;
+    };
+
+    // Runs independent jobs, one emulator each, on a pool of threads. Each
+    // worker takes jobs from its own deque and steals from the others when
+    // it runs out, so long and short jobs balance out. Workers can be pinned
+    // to the cores the process may run on (Linux only), one core each, and
+    // each one has its own Logger.
+    class BatchRunner
+    {
+    public:
+        // 0 threads uses one per core available to the process. Threads are
+        // only pinned if there are enough cores for one each.
+        explicit BatchRunner(int threads = 0, bool pinThreads = false);
+
+        // Results are in the order of the jobs
+        std::vector<BatchResult> run(const std::vector<BatchJob>& jobs);
+
+        // Runs a single job on the calling thread
+        static BatchResult runJob(const BatchJob& job);
+
+        int threadCount() const { return m_threads; }
+
+    private:
+        struct WorkQueue
+        {
+            std::mutex         mutex;
+            std::deque<size_t> jobs;
+        };
+
+        int  m_threads;
+        bool m_pinThreads;
+        // Cores the process may run on
+        std::vector<int> m_cores;
+
+        void worker(int index, std::vector<std::unique_ptr<WorkQueue> >& queues,
+                    const std::vector<BatchJob>& jobs, std::vector<BatchResult>& results);
+        static bool popJob(WorkQueue& queue, bool steal, size_t& job);
+        static std::vector<int> availableCores();
+        static void pinToCore(int core);
+    };
+}
+
+#endif // LIBDMG_BATCH_RUNNER_HPP
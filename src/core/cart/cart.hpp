@@ -1,6 +1,7 @@
 #ifndef LIBDMG_CART_HPP
 #define LIBDMG_CART_HPP
 
+#include <cstdint>
 #include <string>
 #include <memory>
 #include <exception>
@@ -44,6 +45,8 @@ namespace LibDMG
         Cart(const std::string& filePath);
 
         uint32_t    rawMemSize() const { return m_rawMemSize; }
+        // Past the end of the file, reads as an open bus
+        uint8_t     read(uint32_t addr) const { return (addr < m_rawMemSize) ? m_rawMem[addr] : 0xFF; }
         std::string titleStr() const { return std::string(reinterpret_cast<const char *>(m_title), CART_SIZE_TITLE); }
         bool        isColorGb() const { return m_isColorGb; }
         bool        isSgb() const { return m_isSgb; }
@@ -12,25 +12,34 @@ using namespace std;
 
 
 //..................................................................................................
-void Cpu::step(const Emulator& emu, int cycles)
+int Cpu::step(const Emulator& emu, int cycles)
 {
-	while (cycles > 0)
+	int remaining = cycles;
+	while (remaining > 0)
 	{
 		if (m_instrCycles == 0)
 		{
+			// Stop between two instructions
+			if (emu.stopRequested() || emu.isBreakpoint(m_regPC))
+			{
+				break;
+			}
+
 			// Process interrupts
 			emu.periph()->processInterrupts();
 
 			// Fetch and execute next instruction
 			nextInstruction(emu);
+			m_instructions++;
 		}
 		else
 		{
-			int tmp = std::min(cycles, m_instrCycles);
+			int tmp = std::min(remaining, m_instrCycles);
 			m_instrCycles -= tmp;
-			cycles -= tmp;
+			remaining -= tmp;
 		}
 	}
+	return cycles - remaining;
 }
 
 void Cpu::setReg16(Reg16 reg, uint16_t val)
@@ -258,7 +267,10 @@ void Cpu::nextInstruction(const Emulator& emu)
 	case 0x3C: CpuInstr::incReg8(*this, REG8_A); break;
 	case 0x3D: CpuInstr::decReg8(*this, REG8_A); break;
 	case 0x3E: CpuInstr::ldReg8Imm(*this, REG8_A, emu.mem()); break;
-	case 0x40: CpuInstr::ldReg8Reg8(*this, REG8_B, REG8_B); break;
+	case 0x40:
+		CpuInstr::ldReg8Reg8(*this, REG8_B, REG8_B);
+		emu.debugTrap();
+		break;
 	case 0x41: CpuInstr::ldReg8Reg8(*this, REG8_B, REG8_C); break;
 	case 0x42: CpuInstr::ldReg8Reg8(*this, REG8_B, REG8_D); break;
 	case 0x43: CpuInstr::ldReg8Reg8(*this, REG8_B, REG8_E); break;
@@ -40,13 +40,18 @@ namespace LibDMG
 		Cpu() : m_instrCycles(0),
 				m_opcode(0),
 				m_regSP(0),
-				m_regPC(0)
+				m_regPC(0),
+				m_instructions(0)
         {
             m_parameters.fill(0);
             m_reg8.fill(0);
         }
 
-        void step(const Emulator& emu, int cycles);
+        // Returns the cycles run, less than asked if the emulator is stopped
+        // or the next instruction is at a breakpoint
+        int step(const Emulator& emu, int cycles);
+        // Instructions started by step(), for statistics: not part of the state
+        uint64_t instructions() const { return m_instructions; }
 
         void saveState(std::ostream& out) { cereal::XMLOutputArchive ar(out); serialize(ar); }
         void loadState(std::istream& in) { cereal::XMLInputArchive ar(in); serialize(ar); }
@@ -78,6 +83,7 @@ namespace LibDMG
 
     private:
 		friend class CpuInstr;
+		friend class LockstepEngine;
 
         int		m_instrCycles;
 		uint8_t m_opcode;
@@ -85,6 +91,7 @@ namespace LibDMG
         std::array<uint8_t, 8> m_reg8;
         uint16_t m_regPC;
         uint16_t m_regSP;
+        uint64_t m_instructions;
 
         void nextInstruction(const Emulator& emu);
     };
@@ -1,17 +1,369 @@
 #include "emulator.hpp"
 
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <string>
+
+#include "utils/crc32c.hpp"
+
 using namespace LibDMG;
 using namespace std;
 
-Emulator::Emulator()
+Emulator::Emulator() :
+    Emulator(nullptr, MemControllerRomOnly::DEFAULT_BOOT_ROM_PATH)
+{
+}
+
+Emulator::Emulator(const string& bootRomPath) :
+    Emulator(nullptr, bootRomPath)
 {
+    if (bootRomPath.empty())
+    {
+        skipBootRom();
+    }
+}
+
+Emulator::Emulator(MemControllerBase *parentMem, const string& bootRomPath) :
+    m_frameDumper(nullptr),
+    m_audioOutput(nullptr),
+    m_cycles(0),
+    m_snapshotSize(0),
+    m_stopRequested(false),
+    m_hasBreakpoints(false)
+{
+    m_framebuffer = make_unique<Framebuffer>();
     m_cpu = make_unique<Cpu>();
     m_periph = make_unique<Peripherals>(this);
-    m_mem = make_unique<MemControllerRomOnly>(this);
+    if (parentMem != nullptr)
+    {
+        m_mem = parentMem->clone(this);
+    }
+    else
+    {
+        m_mem = make_unique<MemControllerRomOnly>(this, bootRomPath);
+    }
+
+    SnapshotSizer sizer;
+    serialize(sizer);
+    m_snapshotSize = sizer.size();
+
+    SnapshotSizer registers;
+    registers(m_cpu, m_periph, m_cycles);
+    m_hashBuffer.resize(registers.size());
 }
 
-void Emulator::step(int cycles)
+int Emulator::step(int cycles)
 {
-    m_cpu->step(*this, cycles);
-    m_periph->step(cycles);
-}
\ No newline at end of file
+    Joypad *joypad = m_periph->joypad();
+    int done = 0;
+    while (done < cycles)
+    {
+        uint64_t next = joypad->nextEventCycle();
+        if (next <= m_cycles)
+        {
+            joypad->applyEvents(m_cycles);
+            continue;
+        }
+
+        // Run up to the next input event, and only up to the next peripheral
+        // event so that the CPU sees LY, STAT and the timers move and gets
+        // their interrupts on time
+        int count = std::min(cycles - done, m_periph->cyclesUntilNextEvent());
+        if (next - m_cycles < static_cast<uint64_t>(count))
+        {
+            count = static_cast<int>(next - m_cycles);
+        }
+
+        int ran = m_cpu->step(*this, count);
+        m_periph->step(ran);
+        m_cycles += ran;
+        done += ran;
+        if (ran < count)
+        {
+            // Stop requested or breakpoint reached
+            break;
+        }
+    }
+    return done;
+}
+
+Emulator::StopReason Emulator::runUntil(uint64_t cycle, bool stopAtVBlank)
+{
+    if (m_hasBreakpoints && m_breakpoints[m_cpu->reg16(Cpu::REG16_PC)] && !m_stopRequested && m_cycles < cycle)
+    {
+        // Leave the breakpoint the previous run stopped at
+        m_hasBreakpoints = false;
+        step(1);
+        m_hasBreakpoints = true;
+    }
+
+    while (true)
+    {
+        if (m_stopRequested)
+        {
+            return STOP_REQUESTED;
+        }
+        if (m_cycles >= cycle)
+        {
+            return STOP_CYCLE;
+        }
+
+        int count = static_cast<int>(std::min<uint64_t>(RUN_MAX_CYCLES, cycle - m_cycles));
+        bool toVBlank = false;
+        if (stopAtVBlank)
+        {
+            int vblank = m_periph->lcd()->cyclesUntilVBlank();
+            if (vblank <= count)
+            {
+                count = vblank;
+                toVBlank = true;
+            }
+        }
+
+        int ran = step(count);
+        if (ran < count)
+        {
+            return m_stopRequested ? STOP_REQUESTED : STOP_BREAKPOINT;
+        }
+        if (toVBlank)
+        {
+            return STOP_VBLANK;
+        }
+    }
+}
+
+void Emulator::setBreakpoint(uint16_t pc, bool enabled)
+{
+    m_breakpoints[pc] = enabled;
+    m_hasBreakpoints = m_breakpoints.any();
+}
+
+uint32_t Emulator::stateHash()
+{
+    // Registers are small enough to be hashed whole
+    SnapshotWriter ar(m_hashBuffer.data());
+    ar(m_cpu, m_periph, m_cycles);
+    return crc32c(m_mem->memoryHash(), m_hashBuffer.data(), m_hashBuffer.size());
+}
+
+void Emulator::skipBootRom()
+{
+    // Registers as the DMG boot ROM leaves them
+    m_cpu->setReg16(Cpu::REG16_AF, 0x01B0);
+    m_cpu->setReg16(Cpu::REG16_BC, 0x0013);
+    m_cpu->setReg16(Cpu::REG16_DE, 0x00D8);
+    m_cpu->setReg16(Cpu::REG16_HL, 0x014D);
+    m_cpu->setReg16(Cpu::REG16_SP, 0xFFFE);
+    m_cpu->setReg16(Cpu::REG16_PC, 0x0100);
+
+    m_mem->write(0xFF26, 0xF1);     // NR52
+    m_mem->write(0xFF25, 0xF3);     // NR51
+    m_mem->write(0xFF24, 0x77);     // NR50
+    m_mem->write(0xFF47, 0xFC);     // BGP
+    m_mem->write(0xFF48, 0xFF);     // OBP0
+    m_mem->write(0xFF49, 0xFF);     // OBP1
+    m_mem->write(0xFF40, 0x91);     // LCDC
+}
+
+unique_ptr<Emulator> Emulator::clone()
+{
+    unique_ptr<Emulator> copy(new Emulator(m_mem.get(), string()));
+
+    // Through a snapshot, so that the copy rebuilds its caches as on restore()
+    SnapshotWriter out(m_hashBuffer.data());
+    out(m_cpu, m_periph, m_cycles);
+    SnapshotReader in(m_hashBuffer.data());
+    in(copy->m_cpu, copy->m_periph, copy->m_cycles);
+
+    if (m_hasBreakpoints)
+    {
+        copy->m_breakpoints = m_breakpoints;
+        copy->m_hasBreakpoints = true;
+    }
+    copy->m_debugTrap = m_debugTrap;
+    return copy;
+}
+
+uint64_t Emulator::runUntilStop(uint64_t maxCycles)
+{
+    uint64_t start = m_cycles;
+    runUntilCycle(m_cycles + maxCycles);
+    return m_cycles - start;
+}
+
+namespace
+{
+    const char STATE_MAGIC[4] = { 'D', 'M', 'G', 'S' };
+
+    // Section tags
+    const char SECTION_CPU[4] = { 'C', 'P', 'U', ' ' };
+    const char SECTION_PERIPH[4] = { 'P', 'E', 'R', 'I' };
+    const char SECTION_MEM[4] = { 'M', 'E', 'M', ' ' };
+    const char SECTION_PAGES[4] = { 'P', 'A', 'G', 'E' };
+    const char SECTION_EMU[4] = { 'E', 'M', 'U', ' ' };
+
+    uint32_t readU32(const uint8_t *data)
+    {
+        return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+    }
+
+    template <class T>
+    void writeSection(BinaryOutputArchive& ar, const char *tag, T& obj)
+    {
+        ar.writeBytes(tag, 4);
+        size_t pos = ar.beginBlock();
+        obj.serialize(ar);
+        ar.endBlock(pos);
+    }
+}
+
+const uint32_t Emulator::STATE_VERSION;
+
+void Emulator::saveState(std::vector<uint8_t>& out)
+{
+    writeState(out, false);
+}
+
+void Emulator::saveIncremental(std::vector<uint8_t>& out)
+{
+    writeState(out, true);
+}
+
+void Emulator::writeState(std::vector<uint8_t>& out, bool incremental)
+{
+    out.clear();
+    BinaryOutputArchive ar(out);
+    ar.writeBytes(STATE_MAGIC, 4);
+    uint32_t version = STATE_VERSION;
+    ar(version);
+
+    writeSection(ar, SECTION_CPU, *m_cpu);
+    writeSection(ar, SECTION_PERIPH, *m_periph);
+
+    if (incremental)
+    {
+        // Index and content of each dirty page
+        ar.writeBytes(SECTION_PAGES, 4);
+        size_t pos = ar.beginBlock();
+        for (size_t i = 0; i < m_mem->pageCount(); i++)
+        {
+            if (m_mem->isPageDirty(i))
+            {
+                uint16_t index = static_cast<uint16_t>(i);
+                ar(index);
+                ar.writeBytes(m_mem->page(i), m_mem->pageSize(i));
+            }
+        }
+        ar.endBlock(pos);
+        checkpoint();
+    }
+    else
+    {
+        writeSection(ar, SECTION_MEM, *m_mem);
+    }
+
+    ar.writeBytes(SECTION_EMU, 4);
+    size_t pos = ar.beginBlock();
+    ar(m_cycles);
+    ar.endBlock(pos);
+}
+
+void Emulator::loadState(const uint8_t *data, size_t size)
+{
+    if (size < 8 || memcmp(data, STATE_MAGIC, 4) != 0)
+    {
+        throw StateException("Not a save state");
+    }
+    uint32_t version = readU32(data + 4);
+    if (version > STATE_VERSION)
+    {
+        throw StateException("Save state version " + to_string(version) + " is not supported");
+    }
+
+    // Check the framing of every section before changing anything, so that
+    // a bad state leaves the emulator as it was
+    size_t pos = 8;
+    while (pos < size)
+    {
+        if (size - pos < 8)
+        {
+            throw StateException("Truncated save state");
+        }
+        const uint8_t *tag = data + pos;
+        uint32_t length = readU32(data + pos + 4);
+        pos += 8;
+        if (length > size - pos)
+        {
+            throw StateException("Truncated save state");
+        }
+
+        if (memcmp(tag, SECTION_PAGES, 4) == 0)
+        {
+            size_t page = 0;
+            while (length - page >= 2)
+            {
+                uint16_t index = static_cast<uint16_t>(data[pos + page] | (data[pos + page + 1] << 8));
+                if (index >= m_mem->pageCount())
+                {
+                    throw StateException("Invalid memory page " + to_string(index));
+                }
+                page += 2 + m_mem->pageSize(index);
+                if (page > length)
+                {
+                    throw StateException("Truncated save state");
+                }
+            }
+        }
+        pos += length;
+    }
+
+    pos = 8;
+    while (pos < size)
+    {
+        const uint8_t *tag = data + pos;
+        uint32_t length = readU32(data + pos + 4);
+        pos += 8;
+
+        BinaryInputArchive ar(data + pos, length);
+        if (memcmp(tag, SECTION_CPU, 4) == 0)
+        {
+            m_cpu->serialize(ar);
+        }
+        else if (memcmp(tag, SECTION_PERIPH, 4) == 0)
+        {
+            m_periph->serialize(ar);
+        }
+        else if (memcmp(tag, SECTION_MEM, 4) == 0)
+        {
+            m_mem->serialize(ar);
+        }
+        else if (memcmp(tag, SECTION_PAGES, 4) == 0)
+        {
+            while (ar.remaining() >= 2)
+            {
+                uint16_t index = 0;
+                ar(index);
+                ar.readBytes(m_mem->writablePage(index), m_mem->pageSize(index));
+            }
+        }
+        else if (memcmp(tag, SECTION_EMU, 4) == 0)
+        {
+            ar(m_cycles);
+        }
+        pos += length;
+    }
+}
+
+void Emulator::saveState(std::ostream &out)
+{
+    std::vector<uint8_t> data;
+    saveState(data);
+    out.write(reinterpret_cast<const char *>(data.data()), data.size());
+}
+
+void Emulator::loadState(std::istream &in)
+{
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    loadState(data.data(), data.size());
+}
@@ -1,41 +1,191 @@
 #ifndef LIBDMG_EMULATOR_HPP
 #define LIBDMG_EMULATOR_HPP
 
+#include <bitset>
 #include <exception>
+#include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 #include <cereal/archives/xml.hpp>
 #include <cereal/types/memory.hpp>
 
 #include "cpu/cpu.hpp"
 #include "peripherals/peripherals.hpp"
 #include "mem/mem_controller_rom_only.hpp"
+#include "video/framebuffer.hpp"
+#include "video/frame_dumper.hpp"
+#include "audio/audio_output.hpp"
+#include "state/binary_archive.hpp"
+#include "state/snapshot_archive.hpp"
 
 namespace LibDMG
 {
     class Emulator
     {
     public:
+        enum StopReason
+        {
+            STOP_CYCLE,         // Reached the target cycle
+            STOP_VBLANK,        // At the first cycle of VBlank
+            STOP_BREAKPOINT,    // Before the instruction at a breakpoint
+            STOP_REQUESTED      // By requestStop()
+        };
+
+        // Boots through the boot ROM at MemControllerRomOnly::DEFAULT_BOOT_ROM_PATH
         Emulator();
+        // Boots through the given boot ROM. Without one (empty path), starts
+        // at 0x100 with the registers as the boot ROM leaves them.
+        explicit Emulator(const std::string& bootRomPath);
+
+        // Inserts a cartridge, nullptr removes it. A cart can be shared by
+        // any number of emulators.
+        void insertCart(const std::shared_ptr<const Cart>& cart) { m_mem->setCart(cart); }
+
+        // Returns the cycles run, less than asked if a stop is requested or
+        // a breakpoint is reached.
+        // Steps are split at the cycles of pending input events.
+        int step(int cycles);
+        // Cycles run since power on
+        uint64_t cycles() const { return m_cycles; }
+
+        // Any thread: presses or releases buttons (Joypad::Button mask) at
+        // the given emulated cycle. Returns false if the queue is full.
+        bool pushInput(uint64_t cycle, uint8_t buttons, bool pressed)
+        {
+            return m_periph->joypad()->pushEvent(cycle, buttons, pressed);
+        }
+        // Steps until a stop is requested, a breakpoint is reached or
+        // maxCycles have run, returns the number of cycles run
+        uint64_t runUntilStop(uint64_t maxCycles);
 
-        void step(int cycles);
+        // Runs until the given cycle, a breakpoint, a stop request or, if
+        // asked, the start of VBlank. Stopping at VBlank is exact to the
+        // cycle, the CPU may then be in the middle of an instruction.
+        StopReason runUntil(uint64_t cycle, bool stopAtVBlank);
+        StopReason runUntilCycle(uint64_t cycle) { return runUntil(cycle, false); }
+        StopReason runFrame() { return runUntil(UINT64_MAX, true); }
+
+        // PC breakpoints, checked by the CPU before each instruction. A run
+        // starting on a breakpoint executes that instruction first.
+        void setBreakpoint(uint16_t pc, bool enabled = true);
+        void clearBreakpoints() { m_breakpoints.reset(); m_hasBreakpoints = false; }
+        bool isBreakpoint(uint16_t pc) const { return m_hasBreakpoints && m_breakpoints[pc]; }
+
+        // Ends step() and the run functions after the current instruction, until cleared
+        void requestStop() { m_stopRequested = true; }
+        void clearStop() { m_stopRequested = false; }
+        bool stopRequested() const { return m_stopRequested; }
+
+        // Called by the CPU on LD B,B, the software breakpoint used by test
+        // ROMs. An empty function disables it.
+        void setDebugTrap(std::function<void()> trap) { m_debugTrap = trap; }
+        void debugTrap() const
+        {
+            if (m_debugTrap)
+            {
+                m_debugTrap();
+            }
+        }
 
         Cpu * const cpu() const { return m_cpu.get(); }
         Peripherals * const periph() const { return m_periph.get(); }
         MemControllerBase& mem() const { return *m_mem.get(); }
+        Framebuffer * const framebuffer() const { return m_framebuffer.get(); }
+        FrameDumper * const frameDumper() const { return m_frameDumper; }
+        AudioOutput * const audioOutput() const { return m_audioOutput; }
+
+        // The dumper is owned by the caller, nullptr detaches it
+        void setFrameDumper(FrameDumper *dumper) { m_frameDumper = dumper; }
+        // Same for the audio output, which is fed at every VBlank
+        void setAudioOutput(AudioOutput *output) { m_audioOutput = output; }
 
-        void saveState(std::ostream &out) { cereal::XMLOutputArchive ar(out); serialize(ar); }
-        void loadState(std::istream &in) { cereal::XMLInputArchive ar(in); serialize(ar); }
+        // Turns sample synthesis on or off. Sound registers keep behaving
+        // as seen by software either way.
+        void setAudioEnabled(bool enabled) { m_periph->apu()->setSynthesisEnabled(enabled); }
+        bool audioEnabled() const { return m_periph->apu()->isSynthesisEnabled(); }
+
+        // Save states use a binary format: a header with the format version,
+        // then one section per component, each with its length. Sections
+        // unknown to this version are skipped, and fields missing at the end
+        // of a section keep their value, so states stay loadable when fields
+        // are added. Loading throws a StateException on a foreign file, a
+        // newer version or a truncated state, and then changes nothing.
+        static const uint32_t STATE_VERSION = 1;
+
+        void saveState(std::vector<uint8_t>& out);
+        void loadState(const uint8_t *data, size_t size);
+        void saveState(std::ostream &out);
+        void loadState(std::istream &in);
+
+        // Same format, but only with the memory pages written since the last
+        // checkpoint, which is the last checkpoint() or saveIncremental().
+        // Loaded over the state of that checkpoint, it gives the state at
+        // the time it was taken. Full saves do not move the checkpoint, so
+        // they can be taken at any time without breaking a chain: call
+        // checkpoint() with the saveState() that a chain starts from.
+        void saveIncremental(std::vector<uint8_t>& out);
+        void checkpoint() { m_mem->clearDirtyPages(); }
+
+        // Copies the whole machine state to or from a buffer of
+        // snapshotSize() bytes. Snapshots are flat copies, only meant to be
+        // restored by the same build: use saveState() to store states.
+        size_t snapshotSize() const { return m_snapshotSize; }
+        void snapshot(uint8_t *buffer) { SnapshotWriter ar(buffer); serialize(ar); }
+        void restore(const uint8_t *buffer) { SnapshotReader ar(buffer); serialize(ar); }
+
+        // Hash of the CPU, peripheral and memory state, to check that two
+        // emulators have not diverged. Only the memory pages written since
+        // the last call are hashed again.
+        uint32_t stateHash();
+
+        // Copy of the machine, to try several futures from one state. Memory
+        // pages are shared until either side writes them, so a clone costs
+        // the registers and a page table, not the RAM. Breakpoints and the
+        // debug trap are copied, and so are pending inputs; the frame
+        // dumper, audio output and framebuffer content are not. Must not run
+        // concurrently with other calls on this emulator, the clone can then
+        // run on any thread.
+        std::unique_ptr<Emulator> clone();
+
+        // Human readable export of the same state, for debugging
+        void exportXml(std::ostream &out) { cereal::XMLOutputArchive ar(out); serialize(ar); }
+        void importXml(std::istream &in) { cereal::XMLInputArchive ar(in); serialize(ar); }
         template <class Archive>
         void serialize(Archive &ar)
         {
             ar(CEREAL_NVP(m_cpu),
-            CEREAL_NVP(m_periph));
+            CEREAL_NVP(m_periph),
+            cereal::make_nvp("m_mem", *m_mem),
+            CEREAL_NVP(m_cycles));
         }
 
     private:
+        friend class LockstepEngine;
+
+        // Shares the memory of parentMem, or creates one with the boot ROM
+        Emulator(MemControllerBase *parentMem, const std::string& bootRomPath);
+
+        void skipBootRom();
+
+        void writeState(std::vector<uint8_t>& out, bool incremental);
+
         std::unique_ptr<Cpu>         m_cpu;
         std::unique_ptr<Peripherals> m_periph;
         std::unique_ptr<MemControllerBase> m_mem;
+        std::unique_ptr<Framebuffer> m_framebuffer;
+        FrameDumper *                m_frameDumper;
+        AudioOutput *                m_audioOutput;
+        uint64_t                     m_cycles;
+        size_t                       m_snapshotSize;
+        std::vector<uint8_t>         m_hashBuffer;
+        bool                         m_stopRequested;
+        std::bitset<0x10000>         m_breakpoints;
+        bool                         m_hasBreakpoints;
+        std::function<void()>        m_debugTrap;
+
+        // Longest step() of runUntil()
+        static const int RUN_MAX_CYCLES = 1 << 30;
     };
 }
 
@@ -4,12 +4,32 @@
 using namespace std;
 using namespace LibDMG;
 
+namespace
+{
+    thread_local Logger* currentThreadLogger = nullptr;
+}
+
 Logger* Logger::instance() {
+    if (currentThreadLogger != nullptr)
+    {
+        return currentThreadLogger;
+    }
+
     static Logger instance;
     
     return &instance;
 }
 
+void Logger::setThreadLogger(Logger* logger)
+{
+    currentThreadLogger = logger;
+}
+
+Logger* Logger::threadLogger()
+{
+    return currentThreadLogger;
+}
+
 Logger::Logger() : 
     m_errorCb(defaultErrorCb),
     m_infoCb(defaultInfoCb),
@@ -26,10 +26,20 @@
 
 namespace LibDMG
 {
+    // Process-wide logger. A thread can install its own logger instead, so
+    // that threads running separate emulators do not share callbacks.
     class Logger
     {        
     public:
+        Logger();
+
+        // The thread logger if one is installed, the process-wide one otherwise
         static Logger* instance();
+        // nullptr goes back to the process-wide logger
+        static void setThreadLogger(Logger* logger);
+        // The logger installed for this thread, nullptr if none
+        static Logger* threadLogger();
+
         void logInfo(const std::string& msg) { m_infoCb(msg); }
         void logError(const std::string& msg) { m_errorCb(msg); }
         void logWarn(const std::string& msg) { m_warnCb(msg); }
@@ -56,8 +66,6 @@ namespace LibDMG
         std::function<void(const std::string& msg)> m_infoCb;
         std::function<void(const std::string& msg)> m_errorCb;
         std::function<void(const std::string& msg)> m_warnCb;
-    
-        Logger();
     };
 }
 
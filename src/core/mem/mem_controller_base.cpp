@@ -0,0 +1,91 @@
+#include "mem_controller_base.hpp"
+
+#include <atomic>
+#include <cstring>
+
+#include "utils/crc32c.hpp"
+
+namespace LibDMG
+{
+const size_t MemControllerBase::PAGE_SIZE;
+
+uint32_t MemControllerBase::memoryHash()
+{
+    for (size_t index = 0; index < m_pageHashes.size(); index++)
+    {
+        if ((m_staleHashes[index / 64] >> (index % 64)) & 1)
+        {
+            m_pageHashes[index] = crc32c(page(index), pageSize(index));
+        }
+    }
+    std::fill(m_staleHashes.begin(), m_staleHashes.end(), 0);
+
+    return crc32c(m_pageHashes.data(), m_pageHashes.size() * sizeof(uint32_t));
+}
+
+size_t MemControllerBase::addArea(size_t size)
+{
+    size_t first = m_pages.size();
+    for (size_t offset = 0; offset < size; offset += PAGE_SIZE)
+    {
+        m_pages.push_back(std::make_shared<Page>());
+        m_pages.back()->fill(0);
+        m_pageData.push_back(m_pages.back()->data());
+        m_pageSizes.push_back(std::min(PAGE_SIZE, size - offset));
+    }
+
+    size_t count = m_pages.size();
+    m_ownedPages.assign((count + 63) / 64, ~0ULL);
+    m_dirtyPages.assign((count + 63) / 64, ~0ULL);
+    m_staleHashes.assign((count + 63) / 64, ~0ULL);
+    m_pageHashes.assign(count, 0);
+    return first;
+}
+
+void MemControllerBase::sharePages(MemControllerBase& from)
+{
+    m_pages = from.m_pages;
+    m_pageData = from.m_pageData;
+    m_pageSizes = from.m_pageSizes;
+    m_dirtyPages = from.m_dirtyPages;
+    m_staleHashes = from.m_staleHashes;
+    m_pageHashes = from.m_pageHashes;
+
+    // The next write on either side copies the page
+    m_ownedPages.assign(from.m_ownedPages.size(), 0);
+    std::fill(from.m_ownedPages.begin(), from.m_ownedPages.end(), 0);
+}
+
+void MemControllerBase::ownPage(size_t index)
+{
+    if (m_pages[index].use_count() > 1)
+    {
+        m_pages[index] = std::make_shared<Page>(*m_pages[index]);
+        m_pageData[index] = m_pages[index]->data();
+    }
+    else
+    {
+        // The other users are gone, maybe on other threads
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    m_ownedPages[index / 64] |= 1ULL << (index % 64);
+}
+
+void MemControllerBase::copyFromArea(size_t firstPage, uint8_t * data, size_t size) const
+{
+    for (size_t offset = 0; offset < size; offset += PAGE_SIZE)
+    {
+        size_t index = firstPage + offset / PAGE_SIZE;
+        memcpy(data + offset, page(index), pageSize(index));
+    }
+}
+
+void MemControllerBase::copyToArea(size_t firstPage, const uint8_t * data, size_t size)
+{
+    for (size_t offset = 0; offset < size; offset += PAGE_SIZE)
+    {
+        size_t index = firstPage + offset / PAGE_SIZE;
+        memcpy(writablePage(index), data + offset, pageSize(index));
+    }
+}
+} // namespace LibDMG
@@ -2,23 +2,144 @@
 #define LIBDMG_MEM_CONTROLLER_BASE_HPP
 
 #include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <vector>
+#include <cereal/archives/xml.hpp>
+
+#include "state/binary_archive.hpp"
+#include "state/snapshot_archive.hpp"
 
 namespace LibDMG 
 {
+    class Cart;
     class Emulator;
 
     class MemControllerBase
     {
     public:
+        static const uint16_t MAIN_RAM_SIZE = 0x2000;
+
         MemControllerBase(Emulator * emu = nullptr) :
             m_emu(emu)
         {}
+        virtual ~MemControllerBase() {}
 
         virtual uint8_t read(uint16_t addr) const = 0;
         virtual void write(uint16_t addr, uint8_t val) = 0;
 
+        // Copy for another emulator. RAM pages are shared until either side
+        // writes them (copy-on-write), so a copy costs a page table.
+        virtual std::unique_ptr<MemControllerBase> clone(Emulator * emu) = 0;
+
+        // Direct access for the LCD controller, which fetches tiles every
+        // line. Video and main RAM are page tables, see page().
+        virtual const uint8_t * const * videoRamPages() const = 0;
+        virtual const uint8_t * const * mainRamPages() const = 0;
+        virtual const uint8_t * oam() const = 0;
+
+        // RAM is split in pages, which are shared between clones and saved
+        // on their own by incremental save states. A write marks its page
+        // dirty until the next checkpoint clears them.
+        static const size_t PAGE_SIZE = 256;
+        size_t pageCount() const { return m_pageData.size(); }
+        // PAGE_SIZE, or less for the last page of a memory area
+        size_t pageSize(size_t index) const { return m_pageSizes[index]; }
+        const uint8_t * page(size_t index) const { return m_pageData[index]; }
+        // For code writing pages directly, marks the page dirty
+        uint8_t * writablePage(size_t index)
+        {
+            if (!((m_ownedPages[index / 64] >> (index % 64)) & 1))
+            {
+                ownPage(index);
+            }
+            markPageDirty(index);
+            return m_pageData[index];
+        }
+
+        bool isPageDirty(size_t index) const { return (m_dirtyPages[index / 64] >> (index % 64)) & 1; }
+        void clearDirtyPages() { std::fill(m_dirtyPages.begin(), m_dirtyPages.end(), 0); }
+        void markAllPagesDirty()
+        {
+            std::fill(m_dirtyPages.begin(), m_dirtyPages.end(), ~0ULL);
+            std::fill(m_staleHashes.begin(), m_staleHashes.end(), ~0ULL);
+        }
+        void markPageDirty(size_t index)
+        {
+            m_dirtyPages[index / 64] |= 1ULL << (index % 64);
+            m_staleHashes[index / 64] |= 1ULL << (index % 64);
+        }
+
+        // Hash of the whole RAM. Each page hash is kept until the page is
+        // written, so only the pages written since the last call are hashed.
+        uint32_t memoryHash();
+
+        // One overload per archive, as a template cannot be virtual
+        virtual void serialize(BinaryOutputArchive& ar) = 0;
+        virtual void serialize(BinaryInputArchive& ar) = 0;
+        virtual void serialize(cereal::XMLOutputArchive& ar) = 0;
+        virtual void serialize(cereal::XMLInputArchive& ar) = 0;
+        virtual void serialize(SnapshotSizer& ar) = 0;
+        virtual void serialize(SnapshotWriter& ar) = 0;
+        virtual void serialize(SnapshotReader& ar) = 0;
+
+        // Inserts a cartridge, nullptr removes it. Clones share it.
+        virtual void setCart(const std::shared_ptr<const Cart>& cart) = 0;
+
     protected:
         Emulator * m_emu;
+
+        // Adds a zeroed memory area, returns its first page
+        size_t addArea(size_t size);
+        // Shares all pages of another controller, of the same type
+        void sharePages(MemControllerBase& from);
+
+        const uint8_t * const * pageTable(size_t firstPage) const { return m_pageData.data() + firstPage; }
+        // Offset is from the first page of the area
+        uint8_t readArea(size_t firstPage, size_t offset) const
+        {
+            return m_pageData[firstPage + offset / PAGE_SIZE][offset % PAGE_SIZE];
+        }
+        void writeArea(size_t firstPage, size_t offset, uint8_t val)
+        {
+            writablePage(firstPage + offset / PAGE_SIZE)[offset % PAGE_SIZE] = val;
+        }
+        // Copies between a whole area and a flat buffer
+        void copyFromArea(size_t firstPage, uint8_t * data, size_t size) const;
+        void copyToArea(size_t firstPage, const uint8_t * data, size_t size);
+
+        // For binary and snapshot archives, the pages one after the other
+        template<class Archive>
+        void serializePages(Archive & ar)
+        {
+            for (size_t i = 0; i < pageCount(); i++)
+            {
+                pageBytes(ar, i);
+            }
+        }
+
+    private:
+        typedef std::array<uint8_t, PAGE_SIZE> Page;
+
+        std::vector<std::shared_ptr<Page> > m_pages;
+        // Data of m_pages, for reads
+        std::vector<uint8_t *> m_pageData;
+        std::vector<size_t> m_pageSizes;
+        // Pages not shared with a clone, they are written in place
+        std::vector<uint64_t> m_ownedPages;
+        std::vector<uint64_t> m_dirtyPages;     // Since the last checkpoint
+        std::vector<uint64_t> m_staleHashes;    // Since the last memoryHash()
+        std::vector<uint32_t> m_pageHashes;
+
+        void ownPage(size_t index);
+
+        void pageBytes(BinaryOutputArchive& ar, size_t index) { ar.writeBytes(page(index), pageSize(index)); }
+        void pageBytes(BinaryInputArchive& ar, size_t index) { ar.readBytes(writablePage(index), pageSize(index)); }
+        void pageBytes(SnapshotSizer& ar, size_t index) { ar.copy(nullptr, pageSize(index)); }
+        void pageBytes(SnapshotWriter& ar, size_t index) { ar.copy(page(index), pageSize(index)); }
+        void pageBytes(SnapshotReader& ar, size_t index) { ar.copy(writablePage(index), pageSize(index)); }
     };
 
 }
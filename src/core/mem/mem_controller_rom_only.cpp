@@ -4,23 +4,24 @@
 
 namespace LibDMG
 {
+const char * const MemControllerRomOnly::DEFAULT_BOOT_ROM_PATH = "D:\\Dev\\workspace\\LibDMG\\DMG_ROM.bin";
+
 uint8_t MemControllerRomOnly::read(uint16_t addr) const
 {
     // Boot ROM
-    if (addr < 0x100)
+    if (addr < 0x100 && m_bootRomMapped)
     {
         return m_bootRom->read(addr);
     }
     // ROM
     else if (addr < 0x8000)
     {
-        LOG_WARN("MemControllerRomOnly: cart ROM not implemented");
-        return 0;
+        return (m_cart != nullptr) ? m_cart->read(addr) : 0xFF;
     }
     // Video RAM
     else if (addr < 0xA000)
     {
-        return m_videoRam[addr - 0x8000];
+        return readArea(VIDEO_RAM_PAGE, addr - 0x8000);
     }
     // Switchable RAM
     else if (addr < 0xC000)
@@ -30,17 +31,17 @@ uint8_t MemControllerRomOnly::read(uint16_t addr) const
     // Main RAM
     else if (addr < 0xE000)
     {
-        return m_mainRam[addr - 0xC000];
+        return readArea(MAIN_RAM_PAGE, addr - 0xC000);
     }
     // Main RAM echo
     else if (addr < 0xFE00)
     {
-        return m_mainRam[addr - 0xE000];
+        return readArea(MAIN_RAM_PAGE, addr - 0xE000);
     }
     // OAM
     else if (addr < 0xFEA0)
     {
-        return m_oam[addr - 0xFEA0];
+        return readArea(OAM_PAGE, addr - 0xFE00);
     }
     // Reserved area
     else if (addr < 0xFF00)
@@ -60,13 +61,15 @@ uint8_t MemControllerRomOnly::read(uint16_t addr) const
     // "High" RAM
     else if (addr < 0xFFFF)
     {
-        return m_highRam[addr - 0xFF80];
+        return readArea(HIGH_RAM_PAGE, addr - 0xFF80);
     }
     // Interrupt Enable register
     else if (addr == 0xFFFF)
     {
         return m_emu->periph()->regIE();
     }
+    // Unmapped areas read as an open bus
+    return 0xFF;
 }
 
 void MemControllerRomOnly::write(uint16_t addr, uint8_t val)
@@ -79,7 +82,8 @@ void MemControllerRomOnly::write(uint16_t addr, uint8_t val)
     // Video RAM
     else if (addr < 0xA000)
     {
-        m_videoRam[addr - 0x8000] = val;
+        writeArea(VIDEO_RAM_PAGE, addr - 0x8000, val);
+        m_emu->periph()->lcd()->videoRamWritten(addr - 0x8000);
     }
     // Switchable RAM
     else if (addr < 0xC000)
@@ -89,17 +93,18 @@ void MemControllerRomOnly::write(uint16_t addr, uint8_t val)
     // Main RAM
     else if (addr < 0xE000)
     {
-        m_mainRam[addr - 0xC000] = val;
+        writeArea(MAIN_RAM_PAGE, addr - 0xC000, val);
     }
     // Main RAM echo
     else if (addr < 0xFE00)
     {
-        m_mainRam[addr - 0xE000] = val;
+        writeArea(MAIN_RAM_PAGE, addr - 0xE000, val);
     }
     // OAM
     else if (addr < 0xFEA0)
     {
-        m_oam[addr - 0xFEA0] = val;
+        writeArea(OAM_PAGE, addr - 0xFE00, val);
+        m_emu->periph()->lcd()->invalidateSprites();
     }
     // Reserved area
     else if (addr < 0xFF00)
@@ -111,6 +116,14 @@ void MemControllerRomOnly::write(uint16_t addr, uint8_t val)
     {
         m_emu->periph()->setReg(addr - 0xFF00, val);
     }
+    // Boot ROM disable, cannot be undone
+    else if (addr == 0xFF50)
+    {
+        if (val != 0)
+        {
+            m_bootRomMapped = false;
+        }
+    }
     // Reserved
     else if (addr < 0xFF80)
     {
@@ -119,7 +132,7 @@ void MemControllerRomOnly::write(uint16_t addr, uint8_t val)
     // "High" RAM
     else if (addr < 0xFFFF)
     {
-        m_highRam[addr - 0xFF80] = val;
+        writeArea(HIGH_RAM_PAGE, addr - 0xFF80, val);
     }
     // Interrupt Enable register
     else if (addr == 0xFFFF)
@@ -127,4 +140,11 @@ void MemControllerRomOnly::write(uint16_t addr, uint8_t val)
         m_emu->periph()->setRegIE(val);
     }
 }
-} // namespace LibDMG
\ No newline at end of file
+
+std::unique_ptr<MemControllerBase> MemControllerRomOnly::clone(Emulator * emu)
+{
+    std::unique_ptr<MemControllerRomOnly> copy(new MemControllerRomOnly(emu, *this));
+    copy->sharePages(*this);
+    return copy;
+}
+} // namespace LibDMG
@@ -3,30 +3,119 @@
 
 #include "mem_controller_base.hpp"
 #include "boot_rom.hpp"
+#include "cart/cart.hpp"
 #include "logger.hpp"
 
 #include <memory>
 
 namespace LibDMG
 {
-	// This mem controller is for test only. It can only read in boot ROM.
+	// Memory map of a cartridge without MBC: the first 32 KB of the cart
+	// are mapped as ROM, banks and cart RAM are not supported. The boot ROM
+	// covers the first 256 bytes until written off through 0xFF50.
 	class MemControllerRomOnly : public MemControllerBase
 	{
 	public:
-		MemControllerRomOnly(Emulator * emu = nullptr) :
+		static const char * const DEFAULT_BOOT_ROM_PATH;
+
+		// Without a boot ROM (empty path), the cart is mapped from the start
+		MemControllerRomOnly(Emulator * emu = nullptr, const std::string& bootRomPath = DEFAULT_BOOT_ROM_PATH) :
 			MemControllerBase(emu),
-			m_bootRom(std::make_unique<BootRom>("D:\\Dev\\workspace\\LibDMG\\DMG_ROM.bin"))
-		{}
+			m_bootRom(bootRomPath.empty() ? nullptr : std::make_shared<BootRom>(bootRomPath)),
+			m_bootRomMapped(m_bootRom != nullptr)
+		{
+			// In the order of the page constants
+			addArea(VIDEO_RAM_SIZE);
+			addArea(MAIN_RAM_AREA_SIZE);
+			addArea(OAM_SIZE);
+			addArea(HIGH_RAM_SIZE);
+		}
 
 		virtual uint8_t read(uint16_t addr) const;
 		virtual void write(uint16_t addr, uint8_t val);
 
+		virtual std::unique_ptr<MemControllerBase> clone(Emulator * emu);
+		virtual void setCart(const std::shared_ptr<const Cart>& cart) { m_cart = cart; }
+
+		virtual const uint8_t * const * videoRamPages() const { return pageTable(VIDEO_RAM_PAGE); }
+		virtual const uint8_t * const * mainRamPages() const { return pageTable(MAIN_RAM_PAGE); }
+		virtual const uint8_t * oam() const { return page(OAM_PAGE); }
+
+		virtual void serialize(BinaryOutputArchive& ar) { serializeRam(ar); }
+		virtual void serialize(BinaryInputArchive& ar) { serializeRam(ar); }
+		virtual void serialize(cereal::XMLOutputArchive& ar) { serializeXml(ar); }
+		virtual void serialize(cereal::XMLInputArchive& ar) { serializeXml(ar); }
+		virtual void serialize(SnapshotSizer& ar) { serializeRam(ar); }
+		virtual void serialize(SnapshotWriter& ar) { serializeRam(ar); }
+		virtual void serialize(SnapshotReader& ar) { serializeRam(ar); }
+
 	private:
-		std::unique_ptr<BootRom> m_bootRom;
-		uint8_t m_videoRam[8 * 1024];
-		uint8_t m_mainRam[16 * 1024];
-		uint8_t m_oam[160];
-		uint8_t m_highRam[127];
+		static const size_t VIDEO_RAM_SIZE = 8 * 1024;
+		static const size_t MAIN_RAM_AREA_SIZE = 16 * 1024;
+		static const size_t OAM_SIZE = 160;
+		static const size_t HIGH_RAM_SIZE = 127;
+
+		// First page of each memory area
+		static const size_t VIDEO_RAM_PAGE = 0;
+		static const size_t MAIN_RAM_PAGE = 32;
+		static const size_t OAM_PAGE = 96;
+		static const size_t HIGH_RAM_PAGE = 97;
+
+		// Read only, clones share them
+		std::shared_ptr<BootRom> m_bootRom;
+		std::shared_ptr<const Cart> m_cart;
+		bool m_bootRomMapped;
+
+		// For clone()
+		MemControllerRomOnly(Emulator * emu, const MemControllerRomOnly& from) :
+			MemControllerBase(emu),
+			m_bootRom(from.m_bootRom),
+			m_cart(from.m_cart),
+			m_bootRomMapped(from.m_bootRomMapped)
+		{}
+
+		template<class Archive>
+		void serializeRam(Archive & ar)
+		{
+			serializePages(ar);
+			ar(CEREAL_NVP(m_bootRomMapped));
+		}
+
+		// Same XML as when each area was an array
+		struct FlatRam
+		{
+			uint8_t videoRam[VIDEO_RAM_SIZE];
+			uint8_t mainRam[MAIN_RAM_AREA_SIZE];
+			uint8_t oam[OAM_SIZE];
+			uint8_t highRam[HIGH_RAM_SIZE];
+		};
+
+		template<class Archive>
+		void serializeXml(Archive & ar)
+		{
+			std::unique_ptr<FlatRam> ram = std::make_unique<FlatRam>();
+			if (!ArchiveIsLoading<Archive>::value)
+			{
+				copyFromArea(VIDEO_RAM_PAGE, ram->videoRam, VIDEO_RAM_SIZE);
+				copyFromArea(MAIN_RAM_PAGE, ram->mainRam, MAIN_RAM_AREA_SIZE);
+				copyFromArea(OAM_PAGE, ram->oam, OAM_SIZE);
+				copyFromArea(HIGH_RAM_PAGE, ram->highRam, HIGH_RAM_SIZE);
+			}
+
+			ar(cereal::make_nvp("m_videoRam", ram->videoRam),
+			   cereal::make_nvp("m_mainRam", ram->mainRam),
+			   cereal::make_nvp("m_oam", ram->oam),
+			   cereal::make_nvp("m_highRam", ram->highRam),
+			   CEREAL_NVP(m_bootRomMapped));
+
+			if (ArchiveIsLoading<Archive>::value)
+			{
+				copyToArea(VIDEO_RAM_PAGE, ram->videoRam, VIDEO_RAM_SIZE);
+				copyToArea(MAIN_RAM_PAGE, ram->mainRam, MAIN_RAM_AREA_SIZE);
+				copyToArea(OAM_PAGE, ram->oam, OAM_SIZE);
+				copyToArea(HIGH_RAM_PAGE, ram->highRam, HIGH_RAM_SIZE);
+			}
+		}
 	};
 }
 
@@ -0,0 +1,95 @@
+#include "joypad.hpp"
+
+#include <algorithm>
+
+#include "emulator.hpp"
+
+using namespace LibDMG;
+
+const uint8_t Joypad::INT_JOYPAD;
+const size_t Joypad::QUEUE_SIZE;
+
+bool Joypad::pushEvent(uint64_t cycle, uint8_t buttons, bool pressed)
+{
+    Event event = { cycle, buttons, pressed };
+    return m_queue.push(event);
+}
+
+void Joypad::drainQueue()
+{
+    // When the pending list is full, the rest waits in the queue
+    Event event;
+    while (m_pendingCount < QUEUE_SIZE && m_queue.pop(event))
+    {
+        // Producers are not ordered with each other, keep the list sorted.
+        // Events of the same cycle stay in arrival order.
+        Event *end = m_pending.data() + m_pendingCount;
+        Event *it = std::upper_bound(m_pending.data(), end, event,
+                                     [](const Event& a, const Event& b) { return a.cycle < b.cycle; });
+        std::move_backward(it, end, end + 1);
+        *it = event;
+        m_pendingCount++;
+    }
+}
+
+uint64_t Joypad::nextEventCycle()
+{
+    drainQueue();
+    return (m_pendingCount == 0) ? UINT64_MAX : m_pending[0].cycle;
+}
+
+void Joypad::applyEvents(uint64_t cycle)
+{
+    drainQueue();
+
+    uint32_t count = 0;
+    while (count < m_pendingCount && m_pending[count].cycle <= cycle)
+    {
+        const Event& event = m_pending[count];
+        if (event.cycle < cycle)
+        {
+            m_lateEvents++;
+        }
+        setButtons(event.buttons, event.pressed);
+        count++;
+    }
+    std::move(m_pending.begin() + count, m_pending.begin() + m_pendingCount, m_pending.begin());
+    m_pendingCount -= count;
+}
+
+void Joypad::setButtons(uint8_t buttons, bool pressed)
+{
+    uint8_t oldLines = lines();
+    m_buttons = pressed ? (m_buttons | buttons) : (m_buttons & ~buttons);
+    update(oldLines);
+}
+
+void Joypad::setRegP1(uint8_t val)
+{
+    uint8_t oldLines = lines();
+    m_regP1 = val & 0x30;
+    update(oldLines);
+}
+
+uint8_t Joypad::lines() const
+{
+    uint8_t pressed = 0;
+    if (!(m_regP1 & 0x10))
+    {
+        pressed |= m_buttons & 0x0F;
+    }
+    if (!(m_regP1 & 0x20))
+    {
+        pressed |= m_buttons >> 4;
+    }
+    return ~pressed & 0x0F;
+}
+
+void Joypad::update(uint8_t oldLines)
+{
+    // The interrupt is requested when a line goes low
+    if ((oldLines & ~lines()) != 0 && m_emu != nullptr)
+    {
+        m_emu->periph()->setRegIF(m_emu->periph()->regIF() | INT_JOYPAD);
+    }
+}
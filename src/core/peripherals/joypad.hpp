@@ -0,0 +1,138 @@
+#ifndef LIBDMG_JOYPAD_HPP
+#define LIBDMG_JOYPAD_HPP
+
+#include <array>
+#include <cstdint>
+#include <cereal/archives/xml.hpp>
+#include <cereal/types/array.hpp>
+
+#include "state/snapshot_archive.hpp"
+#include "utils/mpsc_queue.hpp"
+
+namespace LibDMG
+{
+    class Emulator;
+
+    // Joypad behind P1. Input comes as events stamped with the emulated
+    // cycle at which they apply; any thread can push them without locking.
+    // The emulator splits its steps at event cycles, so the same events
+    // always land at the same point of the emulation. Events not applied
+    // yet are part of the state: saving takes the queued ones in too, and
+    // loading replaces the pending ones, while those still queued are added
+    // to them.
+    class Joypad
+    {
+    public:
+        enum Button
+        {
+            BUTTON_RIGHT = 0x01,
+            BUTTON_LEFT = 0x02,
+            BUTTON_UP = 0x04,
+            BUTTON_DOWN = 0x08,
+            BUTTON_A = 0x10,
+            BUTTON_B = 0x20,
+            BUTTON_SELECT = 0x40,
+            BUTTON_START = 0x80
+        };
+
+        static const uint8_t INT_JOYPAD = 0x10;
+        static const size_t QUEUE_SIZE = 256;
+
+        Joypad(Emulator * emu = nullptr) :
+            m_emu(emu),
+            m_buttons(0),
+            m_regP1(0x30),
+            m_lateEvents(0),
+            m_pending(),
+            m_pendingCount(0)
+        { }
+
+        void saveState(std::ostream& out) { cereal::XMLOutputArchive ar(out); serialize(ar); }
+        void loadState(std::istream& in) { cereal::XMLInputArchive ar(in); serialize(ar); }
+        template<class Archive>
+        void serialize(Archive & ar)
+        {
+            if (!ArchiveIsLoading<Archive>::value)
+            {
+                drainQueue();
+            }
+
+            ar(CEREAL_NVP(m_buttons),
+               CEREAL_NVP(m_regP1),
+               CEREAL_NVP(m_pendingCount));
+            if (m_pendingCount > QUEUE_SIZE)
+            {
+                m_pendingCount = QUEUE_SIZE;
+            }
+            serializePending(ar);
+        }
+
+        // Any thread: presses or releases the buttons in the mask at the
+        // given cycle. Returns false if the queue is full, which happens when
+        // QUEUE_SIZE events wait for their cycle and QUEUE_SIZE more are
+        // queued. Events stamped before the current cycle are applied as soon
+        // as possible.
+        bool pushEvent(uint64_t cycle, uint8_t buttons, bool pressed);
+
+        // Emulation thread: cycle of the earliest pending event, UINT64_MAX
+        // if there is none
+        uint64_t nextEventCycle();
+        // Emulation thread: applies the events due at or before cycle
+        void applyEvents(uint64_t cycle);
+
+        // Emulation thread: immediate change
+        void setButtons(uint8_t buttons, bool pressed);
+        uint8_t buttons() const { return m_buttons; }
+        // Events applied after their cycle, because they were pushed late
+        uint32_t lateEvents() const { return m_lateEvents; }
+
+        void setRegP1(uint8_t val);
+        uint8_t regP1() const { return 0xC0 | m_regP1 | lines(); }
+
+    private:
+        struct Event
+        {
+            uint64_t cycle;
+            uint8_t  buttons;
+            bool     pressed;
+
+            template<class Archive>
+            void serialize(Archive & ar)
+            {
+                ar(CEREAL_NVP(cycle),
+                   CEREAL_NVP(buttons),
+                   CEREAL_NVP(pressed));
+            }
+        };
+
+        Emulator * m_emu;
+        uint8_t    m_buttons;   // Pressed buttons
+        uint8_t    m_regP1;     // Select bits only
+        uint32_t   m_lateEvents;
+
+        MpscQueue<Event, QUEUE_SIZE> m_queue;
+        // Events taken from the queue, sorted by cycle
+        std::array<Event, QUEUE_SIZE> m_pending;
+        uint32_t                      m_pendingCount;
+
+        void drainQueue();
+
+        // Save states only hold the events waiting, snapshots keep their size
+        template<class Archive>
+        void serializePending(Archive & ar)
+        {
+            for (uint32_t i = 0; i < m_pendingCount; i++)
+            {
+                ar(m_pending[i]);
+            }
+        }
+        void serializePending(SnapshotSizer & ar) { ar(m_pending); }
+        void serializePending(SnapshotWriter & ar) { ar(m_pending); }
+        void serializePending(SnapshotReader & ar) { ar(m_pending); }
+        // Input lines, active low
+        uint8_t lines() const;
+        void update(uint8_t oldLines);
+    };
+}
+
+#endif // LIBDMG_JOYPAD_HPP
@@ -1,64 +1,550 @@
 #include <cstdint>
+#include <cstring>
 
 #include "lcd_controller.hpp"
 
-#include "logger.hpp"
+#include "emulator.hpp"
+#include "utils/crc32c.hpp"
+
+namespace
+{
+    // Map rows (32 bytes) and tile rows never cross a page
+    inline const uint8_t *videoRamAt(const uint8_t * const *vram, int offset)
+    {
+        return vram[offset / LibDMG::MemControllerBase::PAGE_SIZE] + offset % LibDMG::MemControllerBase::PAGE_SIZE;
+    }
+}
 
 namespace LibDMG
 {
+const int LcdController::SCREEN_WIDTH;
+const int LcdController::SCREEN_HEIGHT;
+const int LcdController::LINE_CYCLES;
+const int LcdController::FRAME_LINES;
+const int LcdController::FRAME_CYCLES;
+
 void LcdController::step(int cycles)
 {
-    m_cycles += cycles;
+    int target = m_frameCycle + cycles;
 
-    while (m_cycles >= m_duration)
+    // Only stop on the cycles where something actually happens
+    while (target >= m_nextEvent)
     {
-        m_cycles -= m_duration;
-        // End of state
-        gotoNextState();
+        m_frameCycle = m_nextEvent;
+        if (m_frameCycle == FRAME_CYCLES)
+        {
+            m_frameCycle = 0;
+            target -= FRAME_CYCLES;
+        }
+
+        processEvent();
+        m_nextEvent = nextEventCycle();
     }
+
+    m_frameCycle = target;
 }
 
-void LcdController::gotoNextState(void)
+void LcdController::setRegLCDC(uint8_t val)
 {
-    switch (m_state)
+    if (((m_regLCDC ^ val) & LCDC_OBJ_SIZE) != 0)
     {
-    case STATE_MODE0:
-        m_regLY++;
-        if (m_regLY == 144)
+        m_spritesDirty = true;
+    }
+
+    bool toggled = ((m_regLCDC ^ val) & LCDC_LCD_ENABLE) != 0;
+    m_regLCDC = val;
+    if (toggled)
+    {
+        if (isEnabled())
         {
-            gotoMode0();
+            m_frameCycle = 0;
+            m_windowLine = 0;
+
+            // Line 0 starts now, the events only cover the cycles after it
+            if (m_regLYC == 0 && (m_regSTAT & STAT_INT_LYC) != 0)
+            {
+                requestInterrupt(INT_STAT);
+            }
+        }
+        m_nextEvent = nextEventCycle();
+    }
+}
+
+void LcdController::setRegDMA(uint8_t val)
+{
+    m_regDMA = val;
+
+    if (m_emu == nullptr)
+    {
+        return;
+    }
+
+    // Transfer is instantaneous. Each OAM write only flags the sprite index,
+    // so it is rebuilt once for the whole DMA.
+    MemControllerBase& mem = m_emu->mem();
+    uint16_t src = val << 8;
+    for (uint16_t i = 0; i < OAM_SPRITES * 4; i++)
+    {
+        mem.write(0xFE00 + i, mem.read(src + i));
+    }
+}
+
+uint8_t LcdController::mode(void) const
+{
+    if (!isEnabled())
+    {
+        return 0;
+    }
+
+    int ly = line();
+    if (ly >= SCREEN_HEIGHT)
+    {
+        return 1;
+    }
+
+    int lineCycle = m_frameCycle - ly * LINE_CYCLES;
+    if (lineCycle < MODE2_END)
+    {
+        return 2;
+    }
+    else if (lineCycle < MODE3_END)
+    {
+        return 3;
+    }
+    else
+    {
+        return 0;
+    }
+}
+
+uint8_t LcdController::regSTAT(void) const
+{
+    uint8_t coincidence = (regLY() == m_regLYC) ? 0x04 : 0x00;
+    return 0x80 | m_regSTAT | coincidence | mode();
+}
+
+int LcdController::cyclesUntilVBlank(void) const
+{
+    const int vblank = SCREEN_HEIGHT * LINE_CYCLES;
+    if (m_frameCycle < vblank)
+    {
+        return vblank - m_frameCycle;
+    }
+    return FRAME_CYCLES - m_frameCycle + vblank;
+}
+
+int LcdController::nextEventCycle(void) const
+{
+    int ly = line();
+    int lineStart = ly * LINE_CYCLES;
+    int lineCycle = m_frameCycle - lineStart;
+
+    // Off, only the end of the frame matters
+    if (!isEnabled())
+    {
+        return (ly < SCREEN_HEIGHT) ? SCREEN_HEIGHT * LINE_CYCLES : FRAME_CYCLES;
+    }
+
+    if (ly < SCREEN_HEIGHT)
+    {
+        if (lineCycle < MODE2_END)
+        {
+            return lineStart + MODE2_END;
+        }
+        else if (lineCycle < MODE3_END)
+        {
+            return lineStart + MODE3_END;
         }
         else
         {
-            gotoMode2();
+            return lineStart + LINE_CYCLES;
+        }
+    }
+
+    // During VBlank nothing happens until LY matches LYC or the frame ends
+    if (m_regLYC > ly && m_regLYC < FRAME_LINES)
+    {
+        return m_regLYC * LINE_CYCLES;
+    }
+    return FRAME_CYCLES;
+}
+
+void LcdController::processEvent(void)
+{
+    uint8_t ly = static_cast<uint8_t>(line());
+    int lineCycle = m_frameCycle - ly * LINE_CYCLES;
+
+    if (!isEnabled())
+    {
+        if (lineCycle == 0 && ly == SCREEN_HEIGHT)
+        {
+            endFrame();
+        }
+        return;
+    }
+
+    if (lineCycle == 0)
+    {
+        // New line
+        if (ly == m_regLYC && (m_regSTAT & STAT_INT_LYC) != 0)
+        {
+            requestInterrupt(INT_STAT);
+        }
+
+        if (ly == 0)
+        {
+            m_windowLine = 0;
+        }
+
+        if (ly == SCREEN_HEIGHT)
+        {
+            endFrame();
+            requestInterrupt((m_regSTAT & STAT_INT_MODE1) != 0 ? INT_VBLANK | INT_STAT : INT_VBLANK);
+        }
+        else if (ly < SCREEN_HEIGHT && (m_regSTAT & STAT_INT_MODE2) != 0)
+        {
+            requestInterrupt(INT_STAT);
+        }
+    }
+    else if (lineCycle == MODE3_END)
+    {
+        // Pixel transfer is over, the line is complete
+        renderLine(ly);
+
+        if ((m_regSTAT & STAT_INT_MODE0) != 0)
+        {
+            requestInterrupt(INT_STAT);
+        }
+    }
+}
+
+void LcdController::endFrame(void)
+{
+    m_frameCount++;
+
+    if (m_emu != nullptr)
+    {
+        m_emu->framebuffer()->endFrame();
+    }
+
+    if (m_emu != nullptr && m_emu->frameDumper() != nullptr)
+    {
+        m_emu->frameDumper()->pushFrame(&m_frame[0][0]);
+    }
+
+    if (m_emu != nullptr && m_emu->audioOutput() != nullptr)
+    {
+        m_emu->audioOutput()->update(*m_emu->periph()->apu());
+    }
+
+    if (!m_frameHashEnabled)
+    {
+        return;
+    }
+
+    m_frameHash = crc32c(m_frame, sizeof(m_frame));
+    if (m_frameHashMainRam && m_emu != nullptr)
+    {
+        const uint8_t * const *pages = m_emu->mem().mainRamPages();
+        for (size_t i = 0; i < MemControllerBase::MAIN_RAM_SIZE / MemControllerBase::PAGE_SIZE; i++)
+        {
+            m_frameHash = crc32c(m_frameHash, pages[i], MemControllerBase::PAGE_SIZE);
+        }
+    }
+}
+
+void LcdController::requestInterrupt(uint8_t mask)
+{
+    if (m_emu != nullptr)
+    {
+        m_emu->periph()->setRegIF(m_emu->periph()->regIF() | mask);
+    }
+}
+
+void LcdController::videoRamWritten(uint16_t offset)
+{
+    if (offset < 0x1800)
+    {
+        m_tileTick[offset / 16] = m_tick;
+    }
+    else
+    {
+        m_mapRowTick[(offset - 0x1800) / 32] = m_tick;
+    }
+}
+
+void LcdController::invalidateLines(void)
+{
+    memset(m_lineValid, 0, sizeof(m_lineValid));
+}
+
+void LcdController::renderLine(uint8_t ly)
+{
+    if ((m_regLCDC & LCDC_LCD_ENABLE) == 0 || m_emu == nullptr)
+    {
+        return;
+    }
+
+    VideoRam vram = m_emu->mem().videoRamPages();
+    Framebuffer *fb = m_emu->framebuffer();
+
+    bool windowVisible = (m_regLCDC & (LCDC_BG_ENABLE | LCDC_WIN_ENABLE)) == (LCDC_BG_ENABLE | LCDC_WIN_ENABLE)
+                         && ly >= m_regWY && m_regWX <= 166;
+
+    if ((m_regLCDC & LCDC_OBJ_ENABLE) != 0 && m_spritesDirty)
+    {
+        buildSpriteIndex();
+    }
+
+    // Everything the pixels of this line depend on, apart from VRAM and OAM
+    uint64_t key = static_cast<uint64_t>(m_regLCDC)
+                   | static_cast<uint64_t>(m_regSCX) << 8
+                   | static_cast<uint64_t>(static_cast<uint8_t>(ly + m_regSCY)) << 16
+                   | static_cast<uint64_t>(m_regBGP) << 24
+                   | static_cast<uint64_t>(m_regOBP0) << 32
+                   | static_cast<uint64_t>(m_regOBP1) << 40
+                   | static_cast<uint64_t>(m_regWX) << 48
+                   | static_cast<uint64_t>(windowVisible ? m_windowLine : 0xFF) << 56;
+
+    if (isLineDirty(vram, ly, key, windowVisible) || fb->isLineStale(ly))
+    {
+        uint8_t colors[SCREEN_WIDTH] = {};
+
+        if ((m_regLCDC & LCDC_BG_ENABLE) != 0)
+        {
+            renderBackground(vram, ly, colors);
+
+            if (windowVisible)
+            {
+                renderWindow(vram, colors);
+            }
+        }
+
+        // Apply BG palette
+        uint8_t *out = m_frame[ly];
+        for (int x = 0; x < SCREEN_WIDTH; x++)
+        {
+            out[x] = (m_regBGP >> (colors[x] * 2)) & 0x03;
+        }
+
+        if ((m_regLCDC & LCDC_OBJ_ENABLE) != 0)
+        {
+            renderSprites(vram, ly, colors, out);
         }
-        break;
 
-    case STATE_MODE1:
-        m_regLY++;
-        if (m_regLY == 154)
+        fb->writeLine(ly, out);
+    }
+
+    m_lineKey[ly] = key;
+    m_lineTick[ly] = m_tick;
+    m_lineValid[ly] = true;
+    m_lineHadSprites[ly] = ((m_regLCDC & LCDC_OBJ_ENABLE) != 0) && m_lineSpriteCount[ly] != 0;
+    m_tick++;
+
+    if (windowVisible)
+    {
+        m_windowLine++;
+    }
+}
+
+bool LcdController::isLineDirty(VideoRam vram, uint8_t ly, uint64_t key, bool windowVisible) const
+{
+    if (!m_lineValid[ly] || m_lineKey[ly] != key)
+    {
+        return true;
+    }
+
+    // Any VRAM or OAM write since this line was last drawn that it depends on
+    uint64_t since = m_lineTick[ly];
+
+    if ((m_regLCDC & LCDC_BG_ENABLE) != 0)
+    {
+        int mapRow = (((m_regLCDC & LCDC_BG_MAP) != 0) ? 32 : 0) + static_cast<uint8_t>(ly + m_regSCY) / 8;
+        if (m_mapRowTick[mapRow] > since)
         {
-            m_regLY = 0;
-            gotoMode2();
+            return true;
         }
-        else {
-            // Stay in mode 0
-            gotoMode0();
+
+        const uint8_t *map = videoRamAt(vram, 0x1800 + mapRow * 32);
+        for (int i = 0; i <= SCREEN_WIDTH / 8; i++)
+        {
+            if (m_tileTick[tileSlot(map[(m_regSCX / 8 + i) & 31])] > since)
+            {
+                return true;
+            }
         }
-        break;
 
-    case STATE_MODE2:
-        gotoMode3();
-        break;
+        if (windowVisible)
+        {
+            mapRow = (((m_regLCDC & LCDC_WIN_MAP) != 0) ? 32 : 0) + m_windowLine / 8;
+            if (m_mapRowTick[mapRow] > since)
+            {
+                return true;
+            }
 
-    case STATE_MODE3:
-        gotoMode0();
-        break;
+            map = videoRamAt(vram, 0x1800 + mapRow * 32);
+            for (int i = 0; i <= SCREEN_WIDTH / 8; i++)
+            {
+                if (m_tileTick[tileSlot(map[i])] > since)
+                {
+                    return true;
+                }
+            }
+        }
+    }
 
-    default:
-        LOG_ERROR("LcdController: Internal error");
-        break;
+    bool hasSprites = ((m_regLCDC & LCDC_OBJ_ENABLE) != 0) && m_lineSpriteCount[ly] != 0;
+    if ((hasSprites || m_lineHadSprites[ly]) && m_oamTick > since)
+    {
+        return true;
     }
+
+    if (hasSprites)
+    {
+        const uint8_t *oam = m_emu->mem().oam();
+        bool tall = (m_regLCDC & LCDC_OBJ_SIZE) != 0;
+        for (int i = 0; i < m_lineSpriteCount[ly]; i++)
+        {
+            uint8_t tileIndex = oam[m_lineSprites[ly][i] * 4 + 2];
+            if (tall)
+            {
+                tileIndex &= 0xFE;
+                if (m_tileTick[tileIndex + 1] > since)
+                {
+                    return true;
+                }
+            }
+            if (m_tileTick[tileIndex] > since)
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void LcdController::renderBackground(VideoRam vram, uint8_t ly, uint8_t *colors)
+{
+    int map = ((m_regLCDC & LCDC_BG_MAP) != 0) ? 0x1C00 : 0x1800;
+    uint8_t y = ly + m_regSCY;
+    const uint8_t *mapRow = videoRamAt(vram, map + (y / 8) * 32);
+
+    for (int x = 0; x < SCREEN_WIDTH; x++)
+    {
+        uint8_t bgX = static_cast<uint8_t>(x + m_regSCX);
+        colors[x] = tileColor(vram, mapRow[bgX / 8], y % 8, bgX % 8);
+    }
+}
+
+void LcdController::renderWindow(VideoRam vram, uint8_t *colors)
+{
+    int map = ((m_regLCDC & LCDC_WIN_MAP) != 0) ? 0x1C00 : 0x1800;
+    const uint8_t *mapRow = videoRamAt(vram, map + (m_windowLine / 8) * 32);
+    int startX = m_regWX - 7;
+
+    for (int x = (startX < 0) ? 0 : startX; x < SCREEN_WIDTH; x++)
+    {
+        int winX = x - startX;
+        colors[x] = tileColor(vram, mapRow[winX / 8], m_windowLine % 8, winX % 8);
+    }
+}
+
+void LcdController::renderSprites(VideoRam vram, uint8_t ly, const uint8_t *bgColors, uint8_t *out)
+{
+    int count = m_lineSpriteCount[ly];
+    if (count == 0)
+    {
+        return;
+    }
+
+    const uint8_t *oam = m_emu->mem().oam();
+    int height = ((m_regLCDC & LCDC_OBJ_SIZE) != 0) ? 16 : 8;
+
+    // Sort by priority: lowest X first, then OAM order (insertion sort, max 10)
+    uint8_t order[MAX_SPRITES_PER_LINE];
+    for (int i = 0; i < count; i++)
+    {
+        uint8_t sprite = m_lineSprites[ly][i];
+        int j = i;
+        while (j > 0 && oam[order[j - 1] * 4 + 1] > oam[sprite * 4 + 1])
+        {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = sprite;
+    }
+
+    // Draw from lowest to highest priority so that the latter wins
+    for (int i = count - 1; i >= 0; i--)
+    {
+        const uint8_t *entry = oam + order[i] * 4;
+        int spriteX = entry[1] - 8;
+        uint8_t attr = entry[3];
+        uint8_t palette = ((attr & OBJ_ATTR_PALETTE) != 0) ? m_regOBP1 : m_regOBP0;
+
+        int row = ly - (entry[0] - 16);
+        if ((attr & OBJ_ATTR_FLIP_Y) != 0)
+        {
+            row = height - 1 - row;
+        }
+        uint8_t tileIndex = (height == 16) ? (entry[2] & 0xFE) : entry[2];
+        const uint8_t *tile = videoRamAt(vram, tileIndex * 16 + row * 2);
+
+        for (int col = 0; col < 8; col++)
+        {
+            int x = spriteX + col;
+            if (x < 0 || x >= SCREEN_WIDTH)
+            {
+                continue;
+            }
+
+            int bit = ((attr & OBJ_ATTR_FLIP_X) != 0) ? col : 7 - col;
+            uint8_t color = (((tile[1] >> bit) & 0x01) << 1) | ((tile[0] >> bit) & 0x01);
+            if (color == 0 || ((attr & OBJ_ATTR_PRIORITY) != 0 && bgColors[x] != 0))
+            {
+                continue;
+            }
+
+            out[x] = (palette >> (color * 2)) & 0x03;
+        }
+    }
+}
+
+void LcdController::buildSpriteIndex(void)
+{
+    const uint8_t *oam = m_emu->mem().oam();
+    int height = ((m_regLCDC & LCDC_OBJ_SIZE) != 0) ? 16 : 8;
+
+    memset(m_lineSpriteCount, 0, sizeof(m_lineSpriteCount));
+
+    for (int sprite = 0; sprite < OAM_SPRITES; sprite++)
+    {
+        int top = oam[sprite * 4] - 16;
+        int first = (top < 0) ? 0 : top;
+        int last = (top + height > SCREEN_HEIGHT) ? SCREEN_HEIGHT : top + height;
+
+        for (int line = first; line < last; line++)
+        {
+            if (m_lineSpriteCount[line] < MAX_SPRITES_PER_LINE)
+            {
+                m_lineSprites[line][m_lineSpriteCount[line]++] = static_cast<uint8_t>(sprite);
+            }
+        }
+    }
+
+    m_spritesDirty = false;
+}
+
+uint8_t LcdController::tileColor(VideoRam vram, uint8_t tileIndex, int row, int col) const
+{
+    const uint8_t *tile = videoRamAt(vram, tileSlot(tileIndex) * 16);
+
+    uint8_t lo = tile[row * 2];
+    uint8_t hi = tile[row * 2 + 1];
+    int bit = 7 - col;
+
+    return static_cast<uint8_t>((((hi >> bit) & 0x01) << 1) | ((lo >> bit) & 0x01));
 }
 
-} // namespace LibDMG
\ No newline at end of file
+} // namespace LibDMG
@@ -1,19 +1,49 @@
 #ifndef LIBDMG_LCD_CONTROLLER_HPP
 #define LIBDMG_LCD_CONTROLLER_HPP
 
+#include <cstdint>
 #include <cereal/archives/xml.hpp>
 
+#include "state/binary_archive.hpp"
+
 namespace LibDMG
 {
-class Peripherals;
+class Emulator;
 
 class LcdController
 {
   public:
-    LcdController() :   m_cycles(0),
-                        m_state(STATE_MODE0),
-                        m_duration(MODE0_DURATION),
-                        m_regLY(0)
+    static const int SCREEN_WIDTH = 160;
+    static const int SCREEN_HEIGHT = 144;
+
+    LcdController(Emulator * emu = nullptr) :
+                        m_emu(emu),
+                        m_frameCycle(0),
+                        m_nextEvent(MODE2_END),
+                        m_regLCDC(0),
+                        m_regSTAT(0),
+                        m_regSCY(0),
+                        m_regSCX(0),
+                        m_regLYC(0),
+                        m_regDMA(0),
+                        m_regBGP(0),
+                        m_regOBP0(0),
+                        m_regOBP1(0),
+                        m_regWY(0),
+                        m_regWX(0),
+                        m_windowLine(0),
+                        m_frameCount(0),
+                        m_frameHashEnabled(false),
+                        m_frameHashMainRam(false),
+                        m_frameHash(0),
+                        m_spritesDirty(true),
+                        m_lineSpriteCount(),
+                        m_tick(1),
+                        m_oamTick(0),
+                        m_tileTick(),
+                        m_mapRowTick(),
+                        m_lineValid(),
+                        m_frame()
     {
     }
 
@@ -24,63 +54,187 @@ class LcdController
     template <class Archive>
     void serialize(Archive &ar)
     {
-        ar(CEREAL_NVP(m_cycles),
-           CEREAL_NVP(m_duration),
-           CEREAL_NVP(m_state),
-           CEREAL_NVP(m_regLY));
+        ar(CEREAL_NVP(m_frameCycle),
+           CEREAL_NVP(m_nextEvent),
+           CEREAL_NVP(m_regLCDC),
+           CEREAL_NVP(m_regSTAT),
+           CEREAL_NVP(m_regSCY),
+           CEREAL_NVP(m_regSCX),
+           CEREAL_NVP(m_regLYC),
+           CEREAL_NVP(m_regDMA),
+           CEREAL_NVP(m_regBGP),
+           CEREAL_NVP(m_regOBP0),
+           CEREAL_NVP(m_regOBP1),
+           CEREAL_NVP(m_regWY),
+           CEREAL_NVP(m_regWX),
+           CEREAL_NVP(m_windowLine),
+           CEREAL_NVP(m_frameCount));
+
+        // VRAM and OAM may have been replaced along with the rest of the state
+        if (ArchiveIsLoading<Archive>::value)
+        {
+            m_spritesDirty = true;
+            invalidateLines();
+        }
     }
 
-    void setRegLCDC(uint8_t val) {}
-    void setRegSTAT(uint8_t val) {}
-    void setRegSCY(uint8_t val) {}
-    void setRegSCX(uint8_t val) {}
+    void setRegLCDC(uint8_t val);
+    void setRegSTAT(uint8_t val) { m_regSTAT = val & 0x78; }
+    void setRegSCY(uint8_t val) { m_regSCY = val; }
+    void setRegSCX(uint8_t val) { m_regSCX = val; }
     void setRegLY(uint8_t val) {}
-    void setRegLYC(uint8_t val) {}
-    void setRegDMA(uint8_t val) {}
-    void setRegBGP(uint8_t val) {}
-    void setRegOBP0(uint8_t val) {}
-    void setRegOBP1(uint8_t val) {}
-    void setRegWY(uint8_t val) {}
-    void setRegWX(uint8_t val) {}
-
-    uint8_t regLCDC(void) const { return 0; }
-    uint8_t regSTAT(void) const { return 0; }
-    uint8_t regSCY(void) const { return 0; }
-    uint8_t regSCX(void) const { return 0; }
-    uint8_t regLY(void) const { return m_regLY; }
-    uint8_t regLYC(void) const { return 0; }
-    uint8_t regDMA(void) const { return 0; }
-    uint8_t regBGP(void) const { return 0; }
-    uint8_t regOBP0(void) const { return 0; }
-    uint8_t regOBP1(void) const { return 0; }
-    uint8_t regWY(void) const { return 0; }
-    uint8_t regWX(void) const { return 0; }
+    void setRegLYC(uint8_t val) { m_regLYC = val; m_nextEvent = nextEventCycle(); }
+    void setRegDMA(uint8_t val);
+    void setRegBGP(uint8_t val) { m_regBGP = val; }
+    void setRegOBP0(uint8_t val) { m_regOBP0 = val; }
+    void setRegOBP1(uint8_t val) { m_regOBP1 = val; }
+    void setRegWY(uint8_t val) { m_regWY = val; }
+    void setRegWX(uint8_t val) { m_regWX = val; }
+
+    uint8_t regLCDC(void) const { return m_regLCDC; }
+    uint8_t regSTAT(void) const;
+    uint8_t regSCY(void) const { return m_regSCY; }
+    uint8_t regSCX(void) const { return m_regSCX; }
+    uint8_t regLY(void) const { return isEnabled() ? static_cast<uint8_t>(line()) : 0; }
+    uint8_t regLYC(void) const { return m_regLYC; }
+    uint8_t regDMA(void) const { return m_regDMA; }
+    uint8_t regBGP(void) const { return m_regBGP; }
+    uint8_t regOBP0(void) const { return m_regOBP0; }
+    uint8_t regOBP1(void) const { return m_regOBP1; }
+    uint8_t regWY(void) const { return m_regWY; }
+    uint8_t regWX(void) const { return m_regWX; }
+
+    // Timing is computed in closed form from the position in the frame.
+    // While the LCD is off, LY and the mode read 0 and no interrupt is
+    // requested, but frames are still counted so that hosts keep their pace.
+    // Turning it on starts a new frame.
+    bool isEnabled(void) const { return (m_regLCDC & LCDC_LCD_ENABLE) != 0; }
+    int frameCycle(void) const { return m_frameCycle; }
+    uint8_t mode(void) const;
+    int nextEventCycle(void) const;
+    int cyclesUntilNextEvent(void) const { return m_nextEvent - m_frameCycle; }
+    // Cycles before the start of the next VBlank, a whole frame when it just started
+    int cyclesUntilVBlank(void) const;
+
+    // Must be called on every OAM write, the sprite index is rebuilt lazily
+    void invalidateSprites(void) { m_spritesDirty = true; m_oamTick = m_tick; }
+    // Must be called on every VRAM write, to track which lines need redrawing
+    void videoRamWritten(uint16_t offset);
+    // Forces every line to be redrawn
+    void invalidateLines(void);
+
+    // Last rendered frame, as shades 0-3 (BGP already applied)
+    const uint8_t * line(int ly) const { return m_frame[ly]; }
+
+    // Frames are counted at the start of VBlank. When enabled, a CRC-32C of
+    // the completed frame (and optionally of main RAM) is computed there too.
+    void setFrameHashEnabled(bool enabled, bool includeMainRam = false)
+    {
+        m_frameHashEnabled = enabled;
+        m_frameHashMainRam = includeMainRam;
+    }
+    uint32_t frameCount(void) const { return m_frameCount; }
+    uint32_t frameHash(void) const { return m_frameHash; }
+
+    static const int LINE_CYCLES = 456;
+    static const int FRAME_LINES = 154;
+    static const int FRAME_CYCLES = LINE_CYCLES * FRAME_LINES;
 
   private:
-    enum state_t
+    static const int MODE2_END = 80;        // OAM search, from the start of the line
+    static const int MODE3_END = 80 + 172;  // Pixel transfer, HBlank until the end of the line
+
+    // Line of the frame timing, whether the LCD is on or not
+    int line(void) const { return m_frameCycle / LINE_CYCLES; }
+
+    static const uint8_t STAT_INT_MODE0 = 0x08;
+    static const uint8_t STAT_INT_MODE1 = 0x10;
+    static const uint8_t STAT_INT_MODE2 = 0x20;
+    static const uint8_t STAT_INT_LYC = 0x40;
+
+    static const int OAM_SPRITES = 40;
+    static const int MAX_SPRITES_PER_LINE = 10;
+
+    static const uint8_t OBJ_ATTR_PRIORITY = 0x80;
+    static const uint8_t OBJ_ATTR_FLIP_Y = 0x40;
+    static const uint8_t OBJ_ATTR_FLIP_X = 0x20;
+    static const uint8_t OBJ_ATTR_PALETTE = 0x10;
+
+    static const uint8_t INT_VBLANK = 0x01;
+    static const uint8_t INT_STAT = 0x02;
+
+    static const uint8_t LCDC_BG_ENABLE = 0x01;
+    static const uint8_t LCDC_OBJ_ENABLE = 0x02;
+    static const uint8_t LCDC_OBJ_SIZE = 0x04;
+    static const uint8_t LCDC_BG_MAP = 0x08;
+    static const uint8_t LCDC_TILE_DATA = 0x10;
+    static const uint8_t LCDC_WIN_ENABLE = 0x20;
+    static const uint8_t LCDC_WIN_MAP = 0x40;
+    static const uint8_t LCDC_LCD_ENABLE = 0x80;
+
+    Emulator * m_emu;
+
+    int m_frameCycle;   // Position in the frame, LY and mode are derived from it
+    int m_nextEvent;    // Frame cycle of the next mode change, LYC match or VBlank
+
+    uint8_t m_regLCDC;  // $FF40 - LCD Control
+    uint8_t m_regSTAT;  // $FF41 - LCD Status (interrupt selection bits only)
+    uint8_t m_regSCY;   // $FF42 - Scroll Y
+    uint8_t m_regSCX;   // $FF43 - Scroll X
+    uint8_t m_regLYC;   // $FF45 - LY compare
+    uint8_t m_regDMA;   // $FF46 - OAM DMA source
+    uint8_t m_regBGP;   // $FF47 - BG palette
+    uint8_t m_regOBP0;  // $FF48 - Object palette 0
+    uint8_t m_regOBP1;  // $FF49 - Object palette 1
+    uint8_t m_regWY;    // $FF4A - Window Y
+    uint8_t m_regWX;    // $FF4B - Window X + 7
+
+    uint8_t m_windowLine;   // Internal window line counter
+
+    uint32_t m_frameCount;
+    bool     m_frameHashEnabled;
+    bool     m_frameHashMainRam;
+    uint32_t m_frameHash;
+
+    // Sprites visible on each line, in OAM order
+    bool    m_spritesDirty;
+    uint8_t m_lineSpriteCount[SCREEN_HEIGHT];
+    uint8_t m_lineSprites[SCREEN_HEIGHT][MAX_SPRITES_PER_LINE];
+
+    // Dirty line tracking. VRAM and OAM writes are stamped with the current
+    // line tick; a line is only redrawn if its registers changed or something
+    // it reads was written since it was last drawn.
+    uint64_t m_tick;
+    uint64_t m_oamTick;
+    uint64_t m_tileTick[384];
+    uint64_t m_mapRowTick[64];
+    uint64_t m_lineTick[SCREEN_HEIGHT];
+    uint64_t m_lineKey[SCREEN_HEIGHT];
+    bool     m_lineValid[SCREEN_HEIGHT];
+    bool     m_lineHadSprites[SCREEN_HEIGHT];
+
+    uint8_t m_frame[SCREEN_HEIGHT][SCREEN_WIDTH];
+
+    void processEvent(void);
+    void requestInterrupt(uint8_t mask);
+    void endFrame(void);
+
+    // Page table of video RAM, see MemControllerBase::page()
+    typedef const uint8_t * const * VideoRam;
+
+    void renderLine(uint8_t ly);
+    bool isLineDirty(VideoRam vram, uint8_t ly, uint64_t key, bool windowVisible) const;
+    void renderBackground(VideoRam vram, uint8_t ly, uint8_t *colors);
+    void renderWindow(VideoRam vram, uint8_t *colors);
+    void renderSprites(VideoRam vram, uint8_t ly, const uint8_t *bgColors, uint8_t *out);
+    void buildSpriteIndex(void);
+    // Tile number in VRAM (0-383) for a BG/window tile index
+    int tileSlot(uint8_t tileIndex) const
     {
-        STATE_MODE0,
-        STATE_MODE1,
-        STATE_MODE2,
-        STATE_MODE3
-    };
-    static const int MODE0_DURATION = 204;
-    static const int MODE1_DURATION = 456; // Mode 1 really lasts 10x that
-    static const int MODE2_DURATION = 80;
-    static const int MODE3_DURATION = 172;
-
-    int m_cycles;
-    int m_duration;
-    state_t m_state;
-
-    uint8_t m_regLY;
-
-    void gotoNextState(void);
-    void gotoMode0(void) { m_state = STATE_MODE0; m_duration = MODE0_DURATION; }
-    void gotoMode1(void) { m_state = STATE_MODE1; m_duration = MODE1_DURATION; }
-    void gotoMode2(void) { m_state = STATE_MODE2; m_duration = MODE2_DURATION; }
-    void gotoMode3(void) { m_state = STATE_MODE3; m_duration = MODE3_DURATION; }
+        return ((m_regLCDC & LCDC_TILE_DATA) != 0) ? tileIndex : 256 + static_cast<int8_t>(tileIndex);
+    }
+    uint8_t tileColor(VideoRam vram, uint8_t tileIndex, int row, int col) const;
 };
 } // namespace LibDMG
 
-#endif // LIBDMG_LCD_CONTROLLER_HPP
\ No newline at end of file
+#endif // LIBDMG_LCD_CONTROLLER_HPP
@@ -0,0 +1,132 @@
+#include "link_cable.hpp"
+
+#include <thread>
+
+#include "emulator.hpp"
+
+using namespace LibDMG;
+
+LinkCable::LinkCable()
+{
+    m_ends[0] = nullptr;
+    m_ends[1] = nullptr;
+}
+
+LinkCable::~LinkCable()
+{
+    disconnect();
+}
+
+void LinkCable::connect(Emulator& first, Emulator& second)
+{
+    disconnect();
+
+    m_ends[0] = first.periph()->serial();
+    m_ends[1] = second.periph()->serial();
+    m_ends[0]->setCable(this, 0);
+    m_ends[1]->setCable(this, 1);
+}
+
+void LinkCable::disconnect()
+{
+    for (int i = 0; i < 2; i++)
+    {
+        if (m_ends[i] != nullptr && m_ends[i]->cable() == this)
+        {
+            m_ends[i]->setCable(nullptr, 0);
+        }
+        m_ends[i] = nullptr;
+    }
+}
+
+void LinkCable::run(Emulator& first, Emulator& second, int cycles, int quantum)
+{
+    while (cycles > 0)
+    {
+        int count = (cycles < quantum) ? cycles : quantum;
+        first.step(count);
+        second.step(count);
+        cycles -= count;
+    }
+}
+
+void LinkCable::transfer(int side, uint8_t out)
+{
+    Serial *other = m_ends[1 - side];
+    uint8_t in = (other != nullptr) ? other->shiftExternal(out) : 0xFF;
+    m_ends[side]->completeTransfer(in);
+}
+
+ThreadedLinkCable::ThreadedLinkCable(int quantum) :
+    m_quantum(quantum)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        m_hasPending[i] = false;
+        m_clocks[i] = 0;
+    }
+}
+
+void ThreadedLinkCable::finish(int side)
+{
+    m_clocks[side].store(UINT64_MAX, std::memory_order_release);
+}
+
+void ThreadedLinkCable::transfer(int side, uint8_t out)
+{
+    // Stamped one cycle past what the other end may reach before it can
+    // see this message, see poll()
+    Message msg = { m_ends[side]->cycles() + m_quantum + 1, MSG_DATA, out };
+    send(side, msg);
+}
+
+void ThreadedLinkCable::send(int side, const Message& msg)
+{
+    // Lockstep bounds the messages in flight, the queue is only full if
+    // the other end is not polling yet
+    while (!m_queues[side].push(msg))
+    {
+        std::this_thread::yield();
+    }
+}
+
+void ThreadedLinkCable::poll(int side)
+{
+    Serial *serial = m_ends[side];
+    int other = 1 - side;
+    uint64_t now = serial->cycles();
+
+    // Publish our clock after the messages sent so far, then wait for the
+    // other end to be at most one quantum behind. A message stamped with
+    // cycle c was pushed before its sender published c - quantum.
+    m_clocks[side].store(now, std::memory_order_release);
+    while (now > static_cast<uint64_t>(m_quantum) &&
+           m_clocks[other].load(std::memory_order_acquire) < now - m_quantum)
+    {
+        std::this_thread::yield();
+    }
+
+    for (;;)
+    {
+        if (!m_hasPending[side])
+        {
+            m_hasPending[side] = m_queues[other].pop(m_pending[side]);
+        }
+        if (!m_hasPending[side] || m_pending[side].cycle > now)
+        {
+            break;
+        }
+
+        const Message& msg = m_pending[side];
+        if (msg.type == MSG_DATA)
+        {
+            Message reply = { now + m_quantum + 1, MSG_REPLY, serial->shiftExternal(msg.data) };
+            send(side, reply);
+        }
+        else
+        {
+            serial->completeTransfer(msg.data);
+        }
+        m_hasPending[side] = false;
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef LIBDMG_LINK_CABLE_HPP
+#define LIBDMG_LINK_CABLE_HPP
+
+#include <atomic>
+#include <cstdint>
+
+#include "utils/spsc_queue.hpp"
+
+namespace LibDMG
+{
+    class Emulator;
+    class Serial;
+
+    // Virtual link cable between the serial controllers of two emulators
+    // running on the same thread. Bytes are exchanged at once when the
+    // clocking end finishes shifting: the emulators only have to be run in
+    // turns, with run() or any slicing of their own.
+    class LinkCable
+    {
+    public:
+        LinkCable();
+        virtual ~LinkCable();
+
+        void connect(Emulator& first, Emulator& second);
+        void disconnect();
+
+        Serial * const end(int side) const { return m_ends[side]; }
+
+        // Runs both emulators in turns of quantum cycles. With the default
+        // quantum, a slave sees a transfer before its own next one could end.
+        static void run(Emulator& first, Emulator& second, int cycles, int quantum = 4096);
+
+        // Called by the serial controllers
+        virtual void transfer(int side, uint8_t out);
+        virtual void poll(int side) {}
+
+    protected:
+        Serial * m_ends[2];
+    };
+
+    // Link cable between emulators running on separate threads. The two
+    // threads stay in lockstep at the quantum granularity, without locks:
+    // each end publishes its cycle count and never runs more than quantum
+    // cycles ahead of the other. Bytes travel through bounded lock-free
+    // queues, stamped with the cycle at which the other end applies them,
+    // which keeps the exchanges deterministic whatever the scheduling.
+    class ThreadedLinkCable : public LinkCable
+    {
+    public:
+        ThreadedLinkCable(int quantum = 4096);
+
+        // Must be called by a thread that stops stepping its emulator, so
+        // that the other end does not wait for it forever
+        void finish(int side);
+
+        void transfer(int side, uint8_t out) override;
+        void poll(int side) override;
+
+    private:
+        enum MessageType { MSG_DATA, MSG_REPLY };
+
+        struct Message
+        {
+            uint64_t cycle;     // Applied by the receiver at this cycle
+            uint8_t  type;
+            uint8_t  data;
+        };
+
+        int m_quantum;
+
+        // Queue i carries messages sent by end i
+        SpscQueue<Message, 16> m_queues[2];
+        Message                m_pending[2];
+        bool                   m_hasPending[2];
+        alignas(64) std::atomic<uint64_t> m_clocks[2];
+
+        void send(int side, const Message& msg);
+    };
+}
+
+#endif // LIBDMG_LINK_CABLE_HPP
@@ -1,5 +1,7 @@
 #include "peripherals.hpp"
 
+#include <algorithm>
+
 #include "emulator.hpp"
 #include "logger.hpp"
 
@@ -8,7 +10,18 @@ using namespace LibDMG;
 void Peripherals::step(int cycles)
 {
     m_timer->step(cycles);
+    m_serial->step(cycles);
     m_lcd->step(cycles);
+    m_apu->step(cycles);
+}
+
+int Peripherals::cyclesUntilNextEvent() const
+{
+    int cycles = MAX_STEP_CYCLES;
+    cycles = std::min(cycles, m_lcd->cyclesUntilNextEvent());
+    cycles = std::min(cycles, m_timer->cyclesUntilOverflow());
+    cycles = std::min(cycles, m_serial->cyclesUntilTransferEnd());
+    return std::max(cycles, 1);
 }
 
 void Peripherals::processInterrupts(void)
@@ -25,17 +38,11 @@ uint8_t Peripherals::reg(uint8_t offset) const
     switch (offset)
     {
     // Input
-    case PERIPH_REG_P1:
-        // TODO
-		LOG_WARN("Periph: Input not implemented yet");
-        return 0;
+    case PERIPH_REG_P1: return m_joypad->regP1();
 
     // Serial
-    case PERIPH_REG_SB:
-    case PERIPH_REG_SC:
-        // TODO
-		LOG_WARN("Periph: Serial controller not implemented yet");
-        return 0;
+    case PERIPH_REG_SB: return m_serial->regSB();
+    case PERIPH_REG_SC: return m_serial->regSC();
 
     // Timer
     case PERIPH_REG_DIV:  return m_timer->regDIV();
@@ -69,9 +76,7 @@ uint8_t Peripherals::reg(uint8_t offset) const
     case PERIPH_REG_NR50:
     case PERIPH_REG_NR51:
     case PERIPH_REG_NR52:
-        // TODO
-		LOG_WARN("Periph: Sound controller not implemented yet");
-        return 0;
+        return m_apu->reg(offset);
 
     // LCD
     case PERIPH_REG_LCDC: return m_lcd->regLCDC();
@@ -92,6 +97,11 @@ uint8_t Peripherals::reg(uint8_t offset) const
         return m_regIE;
 
     default:
+        // Wave pattern RAM
+        if (offset >= PERIPH_REG_WAVE && offset <= PERIPH_REG_WAVE_END)
+        {
+            return m_apu->reg(offset);
+        }
         LOG_WARN("Peripherals: Read unkown register");
         return 0;
     }
@@ -102,17 +112,11 @@ void Peripherals::setReg(uint8_t offset, uint8_t val)
     switch (offset)
     {
         // Input
-    case PERIPH_REG_P1:
-        // TODO
-		LOG_WARN("Periph: Input not implemented yet");
-        break;
+    case PERIPH_REG_P1: m_joypad->setRegP1(val); break;
 
         // Serial
-    case PERIPH_REG_SB:
-    case PERIPH_REG_SC:
-		// TODO
-		LOG_WARN("Periph: Serial controller not implemented yet");
-        break;
+    case PERIPH_REG_SB: m_serial->setRegSB(val); break;
+    case PERIPH_REG_SC: m_serial->setRegSC(val); break;
 
         // Timer
     case PERIPH_REG_DIV:  m_timer->setRegDIV(val); break;
@@ -147,8 +151,7 @@ void Peripherals::setReg(uint8_t offset, uint8_t val)
     case PERIPH_REG_NR50:
     case PERIPH_REG_NR51:
     case PERIPH_REG_NR52:
-        // TODO
-		LOG_WARN("Periph: Sound controller not implemented yet");
+        m_apu->setReg(offset, val);
         break;
 
         // LCD
@@ -171,6 +174,12 @@ void Peripherals::setReg(uint8_t offset, uint8_t val)
         break;
 
     default:
+        // Wave pattern RAM
+        if (offset >= PERIPH_REG_WAVE && offset <= PERIPH_REG_WAVE_END)
+        {
+            m_apu->setReg(offset, val);
+            break;
+        }
         LOG_WARN("Peripherals: Write unkown register");
     }
 }
\ No newline at end of file
@@ -8,6 +8,9 @@
 
 #include "timer.hpp"
 #include "lcd_controller.hpp"
+#include "serial.hpp"
+#include "joypad.hpp"
+#include "audio/apu.hpp"
 
 namespace LibDMG
 {
@@ -18,20 +21,34 @@ namespace LibDMG
     public:
         Peripherals(Emulator * emu = nullptr) : 
             m_emu(emu),
+            m_joypad(std::make_unique<Joypad>(emu)),
             m_timer(std::make_unique<Timer>()),
-            m_lcd(std::make_unique<LcdController>())
-             
+            m_serial(std::make_unique<Serial>(emu)),
+            m_lcd(std::make_unique<LcdController>(emu)),
+            m_apu(std::make_unique<Apu>()),
+            m_regIF(0),
+            m_regIE(0),
+            m_flagIME(false)
         {}
 
         void step(int cycles);
+        // Cycles the CPU can run before the peripherals must catch up: the
+        // next LCD mode change, timer overflow or serial transfer end, and
+        // at most MAX_STEP_CYCLES so that registers such as DIV keep moving
+        int cyclesUntilNextEvent() const;
+
+        static const int MAX_STEP_CYCLES = 256;
 
         void saveState(std::ostream& out) { cereal::XMLOutputArchive ar(out); serialize(ar); }
         void loadState(std::istream& in) { cereal::XMLInputArchive ar(in); serialize(ar); }
         template<class Archive>
         void serialize(Archive & ar)
         {
-            ar(CEREAL_NVP(m_timer),
+            ar(CEREAL_NVP(m_joypad),
+               CEREAL_NVP(m_timer),
+               CEREAL_NVP(m_serial),
                CEREAL_NVP(m_lcd),
+               CEREAL_NVP(m_apu),
                CEREAL_NVP(m_regIF),
                CEREAL_NVP(m_regIE),
                CEREAL_NVP(m_flagIME));
@@ -39,6 +56,12 @@ namespace LibDMG
 
         void processInterrupts(void);
 
+        Joypad * const joypad() const { return m_joypad.get(); }
+        Timer * const timer() const { return m_timer.get(); }
+        Serial * const serial() const { return m_serial.get(); }
+        LcdController * const lcd() const { return m_lcd.get(); }
+        Apu * const apu() const { return m_apu.get(); }
+
         uint8_t regIF() const { return m_regIF; }
         uint8_t regIE() const { return m_regIE; }
         bool flagIME() const { return m_flagIME; }
@@ -80,6 +103,8 @@ namespace LibDMG
             PERIPH_REG_NR50 = 0x24,
             PERIPH_REG_NR51 = 0x25,
             PERIPH_REG_NR52 = 0x26,
+            PERIPH_REG_WAVE = 0x30,
+            PERIPH_REG_WAVE_END = 0x3F,
             PERIPH_REG_LCDC = 0x40,
             PERIPH_REG_STAT = 0x41,
             PERIPH_REG_SCY = 0x42,
@@ -98,8 +123,11 @@ namespace LibDMG
     private:
         Emulator * m_emu;
 
+        std::unique_ptr<Joypad>        m_joypad;
         std::unique_ptr<Timer>		   m_timer;
+        std::unique_ptr<Serial>        m_serial;
 		std::unique_ptr<LcdController> m_lcd;
+        std::unique_ptr<Apu>           m_apu;
 
         uint8_t m_regIF;    // $FF0F - Interrupt Flag
         uint8_t m_regIE;    // $FFFF - Interrupt Enable
@@ -0,0 +1,87 @@
+#include "serial.hpp"
+
+#include "emulator.hpp"
+#include "link_cable.hpp"
+
+using namespace LibDMG;
+
+const int Serial::TRANSFER_CYCLES;
+const uint8_t Serial::INT_SERIAL;
+
+void Serial::step(int cycles)
+{
+    m_cycles += cycles;
+
+    if (m_cable != nullptr)
+    {
+        m_cable->poll(m_side);
+    }
+
+    if (m_transferCycles > 0)
+    {
+        m_transferCycles -= cycles;
+        if (m_transferCycles <= 0)
+        {
+            m_transferCycles = 0;
+            if (m_cable != nullptr)
+            {
+                // The cable calls completeTransfer(), maybe later
+                m_waitingReply = true;
+                m_cable->transfer(m_side, m_regSB);
+            }
+            else
+            {
+                completeTransfer(0xFF);
+            }
+        }
+    }
+}
+
+void Serial::setRegSC(uint8_t val)
+{
+    m_regSC = val & (SC_START | SC_INTERNAL_CLOCK);
+    if ((m_regSC & SC_START) && (m_regSC & SC_INTERNAL_CLOCK))
+    {
+        if (!m_waitingReply)
+        {
+            m_transferCycles = TRANSFER_CYCLES;
+            if (m_outputCallback)
+            {
+                m_outputCallback(m_regSB);
+            }
+        }
+    }
+    else
+    {
+        // Aborted, or waiting for the other end to clock
+        m_transferCycles = 0;
+    }
+}
+
+uint8_t Serial::shiftExternal(uint8_t in)
+{
+    uint8_t out = m_regSB;
+    m_regSB = in;
+    if ((m_regSC & SC_START) && !(m_regSC & SC_INTERNAL_CLOCK))
+    {
+        m_regSC &= ~SC_START;
+        requestInterrupt();
+    }
+    return out;
+}
+
+void Serial::completeTransfer(uint8_t in)
+{
+    m_waitingReply = false;
+    m_regSB = in;
+    m_regSC &= ~SC_START;
+    requestInterrupt();
+}
+
+void Serial::requestInterrupt()
+{
+    if (m_emu != nullptr)
+    {
+        m_emu->periph()->setRegIF(m_emu->periph()->regIF() | INT_SERIAL);
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef LIBDMG_SERIAL_HPP
+#define LIBDMG_SERIAL_HPP
+
+#include <climits>
+#include <cstdint>
+#include <functional>
+#include <cereal/archives/xml.hpp>
+
+namespace LibDMG
+{
+    class Emulator;
+    class LinkCable;
+
+    // Serial controller. A transfer clocked internally shifts the 8 bits of
+    // SB out in 4096 cycles, then the byte received from the other end of
+    // the link cable is placed in SB and the serial interrupt is requested.
+    // Without a cable, 0xFF is received.
+    class Serial
+    {
+    public:
+        static const int TRANSFER_CYCLES = 4096;   // 8 bits at 8192 Hz
+        static const uint8_t INT_SERIAL = 0x08;
+
+        Serial(Emulator * emu = nullptr) :
+            m_emu(emu),
+            m_cable(nullptr),
+            m_side(0),
+            m_cycles(0),
+            m_transferCycles(0),
+            m_waitingReply(false),
+            m_regSB(0),
+            m_regSC(0)
+        { }
+
+        void step(int cycles);
+
+        void saveState(std::ostream& out) { cereal::XMLOutputArchive ar(out); serialize(ar); }
+        void loadState(std::istream& in) { cereal::XMLInputArchive ar(in); serialize(ar); }
+        template<class Archive>
+        void serialize(Archive & ar)
+        {
+            ar(CEREAL_NVP(m_cycles),
+               CEREAL_NVP(m_transferCycles),
+               CEREAL_NVP(m_waitingReply),
+               CEREAL_NVP(m_regSB),
+               CEREAL_NVP(m_regSC));
+        }
+
+        // Plugs one end of a cable, nullptr unplugs it. Called by LinkCable.
+        void setCable(LinkCable *cable, int side) { m_cable = cable; m_side = side; }
+        LinkCable * const cable() const { return m_cable; }
+
+        // Called with each byte this end starts sending on its own clock,
+        // which is how test ROMs print. An empty function disables it.
+        void setOutputCallback(std::function<void(uint8_t)> callback) { m_outputCallback = callback; }
+
+        // Cycles this controller has been stepped for, used as the link clock
+        uint64_t cycles() const { return m_cycles; }
+
+        // The other end clocked a byte in: returns the byte shifted out
+        uint8_t shiftExternal(uint8_t in);
+        // End of a transfer clocked by this end
+        void completeTransfer(uint8_t in);
+
+        void setRegSB(uint8_t val) { m_regSB = val; }
+        void setRegSC(uint8_t val);
+
+        uint8_t regSB() const { return m_regSB; }
+        uint8_t regSC() const { return m_regSC | 0x7E; }
+        bool isTransferring() const { return (m_regSC & SC_START) != 0; }
+        // Cycles before a transfer clocked by this end completes, INT_MAX if none
+        int cyclesUntilTransferEnd() const { return (m_transferCycles > 0) ? m_transferCycles : INT_MAX; }
+
+    private:
+        static const uint8_t SC_START = 0x80;
+        static const uint8_t SC_INTERNAL_CLOCK = 0x01;
+
+        Emulator *  m_emu;
+        LinkCable * m_cable;
+        int         m_side;
+
+        std::function<void(uint8_t)> m_outputCallback;
+
+        uint64_t m_cycles;
+        int      m_transferCycles;  // Cycles left in an internal transfer
+        bool     m_waitingReply;    // Bits are out, waiting for the other end
+
+        uint8_t m_regSB;
+        uint8_t m_regSC;
+
+        void requestInterrupt();
+    };
+}
+
+#endif // LIBDMG_SERIAL_HPP
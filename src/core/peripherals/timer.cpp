@@ -1,76 +1,141 @@
 #include "timer.hpp"
 #include "logger.hpp"
 
+#include <limits>
+
 using namespace LibDMG;
 
 void Timer::step(int cycles)
 {
-    m_divPreCounter += cycles;
+    // Finish a reload started by a previous overflow. No falling edge can
+    // happen during the delay, the shortest TIMA period is 16 cycles.
+    if (m_reloadDelay > 0) {
+        if (cycles < m_reloadDelay) {
+            m_reloadDelay -= cycles;
+            m_counter = static_cast<uint16_t>(m_counter + cycles);
+            return;
+        }
 
-    // Update DIV counter
-    while (m_divPreCounter >= TIMER_DIV_PRESCALER) {
-        m_divPreCounter -= TIMER_DIV_PRESCALER;
-        m_regDIV++;
+        cycles -= m_reloadDelay;
+        m_counter = static_cast<uint16_t>(m_counter + m_reloadDelay);
+        reloadTima();
     }
 
-    if (!m_isRunning) {
+    uint32_t start = m_counter;
+    m_counter = static_cast<uint16_t>(start + cycles);
+
+    if (!isRunning()) {
         return;
     }
 
-    m_timaPreCounter += cycles;
+    // Falling edges of bit (shift - 1) are the multiples of 2^shift crossed
+    int shift = periodShift();
+    uint64_t end = static_cast<uint64_t>(start) + cycles;
+    int64_t edges = static_cast<int64_t>((end >> shift) - (start >> shift));
 
-    // Update TIMA counter
-    while (m_timaPreCounter >= m_timaPrescaler) {
-        m_timaPreCounter -= m_timaPrescaler;
-        m_regTIMA++;
-        // Overflow
-        if (m_regTIMA == 0) {
-            m_regTIMA = m_regTMA;
-            m_intTIMAPending = true;
-        }
+    int ticksToOverflow = 256 - m_regTIMA;
+    if (edges < ticksToOverflow) {
+        m_regTIMA = static_cast<uint8_t>(m_regTIMA + edges);
+        return;
+    }
+
+    // After the first overflow TIMA restarts from TMA, possibly several times
+    int64_t ticksAfterFirst = edges - ticksToOverflow;
+    int reloadPeriod = 256 - m_regTMA;
+    int64_t extraOverflows = ticksAfterFirst / reloadPeriod;
+    int64_t remaining = ticksAfterFirst % reloadPeriod;
+
+    if (extraOverflows > 0 || remaining > 0) {
+        // At least one reload has completed
+        m_intTIMAPending = true;
+    }
+
+    if (remaining > 0) {
+        m_regTIMA = static_cast<uint8_t>(m_regTMA + remaining);
+        return;
+    }
+
+    // The step ends shortly after the last overflow, which may still be
+    // waiting for its reload
+    int64_t lastEdge = ticksToOverflow - 1 + extraOverflows * reloadPeriod;
+    uint64_t lastOverflow = (((start >> shift) + 1 + lastEdge) << shift) - start;
+    int64_t elapsed = static_cast<int64_t>(cycles) - static_cast<int64_t>(lastOverflow);
+
+    if (elapsed >= TIMER_RELOAD_DELAY) {
+        reloadTima();
+    }
+    else {
+        m_regTIMA = 0;
+        m_reloadDelay = static_cast<int>(TIMER_RELOAD_DELAY - elapsed);
+    }
+}
+
+int Timer::cyclesUntilOverflow() const
+{
+    if (m_reloadDelay > 0) {
+        return m_reloadDelay;
+    }
+
+    if (!isRunning()) {
+        return std::numeric_limits<int>::max();
     }
+
+    int shift = periodShift();
+    int period = 1 << shift;
+    int firstEdge = period - (m_counter & (period - 1));
+
+    return firstEdge + (255 - m_regTIMA) * period + TIMER_RELOAD_DELAY;
 }
 
 void Timer::setRegDIV(uint8_t val)
 {
-    m_regDIV = 0;
+    // Resetting the counter makes the selected bit fall if it was set
+    bool oldSignal = timaSignal();
+    m_counter = 0;
+    if (oldSignal) {
+        incrementTima();
+    }
+}
 
-    // Resetting DIV also resets internal counters
-    m_divPreCounter = 0;
-    m_timaPreCounter = 0;
+void Timer::setRegTIMA(uint8_t val)
+{
+    // Writing during the reload delay cancels the reload and the interrupt
+    m_reloadDelay = 0;
+    m_regTIMA = val;
 }
 
 void Timer::setRegTAC(uint8_t val)
 {
+    // Disabling the timer or selecting another bit can cause a falling edge
+    bool oldSignal = timaSignal();
     m_regTAC = val;
+    if (oldSignal && !timaSignal()) {
+        incrementTima();
+    }
+}
 
-    switch (val & 0x03)
+int Timer::periodShift() const
+{
+    switch (m_regTAC & 0x03)
     {
-    case 0x00:
-        m_timaPrescaler = 1024;
-        break;
-
-    case 0x01:
-        m_timaPrescaler = 16;
-        break;
-
-    case 0x02:
-        m_timaPrescaler = 64;
-        break;
-
-    case 0x03:
-        m_timaPrescaler = 256;
-        break;
-
-    default:
-        // TODO throw exception
-        break;
+    case 0x00: return 10;   // 1024 cycles
+    case 0x01: return 4;    // 16 cycles
+    case 0x02: return 6;    // 64 cycles
+    default:   return 8;    // 256 cycles
     }
+}
 
-    if ((m_regTAC & 0x04) == 0x04) {
-        m_isRunning = true;
-    }
-    else {
-        m_isRunning = false;
+void Timer::incrementTima()
+{
+    m_regTIMA++;
+    if (m_regTIMA == 0) {
+        m_reloadDelay = TIMER_RELOAD_DELAY;
     }
-}
\ No newline at end of file
+}
+
+void Timer::reloadTima()
+{
+    m_reloadDelay = 0;
+    m_regTIMA = m_regTMA;
+    m_intTIMAPending = true;
+}
@@ -9,44 +9,45 @@ namespace LibDMG
 {
     class Peripherals;
 
+    // The timer is built around the 16-bit system counter. DIV is its upper
+    // byte, and TIMA is clocked by the falling edge of the counter bit
+    // selected by TAC, ANDed with the enable bit.
     class Timer
     {
     public:
         Timer() :
-            m_divPreCounter(0),
-            m_timaPreCounter(0),
-            m_timaPrescaler(1024),
-            m_isRunning(false),
+            m_counter(0),
+            m_reloadDelay(0),
             m_intTIMAPending(false),
-            m_regDIV(0),
             m_regTIMA(0),
             m_regTMA(0),
             m_regTAC(0)
         { }
 
+        // Runs in constant time, whatever the number of cycles
         void step(int cycles);
+        // Cycles before the next TIMA interrupt, INT_MAX if the timer is stopped
+        int cyclesUntilOverflow() const;
+
         void saveState(std::ostream& out) { cereal::XMLOutputArchive ar(out); serialize(ar); }
         void loadState(std::istream& in) { cereal::XMLInputArchive ar(in); serialize(ar); }
         template<class Archive>
         void serialize(Archive & ar)
         {
-            ar(CEREAL_NVP(m_divPreCounter),
-               CEREAL_NVP(m_timaPreCounter),
-               CEREAL_NVP(m_timaPrescaler),
-               CEREAL_NVP(m_isRunning),
+            ar(CEREAL_NVP(m_counter),
+               CEREAL_NVP(m_reloadDelay),
                CEREAL_NVP(m_intTIMAPending),
-               CEREAL_NVP(m_regDIV),
                CEREAL_NVP(m_regTIMA),
                CEREAL_NVP(m_regTMA),
                CEREAL_NVP(m_regTAC));
         }
 
         void setRegDIV(uint8_t val);
-        inline void setRegTIMA(uint8_t val) { m_regTIMA = val; }
+        void setRegTIMA(uint8_t val);
         inline void setRegTMA(uint8_t val) { m_regTMA = val; }
         void setRegTAC(uint8_t val);
 
-        uint8_t regDIV() const { return m_regDIV; }
+        uint8_t regDIV() const { return static_cast<uint8_t>(m_counter >> 8); }
         uint8_t regTIMA() const { return m_regTIMA; }
         uint8_t regTMA() const { return m_regTMA; }
         uint8_t regTAC() const { return m_regTAC; }
@@ -54,18 +55,25 @@ namespace LibDMG
         void clearTIMAPending() { m_intTIMAPending = false; }
 
     private:
-        static const int TIMER_DIV_PRESCALER = 256;
-        int m_divPreCounter;
-        int m_timaPreCounter;
-        int m_timaPrescaler;
-        bool m_isRunning;
-        bool m_intTIMAPending;
+        // After an overflow TIMA reads 0 for one M-cycle before TMA is loaded
+        static const int TIMER_RELOAD_DELAY = 4;
+
+        uint16_t m_counter;     // System counter, DIV is the upper byte
+        int      m_reloadDelay; // Cycles left before TMA is loaded, 0 if none
+        bool     m_intTIMAPending;
 
-        uint8_t m_regDIV;
         uint8_t m_regTIMA;
         uint8_t m_regTMA;
-        uint8_t m_regTAC;       
+        uint8_t m_regTAC;
+
+        bool isRunning() const { return (m_regTAC & 0x04) == 0x04; }
+        // Log2 of the TIMA period, the counter bit that clocks TIMA is one below
+        int periodShift() const;
+        // Signal whose falling edge increments TIMA
+        bool timaSignal() const { return isRunning() && ((m_counter >> (periodShift() - 1)) & 0x01) != 0; }
+        void incrementTima();
+        void reloadTima();
     };
 }
 
-#endif // LIBDMG_TIMER_HPP
\ No newline at end of file
+#endif // LIBDMG_TIMER_HPP
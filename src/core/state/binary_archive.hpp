@@ -0,0 +1,236 @@
+#ifndef LIBDMG_BINARY_ARCHIVE_HPP
+#define LIBDMG_BINARY_ARCHIVE_HPP
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <cereal/archives/xml.hpp>
+
+namespace LibDMG
+{
+    // Compact archives for the serialize() templates of the components,
+    // used instead of cereal for save states. Scalars are stored in little
+    // endian, byte arrays are copied as is. Each object with a serialize()
+    // method is stored as a length-prefixed block: when loading a block
+    // written by an older version, the fields missing at its end keep their
+    // current value, and the fields added by a newer version are skipped.
+    // New fields must therefore be appended at the end of serialize().
+
+    namespace detail
+    {
+        template <class T, class Archive, class = void>
+        struct HasSerialize : std::false_type {};
+
+        template <class T, class Archive>
+        struct HasSerialize<T, Archive, decltype(std::declval<T&>().serialize(std::declval<Archive&>()), void())>
+            : std::true_type {};
+    }
+
+    class BinaryOutputArchive
+    {
+    public:
+        explicit BinaryOutputArchive(std::vector<uint8_t>& buffer) : m_buffer(buffer) {}
+
+        template <class... Types>
+        void operator()(Types&&... args)
+        {
+            int expand[] = { 0, (process(args), 0)... };
+            (void)expand;
+        }
+
+        // Opens a block, returns its position for endBlock()
+        size_t beginBlock()
+        {
+            size_t pos = m_buffer.size();
+            m_buffer.resize(pos + 4);
+            return pos;
+        }
+
+        void endBlock(size_t pos)
+        {
+            uint32_t length = static_cast<uint32_t>(m_buffer.size() - pos - 4);
+            for (int i = 0; i < 4; i++)
+            {
+                m_buffer[pos + i] = static_cast<uint8_t>(length >> (8 * i));
+            }
+        }
+
+        void writeBytes(const void *data, size_t size)
+        {
+            const uint8_t *bytes = static_cast<const uint8_t *>(data);
+            m_buffer.insert(m_buffer.end(), bytes, bytes + size);
+        }
+
+    private:
+        std::vector<uint8_t>& m_buffer;
+
+        template <class T>
+        void process(const cereal::NameValuePair<T>& nvp) { process(nvp.value); }
+
+        template <class T>
+        typename std::enable_if<std::is_arithmetic<T>::value>::type process(T& val)
+        {
+            typedef typename std::conditional<std::is_same<T, bool>::value, uint8_t, T>::type Stored;
+            Stored stored = static_cast<Stored>(val);
+            uint8_t bytes[sizeof(Stored)];
+            uint64_t bits = 0;
+            memcpy(&bits, &stored, sizeof(Stored));
+            for (size_t i = 0; i < sizeof(Stored); i++)
+            {
+                bytes[i] = static_cast<uint8_t>(bits >> (8 * i));
+            }
+            writeBytes(bytes, sizeof(Stored));
+        }
+
+        template <class T, size_t N>
+        void process(T (&arr)[N]) { processArray(arr, N); }
+
+        template <class T, size_t N>
+        void process(std::array<T, N>& arr) { processArray(arr.data(), N); }
+
+        template <class T>
+        void process(std::unique_ptr<T>& ptr) { process(*ptr); }
+
+        template <class T>
+        typename std::enable_if<detail::HasSerialize<T, BinaryOutputArchive>::value>::type process(T& obj)
+        {
+            size_t pos = beginBlock();
+            obj.serialize(*this);
+            endBlock(pos);
+        }
+
+        template <class T>
+        void processArray(T *arr, size_t count)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                process(arr[i]);
+            }
+        }
+
+        void processArray(uint8_t *arr, size_t count) { writeBytes(arr, count); }
+    };
+
+    class BinaryInputArchive
+    {
+    public:
+        BinaryInputArchive(const uint8_t *data, size_t size) : m_pos(data), m_end(data + size) {}
+
+        template <class... Types>
+        void operator()(Types&&... args)
+        {
+            int expand[] = { 0, (process(args), 0)... };
+            (void)expand;
+        }
+
+        // Fields past the end of the data keep their value
+        bool readBytes(void *data, size_t size)
+        {
+            if (static_cast<size_t>(m_end - m_pos) < size)
+            {
+                m_pos = m_end;
+                return false;
+            }
+            memcpy(data, m_pos, size);
+            m_pos += size;
+            return true;
+        }
+
+        size_t remaining() const { return m_end - m_pos; }
+
+    private:
+        const uint8_t *m_pos;
+        const uint8_t *m_end;
+
+        template <class T>
+        void process(const cereal::NameValuePair<T>& nvp) { process(nvp.value); }
+
+        template <class T>
+        typename std::enable_if<std::is_arithmetic<T>::value>::type process(T& val)
+        {
+            typedef typename std::conditional<std::is_same<T, bool>::value, uint8_t, T>::type Stored;
+            uint8_t bytes[sizeof(Stored)];
+            if (!readBytes(bytes, sizeof(Stored)))
+            {
+                return;
+            }
+
+            uint64_t bits = 0;
+            for (size_t i = 0; i < sizeof(Stored); i++)
+            {
+                bits |= static_cast<uint64_t>(bytes[i]) << (8 * i);
+            }
+            Stored stored;
+            memcpy(&stored, &bits, sizeof(Stored));
+            val = static_cast<T>(stored);
+        }
+
+        template <class T, size_t N>
+        void process(T (&arr)[N]) { processArray(arr, N); }
+
+        template <class T, size_t N>
+        void process(std::array<T, N>& arr) { processArray(arr.data(), N); }
+
+        template <class T>
+        void process(std::unique_ptr<T>& ptr) { process(*ptr); }
+
+        template <class T>
+        typename std::enable_if<detail::HasSerialize<T, BinaryInputArchive>::value>::type process(T& obj)
+        {
+            uint32_t length = 0;
+            process(length);
+
+            // Read the block within its own bounds
+            const uint8_t *end = m_end;
+            const uint8_t *blockEnd = (length < remaining()) ? m_pos + length : m_end;
+            m_end = blockEnd;
+            obj.serialize(*this);
+            m_pos = blockEnd;
+            m_end = end;
+        }
+
+        template <class T>
+        void processArray(T *arr, size_t count)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                process(arr[i]);
+            }
+        }
+
+        void processArray(uint8_t *arr, size_t count) { readBytes(arr, count); }
+    };
+
+    // Tells serialize() implementations whether state is being restored,
+    // for work that only makes sense after loading
+    template <class Archive>
+    struct ArchiveIsLoading : std::false_type {};
+
+    template <>
+    struct ArchiveIsLoading<cereal::XMLInputArchive> : std::true_type {};
+
+    template <>
+    struct ArchiveIsLoading<BinaryInputArchive> : std::true_type {};
+
+    class StateException : public std::exception
+    {
+    public:
+        StateException(const std::string& msg)
+            : std::exception(),
+              m_msg("StateException - " + msg)
+        { }
+
+        const char* what() const throw() { return m_msg.c_str(); }
+
+    private:
+        std::string m_msg;
+    };
+}
+
+#endif // LIBDMG_BINARY_ARCHIVE_HPP
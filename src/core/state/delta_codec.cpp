@@ -0,0 +1,136 @@
+#include "delta_codec.hpp"
+
+#include <cstring>
+
+namespace LibDMG
+{
+namespace
+{
+    // Shorter runs of equal bytes are kept in the literals, as a new
+    // token would cost more than it saves
+    const size_t MIN_ZERO_RUN = 8;
+
+    uint8_t *writeVarint(uint8_t *out, size_t val)
+    {
+        while (val >= 0x80)
+        {
+            *out++ = static_cast<uint8_t>(val | 0x80);
+            val >>= 7;
+        }
+        *out++ = static_cast<uint8_t>(val);
+        return out;
+    }
+
+    // Returns nullptr on a varint cut by the end or too large for size_t
+    const uint8_t *readVarint(const uint8_t *in, const uint8_t *end, size_t& val)
+    {
+        val = 0;
+        for (int shift = 0; in < end && shift < static_cast<int>(sizeof(size_t) * 8); shift += 7)
+        {
+            uint8_t byte = *in++;
+            val |= static_cast<size_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+            {
+                return in;
+            }
+        }
+        return nullptr;
+    }
+
+    // Number of equal bytes from pos, compared 8 at a time
+    size_t equalRun(const uint8_t *from, const uint8_t *to, size_t pos, size_t size)
+    {
+        size_t start = pos;
+        while (size - pos >= 8)
+        {
+            uint64_t a, b;
+            memcpy(&a, from + pos, 8);
+            memcpy(&b, to + pos, 8);
+            if (a != b)
+            {
+                break;
+            }
+            pos += 8;
+        }
+        while (pos < size && from[pos] == to[pos])
+        {
+            pos++;
+        }
+        return pos - start;
+    }
+}
+
+size_t encodeXorDelta(const uint8_t *from, const uint8_t *to, size_t size, uint8_t *out)
+{
+    uint8_t *start = out;
+    size_t pos = 0;
+    while (pos < size)
+    {
+        size_t zeros = equalRun(from, to, pos, size);
+        pos += zeros;
+
+        size_t literalStart = pos;
+        while (pos < size)
+        {
+            if (from[pos] != to[pos])
+            {
+                pos++;
+                continue;
+            }
+            size_t run = equalRun(from, to, pos, size);
+            if (run >= MIN_ZERO_RUN || pos + run == size)
+            {
+                break;
+            }
+            pos += run;
+        }
+
+        size_t literals = pos - literalStart;
+        if (literals == 0)
+        {
+            // Trailing zeros are implied
+            break;
+        }
+
+        out = writeVarint(out, zeros);
+        out = writeVarint(out, literals);
+        for (size_t i = literalStart; i < pos; i++)
+        {
+            *out++ = from[i] ^ to[i];
+        }
+    }
+    return out - start;
+}
+
+bool applyXorDelta(const uint8_t *delta, size_t deltaSize, uint8_t *target, size_t size)
+{
+    const uint8_t *end = delta + deltaSize;
+    size_t pos = 0;
+    while (delta < end)
+    {
+        size_t zeros, literals;
+        delta = readVarint(delta, end, zeros);
+        if (delta == nullptr)
+        {
+            return false;
+        }
+        delta = readVarint(delta, end, literals);
+        if (delta == nullptr || zeros > size - pos)
+        {
+            return false;
+        }
+        pos += zeros;
+        if (literals > size - pos || literals > static_cast<size_t>(end - delta))
+        {
+            return false;
+        }
+        for (size_t i = 0; i < literals; i++)
+        {
+            target[pos + i] ^= delta[i];
+        }
+        pos += literals;
+        delta += literals;
+    }
+    return true;
+}
+}
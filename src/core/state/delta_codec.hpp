@@ -0,0 +1,28 @@
+#ifndef LIBDMG_DELTA_CODEC_HPP
+#define LIBDMG_DELTA_CODEC_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+namespace LibDMG
+{
+    // Run-length coding of the XOR of two buffers of the same size. The
+    // output is a list of (zero run, literal run, literal bytes), run
+    // lengths being stored as varints; consecutive snapshots mostly differ
+    // by a few bytes, so the runs of zeros make up most of the delta.
+
+    // Largest encoded size for buffers of the given size
+    inline size_t xorDeltaBound(size_t size) { return size + size / 2 + 16; }
+
+    // Encodes from ^ to into out, which holds xorDeltaBound(size) bytes.
+    // Returns the encoded size.
+    size_t encodeXorDelta(const uint8_t *from, const uint8_t *to, size_t size, uint8_t *out);
+
+    // XORs an encoded delta into target, turning one of the buffers into
+    // the other. Returns false if the delta is corrupt: it does not fit
+    // size, or it does not end exactly at deltaSize. Target is then only
+    // partly updated.
+    bool applyXorDelta(const uint8_t *delta, size_t deltaSize, uint8_t *target, size_t size);
+}
+
+#endif // LIBDMG_DELTA_CODEC_HPP
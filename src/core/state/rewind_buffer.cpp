@@ -0,0 +1,119 @@
+#include "rewind_buffer.hpp"
+
+#include <cstring>
+
+#include "emulator.hpp"
+#include "delta_codec.hpp"
+
+using namespace LibDMG;
+
+RewindBuffer::RewindBuffer(Emulator& emu, size_t capacity, uint32_t interval) :
+    m_emu(emu),
+    m_interval(interval > 0 ? interval : 1),
+    m_ring(capacity),
+    m_head(0),
+    m_current(emu.snapshotSize()),
+    m_next(emu.snapshotSize()),
+    m_delta(xorDeltaBound(emu.snapshotSize())),
+    m_hasCurrent(false),
+    m_currentFrame(0)
+{
+}
+
+uint32_t RewindBuffer::frameCount() const
+{
+    return m_emu.periph()->lcd()->frameCount();
+}
+
+void RewindBuffer::update()
+{
+    if (!m_hasCurrent || frameCount() - m_currentFrame >= m_interval)
+    {
+        capture();
+    }
+}
+
+void RewindBuffer::capture()
+{
+    uint32_t frame = frameCount();
+    if (!m_hasCurrent)
+    {
+        m_emu.snapshot(m_current.data());
+        m_hasCurrent = true;
+        m_currentFrame = frame;
+        return;
+    }
+
+    m_emu.snapshot(m_next.data());
+    size_t size = encodeXorDelta(m_next.data(), m_current.data(), m_current.size(), m_delta.data());
+    push(m_delta.data(), size, m_currentFrame);
+    m_current.swap(m_next);
+    m_currentFrame = frame;
+}
+
+void RewindBuffer::push(const uint8_t *data, size_t size, uint32_t frame)
+{
+    if (size > m_ring.size())
+    {
+        // Cannot be stored, the history before it is lost
+        m_entries.clear();
+        m_head = 0;
+        return;
+    }
+
+    if (m_head + size > m_ring.size())
+    {
+        // The tail is left unused, the entries stored there are the oldest
+        while (!m_entries.empty() && m_entries.front().offset >= m_head)
+        {
+            m_entries.pop_front();
+        }
+        m_head = 0;
+    }
+    while (!m_entries.empty() &&
+           m_entries.front().offset < m_head + size &&
+           m_entries.front().offset + m_entries.front().size > m_head)
+    {
+        m_entries.pop_front();
+    }
+
+    memcpy(m_ring.data() + m_head, data, size);
+    m_entries.push_back({ m_head, size, frame });
+    m_head += size;
+}
+
+bool RewindBuffer::rewind(size_t steps)
+{
+    if (steps >= count())
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < steps; i++)
+    {
+        const Entry& entry = m_entries.back();
+        applyXorDelta(m_ring.data() + entry.offset, entry.size, m_current.data(), m_current.size());
+        m_currentFrame = entry.frame;
+        m_head = entry.offset;
+        m_entries.pop_back();
+    }
+    m_emu.restore(m_current.data());
+    return true;
+}
+
+size_t RewindBuffer::memoryUsed() const
+{
+    size_t used = 0;
+    for (const Entry& entry : m_entries)
+    {
+        used += entry.size;
+    }
+    return used;
+}
+
+void RewindBuffer::clear()
+{
+    m_entries.clear();
+    m_head = 0;
+    m_hasCurrent = false;
+}
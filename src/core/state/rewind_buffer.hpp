@@ -0,0 +1,63 @@
+#ifndef LIBDMG_REWIND_BUFFER_HPP
+#define LIBDMG_REWIND_BUFFER_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+namespace LibDMG
+{
+    class Emulator;
+
+    // Bounded history of snapshots for rewinding. Only the newest snapshot
+    // is kept whole; each older one is stored as the encoded XOR delta that
+    // turns its successor back into it, in a ring of fixed size. Rewinding
+    // applies the deltas from the newest one backwards, and the oldest
+    // deltas are dropped to make room.
+    class RewindBuffer
+    {
+    public:
+        // Capacity is in bytes of encoded deltas, interval in frames
+        RewindBuffer(Emulator& emu, size_t capacity = 512 * 1024, uint32_t interval = 4);
+
+        // Call once per frame, captures a snapshot every interval frames
+        void update();
+        // Captures a snapshot now
+        void capture();
+
+        // Restores the state captured steps snapshots before the newest one,
+        // which is 0. Newer snapshots are dropped. Returns false, without
+        // changing anything, if the history is not that long.
+        bool rewind(size_t steps = 1);
+
+        // Snapshots that can be restored
+        size_t count() const { return m_hasCurrent ? m_entries.size() + 1 : 0; }
+        size_t memoryUsed() const;
+        void clear();
+
+    private:
+        struct Entry
+        {
+            size_t   offset;    // In the ring
+            size_t   size;
+            uint32_t frame;     // Of the snapshot the delta restores
+        };
+
+        Emulator&            m_emu;
+        uint32_t             m_interval;
+        std::vector<uint8_t> m_ring;
+        size_t               m_head;
+        std::deque<Entry>    m_entries;
+        std::vector<uint8_t> m_current;
+        std::vector<uint8_t> m_next;
+        std::vector<uint8_t> m_delta;
+        bool                 m_hasCurrent;
+        uint32_t             m_currentFrame;
+
+        uint32_t frameCount() const;
+        void push(const uint8_t *data, size_t size, uint32_t frame);
+    };
+}
+
+#endif // LIBDMG_REWIND_BUFFER_HPP
@@ -0,0 +1,117 @@
+#ifndef LIBDMG_SNAPSHOT_ARCHIVE_HPP
+#define LIBDMG_SNAPSHOT_ARCHIVE_HPP
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <cereal/archives/xml.hpp>
+
+#include "binary_archive.hpp"
+
+namespace LibDMG
+{
+    // Archives for in-memory snapshots. Fields are copied with memcpy, in
+    // host layout and without any framing, into a buffer whose size is
+    // known beforehand: a snapshot is only valid for the build that took
+    // it, and never allocates. Use the binary archives for save states.
+    template <class Derived>
+    class SnapshotArchiveBase
+    {
+    public:
+        template <class... Types>
+        void operator()(Types&&... args)
+        {
+            int expand[] = { 0, (process(args), 0)... };
+            (void)expand;
+        }
+
+    private:
+        Derived& self() { return static_cast<Derived&>(*this); }
+
+        template <class T>
+        void process(const cereal::NameValuePair<T>& nvp) { process(nvp.value); }
+
+        template <class T>
+        typename std::enable_if<std::is_arithmetic<T>::value>::type process(T& val)
+        {
+            self().copy(&val, sizeof(T));
+        }
+
+        template <class T, size_t N>
+        typename std::enable_if<std::is_arithmetic<T>::value>::type process(T (&arr)[N])
+        {
+            self().copy(arr, sizeof(arr));
+        }
+
+        template <class T, size_t N>
+        typename std::enable_if<!std::is_arithmetic<T>::value>::type process(T (&arr)[N])
+        {
+            for (size_t i = 0; i < N; i++)
+            {
+                process(arr[i]);
+            }
+        }
+
+        template <class T, size_t N>
+        void process(std::array<T, N>& arr) { process(*reinterpret_cast<T (*)[N]>(arr.data())); }
+
+        template <class T>
+        void process(std::unique_ptr<T>& ptr) { process(*ptr); }
+
+        template <class T>
+        typename std::enable_if<detail::HasSerialize<T, Derived>::value>::type process(T& obj)
+        {
+            obj.serialize(self());
+        }
+    };
+
+    // Counts the bytes of a snapshot
+    class SnapshotSizer : public SnapshotArchiveBase<SnapshotSizer>
+    {
+    public:
+        SnapshotSizer() : m_size(0) {}
+
+        void copy(void *, size_t size) { m_size += size; }
+        size_t size() const { return m_size; }
+
+    private:
+        size_t m_size;
+    };
+
+    class SnapshotWriter : public SnapshotArchiveBase<SnapshotWriter>
+    {
+    public:
+        explicit SnapshotWriter(uint8_t *buffer) : m_pos(buffer) {}
+
+        void copy(const void *field, size_t size)
+        {
+            memcpy(m_pos, field, size);
+            m_pos += size;
+        }
+
+    private:
+        uint8_t *m_pos;
+    };
+
+    class SnapshotReader : public SnapshotArchiveBase<SnapshotReader>
+    {
+    public:
+        explicit SnapshotReader(const uint8_t *buffer) : m_pos(buffer) {}
+
+        void copy(void *field, size_t size)
+        {
+            memcpy(field, m_pos, size);
+            m_pos += size;
+        }
+
+    private:
+        const uint8_t *m_pos;
+    };
+
+    template <>
+    struct ArchiveIsLoading<SnapshotReader> : std::true_type {};
+}
+
+#endif // LIBDMG_SNAPSHOT_ARCHIVE_HPP
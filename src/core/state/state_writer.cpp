@@ -0,0 +1,174 @@
+#include "state_writer.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include "emulator.hpp"
+#include "delta_codec.hpp"
+#include "utils/crc32c.hpp"
+
+using namespace LibDMG;
+using namespace std;
+
+namespace
+{
+    const char FILE_MAGIC[4] = { 'D', 'M', 'G', 'Z' };
+    const size_t HEADER_SIZE = 12;
+
+    // Far above any state, so that a corrupt header cannot make load()
+    // allocate gigabytes
+    const uint32_t MAX_STATE_SIZE = 16 * 1024 * 1024;
+
+    void writeU32(uint8_t *out, uint32_t val)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            out[i] = static_cast<uint8_t>(val >> (8 * i));
+        }
+    }
+
+    uint32_t readU32(const uint8_t *data)
+    {
+        return data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24);
+    }
+}
+
+StateWriter::StateWriter() :
+    m_running(true),
+    m_busy(false)
+{
+    m_thread = thread(&StateWriter::writerLoop, this);
+}
+
+StateWriter::~StateWriter()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+future<void> StateWriter::save(Emulator& emu, const string& path)
+{
+    Job job;
+    {
+        lock_guard<mutex> lock(m_mutex);
+        if (!m_pool.empty())
+        {
+            job.state.swap(m_pool.back());
+            m_pool.pop_back();
+        }
+    }
+
+    // The buffer keeps its capacity, so this does not allocate once warm
+    emu.saveState(job.state);
+    job.path = path;
+    future<void> done = job.done.get_future();
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_jobs.push_back(move(job));
+    }
+    m_wake.notify_one();
+    return done;
+}
+
+void StateWriter::flush()
+{
+    unique_lock<mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return m_jobs.empty() && !m_busy; });
+}
+
+void StateWriter::writerLoop()
+{
+    unique_lock<mutex> lock(m_mutex);
+    while (true)
+    {
+        m_wake.wait(lock, [this] { return !m_jobs.empty() || !m_running; });
+        if (m_jobs.empty())
+        {
+            // Stopped, with everything written
+            break;
+        }
+
+        Job job = move(m_jobs.front());
+        m_jobs.pop_front();
+        m_busy = true;
+        lock.unlock();
+
+        try
+        {
+            writeFile(job.path, job.state);
+            job.done.set_value();
+        }
+        catch (...)
+        {
+            job.done.set_exception(current_exception());
+        }
+
+        lock.lock();
+        m_pool.push_back(move(job.state));
+        m_busy = false;
+        if (m_jobs.empty())
+        {
+            m_idle.notify_all();
+        }
+    }
+}
+
+void StateWriter::writeFile(const string& path, const vector<uint8_t>& state)
+{
+    // Most of the RAM is zeros
+    if (m_zeros.size() < state.size())
+    {
+        m_zeros.resize(state.size(), 0);
+    }
+    m_encoded.resize(HEADER_SIZE + xorDeltaBound(state.size()));
+    memcpy(m_encoded.data(), FILE_MAGIC, 4);
+    writeU32(m_encoded.data() + 4, static_cast<uint32_t>(state.size()));
+    writeU32(m_encoded.data() + 8, crc32c(state.data(), state.size()));
+    size_t encodedSize = encodeXorDelta(m_zeros.data(), state.data(), state.size(), m_encoded.data() + HEADER_SIZE);
+
+    ofstream file(path.c_str(), ios_base::out | ios_base::binary | ios_base::trunc);
+    if (!file.is_open())
+    {
+        throw StateException("Cannot open " + path);
+    }
+    file.write(reinterpret_cast<const char *>(m_encoded.data()), HEADER_SIZE + encodedSize);
+    if (!file)
+    {
+        throw StateException("Cannot write " + path);
+    }
+}
+
+void StateWriter::load(Emulator& emu, const string& path)
+{
+    ifstream file(path.c_str(), ios_base::in | ios_base::binary);
+    if (!file.is_open())
+    {
+        throw StateException("Cannot open " + path);
+    }
+    vector<uint8_t> data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+    if (data.size() < HEADER_SIZE || memcmp(data.data(), FILE_MAGIC, 4) != 0)
+    {
+        emu.loadState(data.data(), data.size());
+        return;
+    }
+
+    uint32_t size = readU32(data.data() + 4);
+    if (size > MAX_STATE_SIZE)
+    {
+        throw StateException("Corrupt save state " + path);
+    }
+    vector<uint8_t> state(size, 0);
+    if (!applyXorDelta(data.data() + HEADER_SIZE, data.size() - HEADER_SIZE, state.data(), state.size()) ||
+        crc32c(state.data(), state.size()) != readU32(data.data() + 8))
+    {
+        throw StateException("Corrupt save state " + path);
+    }
+    emu.loadState(state.data(), state.size());
+}
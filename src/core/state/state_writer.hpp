@@ -0,0 +1,70 @@
+#ifndef LIBDMG_STATE_WRITER_HPP
+#define LIBDMG_STATE_WRITER_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace LibDMG
+{
+    class Emulator;
+
+    // Writes save states to disk on a background thread. save() only
+    // serializes the state into a pooled buffer and queues it, the writer
+    // thread compresses and writes it. One writer can be shared by any
+    // number of emulators and threads.
+    //
+    // Files hold the compressed state: 'DMGZ', the state size, the CRC-32C
+    // of the state, then the state run-length coded against zeros (see
+    // delta_codec.hpp).
+    class StateWriter
+    {
+    public:
+        StateWriter();
+        // Writes the queued states before returning
+        ~StateWriter();
+
+        // The future is ready once the file is written, and holds a
+        // StateException if it could not be
+        std::future<void> save(Emulator& emu, const std::string& path);
+
+        // Waits until every queued state is written
+        void flush();
+
+        // Loads a file written by save(), or an uncompressed save state.
+        // Throws a StateException on a truncated or corrupt file, without
+        // changing the emulator.
+        static void load(Emulator& emu, const std::string& path);
+
+    private:
+        struct Job
+        {
+            std::vector<uint8_t> state;
+            std::string          path;
+            std::promise<void>   done;
+        };
+
+        std::thread             m_thread;
+        std::mutex              m_mutex;
+        std::condition_variable m_wake;
+        std::condition_variable m_idle;
+        std::deque<Job>         m_jobs;
+        std::vector<std::vector<uint8_t> > m_pool;
+        bool                    m_running;
+        bool                    m_busy;
+
+        // Writer thread only
+        std::vector<uint8_t>    m_zeros;
+        std::vector<uint8_t>    m_encoded;
+
+        void writerLoop();
+        void writeFile(const std::string& path, const std::vector<uint8_t>& state);
+    };
+}
+
+#endif // LIBDMG_STATE_WRITER_HPP
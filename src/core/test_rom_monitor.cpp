@@ -0,0 +1,93 @@
+#include "test_rom_monitor.hpp"
+
+#include "emulator.hpp"
+
+using namespace LibDMG;
+using namespace std;
+
+TestRomMonitor::TestRomMonitor(Emulator& emu, function<void(uint8_t)> serialCallback) :
+    m_emu(emu),
+    m_serialCallback(serialCallback),
+    m_passed("Passed"),
+    m_failed("Failed"),
+    m_registerTrap(true),
+    m_result(RESULT_NONE)
+{
+    m_emu.periph()->serial()->setOutputCallback([this](uint8_t val) { onSerial(val); });
+    m_emu.setDebugTrap([this]() { onTrap(); });
+}
+
+TestRomMonitor::~TestRomMonitor()
+{
+    m_emu.periph()->serial()->setOutputCallback(nullptr);
+    m_emu.setDebugTrap(nullptr);
+}
+
+void TestRomMonitor::setPatterns(const string& passed, const string& failed)
+{
+    m_passed = passed;
+    m_failed = failed;
+}
+
+void TestRomMonitor::onSerial(uint8_t val)
+{
+    m_output.push_back(static_cast<char>(val));
+    if (m_serialCallback)
+    {
+        m_serialCallback(val);
+    }
+
+    // Only the tail can contain a new match
+    if (!m_passed.empty() && endsWith(m_passed))
+    {
+        finish(RESULT_PASSED);
+    }
+    else if (!m_failed.empty() && endsWith(m_failed))
+    {
+        finish(RESULT_FAILED);
+    }
+}
+
+void TestRomMonitor::onTrap()
+{
+    if (!m_registerTrap)
+    {
+        return;
+    }
+
+    static const Cpu::Reg8 regs[] = { Cpu::REG8_B, Cpu::REG8_C, Cpu::REG8_D, Cpu::REG8_E, Cpu::REG8_H, Cpu::REG8_L };
+    static const uint8_t fibonacci[] = { 3, 5, 8, 13, 21, 34 };
+
+    bool passed = true;
+    bool failed = true;
+    for (int i = 0; i < 6; i++)
+    {
+        uint8_t val = m_emu.cpu()->reg8(regs[i]);
+        passed = passed && val == fibonacci[i];
+        failed = failed && val == 0x42;
+    }
+
+    if (passed)
+    {
+        finish(RESULT_PASSED);
+    }
+    else if (failed)
+    {
+        finish(RESULT_FAILED);
+    }
+}
+
+void TestRomMonitor::finish(Result result)
+{
+    if (m_result == RESULT_NONE)
+    {
+        m_result = result;
+    }
+    m_emu.requestStop();
+}
+
+bool TestRomMonitor::endsWith(const string& pattern) const
+{
+    return m_output.size() >= pattern.size() &&
+           m_output.compare(m_output.size() - pattern.size(), pattern.size(), pattern) == 0;
+}
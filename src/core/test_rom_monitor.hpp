@@ -0,0 +1,55 @@
+#ifndef LIBDMG_TEST_ROM_MONITOR_HPP
+#define LIBDMG_TEST_ROM_MONITOR_HPP
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace LibDMG
+{
+    class Emulator;
+
+    // Watches a test ROM for its verdict and stops the emulator as soon as
+    // it is known. Bytes sent over serial are captured and matched against
+    // the passed and failed strings (Blargg's ROMs print "Passed" or
+    // "Failed"). LD B,B can also be watched: with B, C, D, E, H, L set to
+    // 3, 5, 8, 13, 21, 34 the test passed, with all of them set to 0x42 it
+    // failed (Mooneye's convention).
+    class TestRomMonitor
+    {
+    public:
+        enum Result
+        {
+            RESULT_NONE,
+            RESULT_PASSED,
+            RESULT_FAILED
+        };
+
+        // Hooks the serial output and the debug trap of the emulator. Serial
+        // bytes are also forwarded to the callback, if any.
+        TestRomMonitor(Emulator& emu, std::function<void(uint8_t)> serialCallback = nullptr);
+        ~TestRomMonitor();
+
+        void setPatterns(const std::string& passed, const std::string& failed);
+        void setRegisterTrap(bool enabled) { m_registerTrap = enabled; }
+
+        Result result() const { return m_result; }
+        const std::string& output() const { return m_output; }
+
+    private:
+        Emulator&                    m_emu;
+        std::function<void(uint8_t)> m_serialCallback;
+        std::string                  m_output;
+        std::string                  m_passed;
+        std::string                  m_failed;
+        bool                         m_registerTrap;
+        Result                       m_result;
+
+        void onSerial(uint8_t val);
+        void onTrap();
+        void finish(Result result);
+        bool endsWith(const std::string& pattern) const;
+    };
+}
+
+#endif // LIBDMG_TEST_ROM_MONITOR_HPP
@@ -0,0 +1,95 @@
+#include "crc32c.hpp"
+
+#include <cstring>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+namespace LibDMG
+{
+
+namespace
+{
+    struct Crc32cTable
+    {
+        uint32_t entries[256];
+
+        Crc32cTable()
+        {
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                uint32_t crc = i;
+                for (int bit = 0; bit < 8; bit++)
+                {
+                    crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78 : (crc >> 1);
+                }
+                entries[i] = crc;
+            }
+        }
+    };
+
+    const Crc32cTable TABLE;
+}
+
+uint32_t detail::crc32cTable(uint32_t crc, const void *data, size_t size)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    crc = ~crc;
+
+    while (size > 0)
+    {
+        crc = TABLE.entries[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        size--;
+    }
+
+    return ~crc;
+}
+
+#if defined(__SSE4_2__)
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t size)
+{
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    crc = ~crc;
+
+#if defined(__x86_64__) || defined(_M_X64)
+    uint64_t crc64 = crc;
+    while (size >= 8)
+    {
+        uint64_t val;
+        memcpy(&val, p, 8);
+        crc64 = _mm_crc32_u64(crc64, val);
+        p += 8;
+        size -= 8;
+    }
+    crc = static_cast<uint32_t>(crc64);
+#endif
+
+    while (size >= 4)
+    {
+        uint32_t val;
+        memcpy(&val, p, 4);
+        crc = _mm_crc32_u32(crc, val);
+        p += 4;
+        size -= 4;
+    }
+    while (size > 0)
+    {
+        crc = _mm_crc32_u8(crc, *p++);
+        size--;
+    }
+
+    return ~crc;
+}
+
+#else
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t size)
+{
+    return detail::crc32cTable(crc, data, size);
+}
+
+#endif
+
+} // namespace LibDMG
@@ -0,0 +1,24 @@
+#ifndef LIBDMG_CRC32C_HPP
+#define LIBDMG_CRC32C_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+namespace LibDMG
+{
+    // CRC-32C (Castagnoli). Uses the SSE4.2 crc32 instruction when the core is
+    // built with it, a table-driven implementation otherwise. Both give the
+    // same results, so hashes can be compared across machines.
+    uint32_t crc32c(uint32_t crc, const void *data, size_t size);
+
+    inline uint32_t crc32c(const void *data, size_t size) { return crc32c(0, data, size); }
+
+    namespace detail
+    {
+        // The table-driven implementation, built in every configuration so
+        // that tests can check the SSE4.2 path against it
+        uint32_t crc32cTable(uint32_t crc, const void *data, size_t size);
+    }
+}
+
+#endif // LIBDMG_CRC32C_HPP
@@ -0,0 +1,89 @@
+#ifndef LIBDMG_MPSC_QUEUE_HPP
+#define LIBDMG_MPSC_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace LibDMG
+{
+    // Bounded lock-free queue for any number of producer threads and one
+    // consumer thread. Capacity must be a power of two. Each cell carries a
+    // sequence number telling whether it is free for the producer claiming
+    // that position or filled for the consumer, so producers only contend
+    // on the tail index. Neither push() nor pop() ever block.
+    template <typename T, size_t Capacity>
+    class MpscQueue
+    {
+        static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    public:
+        MpscQueue() : m_tail(0), m_head(0)
+        {
+            for (size_t i = 0; i < Capacity; i++)
+            {
+                m_cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        bool push(const T& val)
+        {
+            size_t pos = m_tail.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                Cell& cell = m_cells[pos & (Capacity - 1)];
+                size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+                if (diff == 0)
+                {
+                    // The cell is free, try to claim the position
+                    if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        cell.value = val;
+                        cell.sequence.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    // Not consumed yet, the queue is full
+                    return false;
+                }
+                else
+                {
+                    // Another producer claimed it
+                    pos = m_tail.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        bool pop(T& val)
+        {
+            Cell& cell = m_cells[m_head & (Capacity - 1)];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if (sequence != m_head + 1)
+            {
+                return false;
+            }
+
+            val = cell.value;
+            cell.sequence.store(m_head + Capacity, std::memory_order_release);
+            m_head++;
+            return true;
+        }
+
+    private:
+        struct Cell
+        {
+            std::atomic<size_t> sequence;
+            T                   value;
+        };
+
+        alignas(64) Cell m_cells[Capacity];
+        alignas(64) std::atomic<size_t> m_tail;
+        alignas(64) size_t m_head;
+    };
+}
+
+#endif // LIBDMG_MPSC_QUEUE_HPP
@@ -0,0 +1,64 @@
+#ifndef LIBDMG_SPSC_QUEUE_HPP
+#define LIBDMG_SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+
+namespace LibDMG
+{
+    // Bounded lock-free queue for exactly one producer thread and one
+    // consumer thread. Capacity must be a power of two. Neither push() nor
+    // pop() ever block: they fail when the queue is full or empty.
+    template <typename T, size_t Capacity>
+    class SpscQueue
+    {
+        static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    public:
+        SpscQueue() : m_head(0), m_tail(0) {}
+
+        bool push(const T& val)
+        {
+            size_t tail = m_tail.load(std::memory_order_relaxed);
+            if (tail - m_head.load(std::memory_order_acquire) == Capacity)
+            {
+                return false;
+            }
+
+            m_items[tail & (Capacity - 1)] = val;
+            m_tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool pop(T& val)
+        {
+            size_t head = m_head.load(std::memory_order_relaxed);
+            if (head == m_tail.load(std::memory_order_acquire))
+            {
+                return false;
+            }
+
+            val = m_items[head & (Capacity - 1)];
+            m_head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool empty() const
+        {
+            return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+        }
+
+        size_t size() const
+        {
+            return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+        }
+
+    private:
+        // Keep producer and consumer indices on separate cache lines
+        alignas(64) std::atomic<size_t> m_head;
+        alignas(64) std::atomic<size_t> m_tail;
+        alignas(64) T m_items[Capacity];
+    };
+}
+
+#endif // LIBDMG_SPSC_QUEUE_HPP
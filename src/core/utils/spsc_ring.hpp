@@ -0,0 +1,67 @@
+#ifndef LIBDMG_SPSC_RING_HPP
+#define LIBDMG_SPSC_RING_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+
+namespace LibDMG
+{
+    // Bounded lock-free ring buffer of plain values for exactly one producer
+    // thread and one consumer thread, copying blocks of elements at a time.
+    // Capacity must be a power of two. write() and read() never block, they
+    // transfer as many elements as fit or are available.
+    template <typename T, size_t Capacity>
+    class SpscRing
+    {
+        static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    public:
+        SpscRing() : m_head(0), m_tail(0) {}
+
+        size_t write(const T *data, size_t count)
+        {
+            size_t tail = m_tail.load(std::memory_order_relaxed);
+            size_t space = Capacity - (tail - m_head.load(std::memory_order_acquire));
+            count = std::min(count, space);
+
+            size_t start = tail & (Capacity - 1);
+            size_t first = std::min(count, Capacity - start);
+            std::copy(data, data + first, m_items + start);
+            std::copy(data + first, data + count, m_items);
+
+            m_tail.store(tail + count, std::memory_order_release);
+            return count;
+        }
+
+        size_t read(T *data, size_t count)
+        {
+            size_t head = m_head.load(std::memory_order_relaxed);
+            size_t available = m_tail.load(std::memory_order_acquire) - head;
+            count = std::min(count, available);
+
+            size_t start = head & (Capacity - 1);
+            size_t first = std::min(count, Capacity - start);
+            std::copy(m_items + start, m_items + start + first, data);
+            std::copy(m_items, m_items + (count - first), data + first);
+
+            m_head.store(head + count, std::memory_order_release);
+            return count;
+        }
+
+        size_t size() const
+        {
+            return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+        }
+
+        size_t space() const { return Capacity - size(); }
+
+    private:
+        // Keep producer and consumer indices on separate cache lines
+        alignas(64) std::atomic<size_t> m_head;
+        alignas(64) std::atomic<size_t> m_tail;
+        alignas(64) T m_items[Capacity];
+    };
+}
+
+#endif // LIBDMG_SPSC_RING_HPP
@@ -0,0 +1,230 @@
+#include "frame_dumper.hpp"
+
+#include "png_writer.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+using namespace LibDMG;
+
+namespace
+{
+    const uint32_t DEFAULT_PALETTE[4] = { 0xFFFFFFFF, 0xAAAAAAFF, 0x555555FF, 0x000000FF };
+
+    // The DMG runs at 4194304 Hz with 70224 cycles per frame. Keeping one
+    // frame in N lengthens each one N times.
+    const uint64_t CPU_CLOCK = 4194304;
+    const uint64_t FRAME_CYCLES = 70224;
+}
+
+FrameDumper::FrameDumper() :
+    m_hasVideo(false),
+    m_format(FORMAT_Y4M),
+    m_everyNth(1),
+    m_frameIndex(0),
+    m_snapshotPending(false),
+    m_running(false),
+    m_writtenFrames(0),
+    m_droppedFrames(0)
+{
+    setPalette(DEFAULT_PALETTE);
+}
+
+FrameDumper::~FrameDumper()
+{
+    close();
+}
+
+void FrameDumper::open(const string& path, Format format, int everyNth)
+{
+    close();
+    everyNth = (everyNth > 0) ? everyNth : 1;
+
+    if (!path.empty())
+    {
+        m_file.open(path.c_str(), ios_base::out | ios_base::binary | ios_base::trunc);
+        if (!m_file.good())
+        {
+            throw FrameDumperException("Invalid file");
+        }
+        if (format == FORMAT_Y4M)
+        {
+            m_file << "YUV4MPEG2 W160 H144 F" << CPU_CLOCK << ":" << FRAME_CYCLES * everyNth
+                   << " Ip A1:1 Cmono\n";
+        }
+    }
+
+    m_hasVideo = !path.empty();
+    m_format = format;
+    m_everyNth = everyNth;
+    m_frameIndex = 0;
+    m_writtenFrames = 0;
+    m_droppedFrames = 0;
+
+    // Every pooled buffer starts on the free list
+    FrameBuffer *frame;
+    while (m_freeQueue.pop(frame)) {}
+    while (m_readyQueue.pop(frame)) {}
+    for (size_t i = 0; i < POOL_SIZE; i++)
+    {
+        m_freeQueue.push(&m_pool[i]);
+    }
+
+    m_running = true;
+    m_thread = thread(&FrameDumper::writerLoop, this);
+}
+
+void FrameDumper::close()
+{
+    if (!m_running)
+    {
+        return;
+    }
+
+    m_running = false;
+    m_wake.notify_one();
+    m_thread.join();
+
+    if (m_file.is_open())
+    {
+        m_file.close();
+    }
+}
+
+void FrameDumper::requestSnapshot(const string& path)
+{
+    lock_guard<mutex> lock(m_snapshotMutex);
+    m_snapshotPath = path;
+    m_snapshotPending = true;
+}
+
+void FrameDumper::setPalette(const uint32_t colors[4])
+{
+    for (int i = 0; i < 4; i++)
+    {
+        m_rgb[i][0] = (colors[i] >> 24) & 0xFF;
+        m_rgb[i][1] = (colors[i] >> 16) & 0xFF;
+        m_rgb[i][2] = (colors[i] >> 8) & 0xFF;
+    }
+}
+
+void FrameDumper::pushFrame(const uint8_t *shades)
+{
+    if (!m_running)
+    {
+        return;
+    }
+
+    bool isVideoFrame = m_hasVideo && (m_frameIndex % m_everyNth) == 0;
+    bool isSnapshot = m_snapshotPending;
+    m_frameIndex++;
+
+    if (!isVideoFrame && !isSnapshot)
+    {
+        return;
+    }
+
+    FrameBuffer *frame;
+    if (!m_freeQueue.pop(frame))
+    {
+        // Writer is behind, never wait for it
+        m_droppedFrames++;
+        return;
+    }
+
+    memcpy(frame->shades, shades, sizeof(frame->shades));
+    frame->isVideoFrame = isVideoFrame;
+    frame->snapshotPath.clear();
+    if (isSnapshot)
+    {
+        // Uncontended in practice: only taken here and by requestSnapshot()
+        lock_guard<mutex> lock(m_snapshotMutex);
+        frame->snapshotPath.swap(m_snapshotPath);
+        m_snapshotPending = false;
+    }
+
+    m_readyQueue.push(frame);
+    m_wake.notify_one();
+}
+
+void FrameDumper::writerLoop()
+{
+    for (;;)
+    {
+        FrameBuffer *frame;
+        if (m_readyQueue.pop(frame))
+        {
+            if (frame->isVideoFrame)
+            {
+                writeFrame(*frame);
+            }
+            if (!frame->snapshotPath.empty())
+            {
+                writeSnapshot(*frame);
+            }
+            m_freeQueue.push(frame);
+            continue;
+        }
+
+        if (!m_running)
+        {
+            break;
+        }
+
+        // The producer never takes this lock, the timeout covers missed wakeups
+        unique_lock<mutex> lock(m_wakeMutex);
+        m_wake.wait_for(lock, chrono::milliseconds(5));
+    }
+
+    m_file.flush();
+}
+
+void FrameDumper::writeFrame(const FrameBuffer& frame)
+{
+    if (m_format == FORMAT_Y4M)
+    {
+        uint8_t luma[4];
+        for (int i = 0; i < 4; i++)
+        {
+            luma[i] = static_cast<uint8_t>((m_rgb[i][0] * 77 + m_rgb[i][1] * 150 + m_rgb[i][2] * 29) >> 8);
+        }
+
+        uint8_t plane[WIDTH * HEIGHT];
+        for (int i = 0; i < WIDTH * HEIGHT; i++)
+        {
+            plane[i] = luma[frame.shades[i] & 0x03];
+        }
+
+        m_file << "FRAME\n";
+        m_file.write(reinterpret_cast<const char *>(plane), sizeof(plane));
+    }
+    else
+    {
+        uint8_t rgb[WIDTH * HEIGHT * 3];
+        for (int i = 0; i < WIDTH * HEIGHT; i++)
+        {
+            memcpy(&rgb[i * 3], m_rgb[frame.shades[i] & 0x03], 3);
+        }
+
+        m_file.write(reinterpret_cast<const char *>(rgb), sizeof(rgb));
+    }
+
+    m_writtenFrames++;
+}
+
+void FrameDumper::writeSnapshot(const FrameBuffer& frame)
+{
+    vector<uint8_t> rgb(WIDTH * HEIGHT * 3);
+    for (int i = 0; i < WIDTH * HEIGHT; i++)
+    {
+        memcpy(&rgb[i * 3], m_rgb[frame.shades[i] & 0x03], 3);
+    }
+
+    ofstream out(frame.snapshotPath.c_str(), ios_base::out | ios_base::binary | ios_base::trunc);
+    if (out.good())
+    {
+        writePngRgb(out, rgb.data(), WIDTH, HEIGHT);
+    }
+}
@@ -0,0 +1,109 @@
+#ifndef LIBDMG_FRAME_DUMPER_HPP
+#define LIBDMG_FRAME_DUMPER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "utils/spsc_queue.hpp"
+
+namespace LibDMG
+{
+    // Headless video output. The emulation thread hands completed frames
+    // over at VBlank by filling a pooled buffer and queueing it; encoding and
+    // file I/O happen on a background thread. When the writer falls behind,
+    // frames are dropped rather than stalling emulation.
+    class FrameDumper
+    {
+    public:
+        enum Format
+        {
+            FORMAT_Y4M,     // YUV4MPEG2, luma only
+            FORMAT_RGB24    // Raw RGB, 3 bytes per pixel, no header
+        };
+
+        static const int WIDTH = 160;
+        static const int HEIGHT = 144;
+
+        FrameDumper();
+        ~FrameDumper();
+
+        // Starts the writer thread. Only every nth frame is written to the
+        // video file, an empty path disables video and keeps snapshots only.
+        void open(const std::string& path, Format format, int everyNth = 1);
+        // Waits for queued frames to be written, then stops the writer thread
+        void close();
+        bool isOpen() const { return m_running; }
+
+        // The next completed frame is also saved as a PNG
+        void requestSnapshot(const std::string& path);
+
+        // Colors are 0xRRGGBBAA, from shade 0 (lightest) to shade 3 (darkest).
+        // Must not be called while the dumper is open.
+        void setPalette(const uint32_t colors[4]);
+
+        // Called from the emulation thread with a frame of shades 0-3
+        void pushFrame(const uint8_t *shades);
+
+        uint32_t writtenFrames() const { return m_writtenFrames; }
+        uint32_t droppedFrames() const { return m_droppedFrames; }
+
+    private:
+        static const size_t POOL_SIZE = 8;
+
+        struct FrameBuffer
+        {
+            uint8_t     shades[WIDTH * HEIGHT];
+            bool        isVideoFrame;
+            std::string snapshotPath;
+        };
+
+        FrameBuffer m_pool[POOL_SIZE];
+        SpscQueue<FrameBuffer *, POOL_SIZE> m_freeQueue;   // Writer -> emulation
+        SpscQueue<FrameBuffer *, POOL_SIZE> m_readyQueue;  // Emulation -> writer
+
+        std::ofstream m_file;
+        bool          m_hasVideo;
+        Format        m_format;
+        int           m_everyNth;
+        uint32_t      m_frameIndex;
+        uint8_t       m_rgb[4][3];
+
+        std::mutex        m_snapshotMutex;
+        std::string       m_snapshotPath;
+        std::atomic<bool> m_snapshotPending;
+
+        std::thread             m_thread;
+        std::atomic<bool>       m_running;
+        std::mutex              m_wakeMutex;
+        std::condition_variable m_wake;
+
+        std::atomic<uint32_t> m_writtenFrames;
+        std::atomic<uint32_t> m_droppedFrames;
+
+        void writerLoop();
+        void writeFrame(const FrameBuffer& frame);
+        void writeSnapshot(const FrameBuffer& frame);
+    };
+
+    class FrameDumperException : public std::exception
+    {
+    public:
+        FrameDumperException(const std::string& msg)
+            : std::exception(),
+              m_msg("FrameDumperException - " + msg)
+        { }
+
+        const char* what() const throw() { return m_msg.c_str(); }
+
+    private:
+        std::string m_msg;
+    };
+}
+
+#endif // LIBDMG_FRAME_DUMPER_HPP
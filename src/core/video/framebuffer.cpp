@@ -0,0 +1,128 @@
+#include "framebuffer.hpp"
+
+#include <cstring>
+
+using namespace LibDMG;
+
+namespace
+{
+    const uint32_t DEFAULT_PALETTE[4] = { 0xFFFFFFFF, 0xAAAAAAFF, 0x555555FF, 0x000000FF };
+}
+
+Framebuffer::Framebuffer() :
+    m_buffer(nullptr),
+    m_format(FORMAT_RGBA8888),
+    m_pitch(0),
+    m_lineWriter(writeLineRgba8888)
+{
+    m_staleLines.set();
+    setPalette(DEFAULT_PALETTE);
+}
+
+void Framebuffer::attach(void *buffer, Format format, size_t pitch)
+{
+    m_buffer = static_cast<uint8_t *>(buffer);
+    m_format = format;
+    m_pitch = (pitch != 0) ? pitch : WIDTH * bytesPerPixel(format);
+
+    // Nothing in the new buffer can be trusted
+    m_staleLines.set();
+
+    switch (format)
+    {
+    case FORMAT_RGBA8888: m_lineWriter = writeLineRgba8888; break;
+    case FORMAT_RGB565:   m_lineWriter = writeLineRgb565; break;
+    case FORMAT_GRAY8:    m_lineWriter = writeLineGray8; break;
+    case FORMAT_INDEX2:   m_lineWriter = writeLineIndex2; break;
+    }
+}
+
+void Framebuffer::detach()
+{
+    m_buffer = nullptr;
+}
+
+void Framebuffer::setPalette(const uint32_t colors[4])
+{
+    for (int i = 0; i < 4; i++)
+    {
+        uint8_t r = (colors[i] >> 24) & 0xFF;
+        uint8_t g = (colors[i] >> 16) & 0xFF;
+        uint8_t b = (colors[i] >> 8) & 0xFF;
+        uint8_t a = colors[i] & 0xFF;
+
+        // Store the bytes in memory order so the LUT is endianness-agnostic
+        uint8_t rgba[4] = { r, g, b, a };
+        memcpy(&m_lutRgba8888[i], rgba, sizeof(rgba));
+
+        m_lutRgb565[i] = static_cast<uint16_t>(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+        m_lutGray8[i] = static_cast<uint8_t>((r * 77 + g * 150 + b * 29) >> 8);
+    }
+
+    // Lines already in the buffer have the old colors
+    m_staleLines.set();
+}
+
+void Framebuffer::writeLine(int line, const uint8_t *shades)
+{
+    m_dirtyLines.set(line);
+
+    if (m_buffer == nullptr)
+    {
+        return;
+    }
+
+    m_lineWriter(m_buffer + line * m_pitch, shades, *this);
+    m_staleLines.reset(line);
+}
+
+void Framebuffer::endFrame()
+{
+    m_frameDirtyLines = m_dirtyLines;
+    m_dirtyLines.reset();
+}
+
+size_t Framebuffer::bytesPerPixel(Format format)
+{
+    switch (format)
+    {
+    case FORMAT_RGBA8888: return 4;
+    case FORMAT_RGB565:   return 2;
+    default:              return 1;
+    }
+}
+
+void Framebuffer::writeLineRgba8888(void *dst, const uint8_t *shades, const Framebuffer& fb)
+{
+    uint8_t *out = static_cast<uint8_t *>(dst);
+    const uint32_t *lut = fb.m_lutRgba8888;
+    for (int x = 0; x < WIDTH; x++)
+    {
+        memcpy(out + 4 * x, &lut[shades[x] & 0x03], 4);
+    }
+}
+
+void Framebuffer::writeLineRgb565(void *dst, const uint8_t *shades, const Framebuffer& fb)
+{
+    uint8_t *out = static_cast<uint8_t *>(dst);
+    const uint16_t *lut = fb.m_lutRgb565;
+    for (int x = 0; x < WIDTH; x++)
+    {
+        memcpy(out + 2 * x, &lut[shades[x] & 0x03], 2);
+    }
+}
+
+void Framebuffer::writeLineGray8(void *dst, const uint8_t *shades, const Framebuffer& fb)
+{
+    uint8_t *out = static_cast<uint8_t *>(dst);
+    const uint8_t *lut = fb.m_lutGray8;
+    for (int x = 0; x < WIDTH; x++)
+    {
+        out[x] = lut[shades[x] & 0x03];
+    }
+}
+
+void Framebuffer::writeLineIndex2(void *dst, const uint8_t *shades, const Framebuffer&)
+{
+    memcpy(dst, shades, WIDTH);
+}
@@ -0,0 +1,78 @@
+#ifndef LIBDMG_FRAMEBUFFER_HPP
+#define LIBDMG_FRAMEBUFFER_HPP
+
+#include <bitset>
+#include <cstdint>
+#include <cstddef>
+
+namespace LibDMG
+{
+    // Output surface for the LCD controller. The pixel memory is owned by the
+    // caller (shared memory, GPU staging buffer, ...) and lines are converted
+    // straight into it as they are rendered: the emulator never allocates or
+    // copies frame memory.
+    class Framebuffer
+    {
+    public:
+        enum Format
+        {
+            FORMAT_RGBA8888,    // 4 bytes per pixel, R G B A in memory order
+            FORMAT_RGB565,      // 2 bytes per pixel, native endianness
+            FORMAT_GRAY8,       // 1 byte per pixel, 0xFF is white
+            FORMAT_INDEX2       // 1 byte per pixel, palette index 0-3
+        };
+
+        static const int WIDTH = 160;
+        static const int HEIGHT = 144;
+
+        Framebuffer();
+
+        // Pitch is the size of a row in bytes, 0 means tightly packed
+        void attach(void *buffer, Format format, size_t pitch = 0);
+        void detach();
+
+        // Colors are 0xRRGGBBAA, from shade 0 (lightest) to shade 3 (darkest).
+        // Makes every line stale, to be redrawn with the new colors.
+        void setPalette(const uint32_t colors[4]);
+
+        bool isAttached() const { return m_buffer != nullptr; }
+        void * buffer() const { return m_buffer; }
+        Format format() const { return m_format; }
+        size_t pitch() const { return m_pitch; }
+
+        void writeLine(int line, const uint8_t *shades);
+        void endFrame();
+
+        // Lines written during the last completed frame. Lines that are not
+        // set still hold the same pixels as in the previous frame.
+        const std::bitset<HEIGHT>& dirtyLines() const { return m_frameDirtyLines; }
+        bool isLineDirty(int line) const { return m_frameDirtyLines[line]; }
+        // Lines that have not been written since the buffer was attached
+        bool isLineStale(int line) const { return m_buffer != nullptr && m_staleLines[line]; }
+
+        static size_t bytesPerPixel(Format format);
+
+    private:
+        typedef void (*LineWriter)(void *dst, const uint8_t *shades, const Framebuffer& fb);
+
+        uint8_t *  m_buffer;
+        Format     m_format;
+        size_t     m_pitch;
+        LineWriter m_lineWriter;
+
+        std::bitset<HEIGHT> m_dirtyLines;
+        std::bitset<HEIGHT> m_frameDirtyLines;
+        std::bitset<HEIGHT> m_staleLines;
+
+        uint32_t m_lutRgba8888[4];
+        uint16_t m_lutRgb565[4];
+        uint8_t  m_lutGray8[4];
+
+        static void writeLineRgba8888(void *dst, const uint8_t *shades, const Framebuffer& fb);
+        static void writeLineRgb565(void *dst, const uint8_t *shades, const Framebuffer& fb);
+        static void writeLineGray8(void *dst, const uint8_t *shades, const Framebuffer& fb);
+        static void writeLineIndex2(void *dst, const uint8_t *shades, const Framebuffer& fb);
+    };
+}
+
+#endif // LIBDMG_FRAMEBUFFER_HPP
@@ -0,0 +1,121 @@
+#include "png_writer.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    struct Crc32Table
+    {
+        uint32_t entries[256];
+
+        Crc32Table()
+        {
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                uint32_t c = i;
+                for (int bit = 0; bit < 8; bit++)
+                {
+                    c = (c & 1) ? (c >> 1) ^ 0xEDB88320 : (c >> 1);
+                }
+                entries[i] = c;
+            }
+        }
+    };
+
+    // CRC-32 (ISO-HDLC), as required by the PNG chunk format
+    uint32_t crc32(uint32_t crc, const uint8_t *data, size_t size)
+    {
+        static const Crc32Table table;
+
+        crc = ~crc;
+        for (size_t i = 0; i < size; i++)
+        {
+            crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    void putBe32(vector<uint8_t>& buf, uint32_t val)
+    {
+        buf.push_back(static_cast<uint8_t>(val >> 24));
+        buf.push_back(static_cast<uint8_t>(val >> 16));
+        buf.push_back(static_cast<uint8_t>(val >> 8));
+        buf.push_back(static_cast<uint8_t>(val));
+    }
+
+    void writeChunk(ostream& out, const char *type, const vector<uint8_t>& data)
+    {
+        vector<uint8_t> chunk;
+        putBe32(chunk, static_cast<uint32_t>(data.size()));
+        chunk.insert(chunk.end(), type, type + 4);
+        chunk.insert(chunk.end(), data.begin(), data.end());
+        putBe32(chunk, crc32(0, chunk.data() + 4, chunk.size() - 4));
+        out.write(reinterpret_cast<const char *>(chunk.data()), chunk.size());
+    }
+}
+
+namespace LibDMG
+{
+void writePngRgb(ostream& out, const uint8_t *rgb, int width, int height)
+{
+    static const uint8_t SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    out.write(reinterpret_cast<const char *>(SIGNATURE), sizeof(SIGNATURE));
+
+    vector<uint8_t> header;
+    putBe32(header, width);
+    putBe32(header, height);
+    header.push_back(8);    // Bit depth
+    header.push_back(2);    // Color type: RGB
+    header.push_back(0);    // Compression
+    header.push_back(0);    // Filter
+    header.push_back(0);    // Interlace
+    writeChunk(out, "IHDR", header);
+
+    // Raw scanlines, each prefixed with filter type 0
+    size_t rowSize = static_cast<size_t>(width) * 3;
+    vector<uint8_t> raw;
+    raw.reserve((rowSize + 1) * height);
+    for (int y = 0; y < height; y++)
+    {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgb + y * rowSize, rgb + (y + 1) * rowSize);
+    }
+
+    // zlib stream made of stored deflate blocks
+    vector<uint8_t> zlib;
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+    size_t pos = 0;
+    do
+    {
+        size_t len = raw.size() - pos;
+        if (len > 0xFFFF)
+        {
+            len = 0xFFFF;
+        }
+        bool last = (pos + len == raw.size());
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back(static_cast<uint8_t>(len));
+        zlib.push_back(static_cast<uint8_t>(len >> 8));
+        zlib.push_back(static_cast<uint8_t>(~len));
+        zlib.push_back(static_cast<uint8_t>(~len >> 8));
+        zlib.insert(zlib.end(), raw.begin() + pos, raw.begin() + pos + len);
+        pos += len;
+    } while (pos < raw.size());
+
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for (uint8_t byte : raw)
+    {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    putBe32(zlib, (b << 16) | a);
+    writeChunk(out, "IDAT", zlib);
+
+    writeChunk(out, "IEND", vector<uint8_t>());
+}
+} // namespace LibDMG
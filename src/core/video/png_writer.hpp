@@ -0,0 +1,15 @@
+#ifndef LIBDMG_PNG_WRITER_HPP
+#define LIBDMG_PNG_WRITER_HPP
+
+#include <cstdint>
+#include <ostream>
+
+namespace LibDMG
+{
+    // Minimal PNG encoder for 8-bit RGB images. Image data is stored with
+    // uncompressed deflate blocks, which keeps it dependency-free; snapshots
+    // are small enough that compression does not matter.
+    void writePngRgb(std::ostream& out, const uint8_t *rgb, int width, int height);
+}
+
+#endif // LIBDMG_PNG_WRITER_HPP
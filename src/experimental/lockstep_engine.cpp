@@ -0,0 +1,641 @@
+#include "lockstep_engine.hpp"
+
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LIBDMG_LOCKSTEP_SSE2
+#endif
+
+#include "emulator.hpp"
+#include "cpu/cpu_macros.hpp"
+
+using namespace LibDMG;
+using namespace std;
+
+namespace
+{
+    // Bits 3-5 of the 0x80-0xBF opcodes
+    enum AluOperation
+    {
+        ALU_ADD = 0,
+        ALU_ADC = 1,
+        ALU_SUB = 2,
+        ALU_SBC = 3,
+        ALU_AND = 4,
+        ALU_XOR = 5,
+        ALU_OR  = 6,
+        ALU_CP  = 7
+    };
+
+    // Register field of the opcodes, the other values match Cpu::Reg8
+    const int OPERAND_MEM_HL = 6;
+
+    const uint8_t FLAG_Z = 0x80;
+    const uint8_t FLAG_N = 0x40;
+    const uint8_t FLAG_H = 0x20;
+    const uint8_t FLAG_C = 0x10;
+
+    // Masks are 0xFF for the lanes running the opcode, 0 for the others
+#if defined(LIBDMG_LOCKSTEP_SSE2)
+    inline __m128i load(const uint8_t *p)
+    {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    }
+
+    inline void store(uint8_t *p, __m128i val)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(p), val);
+    }
+
+    inline __m128i blend(__m128i val, __m128i old, __m128i mask)
+    {
+        return _mm_or_si128(_mm_and_si128(mask, val), _mm_andnot_si128(mask, old));
+    }
+
+    inline __m128i flagIf(__m128i cond, uint8_t flag)
+    {
+        return _mm_and_si128(cond, _mm_set1_epi8(static_cast<char>(flag)));
+    }
+
+    // IS_CARRY3(a, b, c), on bytes widened to 16 bits
+    inline __m128i isCarry(__m128i a, __m128i b, __m128i c)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i limit = _mm_set1_epi16(256);
+        __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)),
+                                   _mm_unpacklo_epi8(c, zero));
+        __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)),
+                                   _mm_unpackhi_epi8(c, zero));
+        return _mm_packs_epi16(_mm_cmpgt_epi16(lo, limit), _mm_cmpgt_epi16(hi, limit));
+    }
+
+    // IS_BORROW3(a, b, c)
+    inline __m128i isBorrow(__m128i a, __m128i b, __m128i c)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero));
+        __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero));
+        return _mm_packs_epi16(_mm_cmpgt_epi16(lo, _mm_unpacklo_epi8(a, zero)),
+                               _mm_cmpgt_epi16(hi, _mm_unpackhi_epi8(a, zero)));
+    }
+#else
+    inline uint8_t blend(uint8_t val, uint8_t old, uint8_t mask)
+    {
+        return static_cast<uint8_t>((val & mask) | (old & ~mask));
+    }
+#endif
+}
+
+LockstepEngine::LockstepEngine(size_t lanes) :
+    m_lanes(lanes),
+    m_stride((lanes + 15) & ~static_cast<size_t>(15)),
+    m_pc(lanes),
+    m_sp(lanes),
+    m_opcode(m_stride),
+    m_param(m_stride),
+    m_instrCycles(lanes),
+    m_remaining(lanes),
+    m_ran(lanes),
+    m_stopped(lanes),
+    m_fetched(m_stride),
+    m_mask(m_stride),
+    m_vectorInstrs(0),
+    m_scalarInstrs(0)
+{
+    for (size_t i = 0; i < m_lanes; i++)
+    {
+        m_emus.push_back(make_unique<Emulator>());
+    }
+    for (vector<uint8_t>& reg : m_regs)
+    {
+        reg.resize(m_stride);
+    }
+    m_opcodeLanes.fill(0);
+    for (int opcode = 0; opcode < 256; opcode++)
+    {
+        m_vectorOpcodes[opcode] = isVectorOpcode(static_cast<uint8_t>(opcode));
+    }
+}
+
+LockstepEngine::~LockstepEngine()
+{
+}
+
+int LockstepEngine::step(int cycles)
+{
+    vector<int> counts(m_lanes, cycles);
+    runLanes(counts);
+    return m_lanes > 0 ? *min_element(counts.begin(), counts.end()) : 0;
+}
+
+void LockstepEngine::runFrame()
+{
+    vector<int> counts(m_lanes);
+    for (size_t i = 0; i < m_lanes; i++)
+    {
+        counts[i] = m_emus[i]->periph()->lcd()->cyclesUntilVBlank();
+    }
+    runLanes(counts);
+}
+
+void LockstepEngine::runLanes(vector<int>& counts)
+{
+    for (size_t i = 0; i < m_lanes; i++)
+    {
+        gather(i);
+        m_stopped[i] = 0;
+    }
+
+    // Same as Emulator::step(), the CPU runs up to the next input or
+    // peripheral event then the peripherals catch up
+    vector<int> done(m_lanes, 0);
+    while (true)
+    {
+        bool busy = false;
+        for (size_t i = 0; i < m_lanes; i++)
+        {
+            m_remaining[i] = 0;
+            m_ran[i] = 0;
+            if (m_stopped[i] || done[i] >= counts[i])
+            {
+                continue;
+            }
+
+            Emulator& emu = *m_emus[i];
+            Joypad *joypad = emu.periph()->joypad();
+            uint64_t next = joypad->nextEventCycle();
+            while (next <= emu.m_cycles)
+            {
+                joypad->applyEvents(emu.m_cycles);
+                next = joypad->nextEventCycle();
+            }
+
+            int count = min(counts[i] - done[i], emu.periph()->cyclesUntilNextEvent());
+            if (next - emu.m_cycles < static_cast<uint64_t>(count))
+            {
+                count = static_cast<int>(next - emu.m_cycles);
+            }
+            m_remaining[i] = count;
+            busy = true;
+        }
+        if (!busy)
+        {
+            break;
+        }
+
+        runCpu();
+
+        for (size_t i = 0; i < m_lanes; i++)
+        {
+            if (m_ran[i] > 0)
+            {
+                Emulator& emu = *m_emus[i];
+                emu.periph()->step(m_ran[i]);
+                emu.m_cycles += m_ran[i];
+                done[i] += m_ran[i];
+            }
+        }
+    }
+
+    for (size_t i = 0; i < m_lanes; i++)
+    {
+        scatter(i);
+        counts[i] = done[i];
+    }
+}
+
+void LockstepEngine::runCpu()
+{
+    // Same as Cpu::step() on each lane, the cycles of an instruction are
+    // counted at the start of the next round
+    while (true)
+    {
+        bool busy = false;
+        for (size_t i = 0; i < m_lanes; i++)
+        {
+            if (m_stopped[i] || m_remaining[i] == 0)
+            {
+                continue;
+            }
+
+            if (m_instrCycles[i] > 0)
+            {
+                int tmp = min(m_remaining[i], m_instrCycles[i]);
+                m_instrCycles[i] -= tmp;
+                m_remaining[i] -= tmp;
+                m_ran[i] += tmp;
+            }
+            if (m_instrCycles[i] == 0 && m_remaining[i] > 0)
+            {
+                fetch(i);
+                busy = true;
+            }
+        }
+        if (!busy)
+        {
+            break;
+        }
+
+        for (uint8_t opcode : m_opcodes)
+        {
+            execute(opcode);
+        }
+        m_opcodes.clear();
+    }
+}
+
+void LockstepEngine::fetch(size_t lane)
+{
+    Emulator& emu = *m_emus[lane];
+    Cpu& cpu = *emu.cpu();
+
+    // Stop between two instructions
+    if (emu.stopRequested() || emu.isBreakpoint(m_pc[lane]))
+    {
+        m_stopped[lane] = 1;
+        return;
+    }
+
+    // Interrupts move the PC
+    cpu.m_regPC = m_pc[lane];
+    emu.periph()->processInterrupts();
+    m_pc[lane] = cpu.m_regPC;
+
+    // Counted as Cpu::step() does, whichever path runs the instruction
+    uint8_t opcode = emu.mem().read(m_pc[lane]);
+    m_opcode[lane] = opcode;
+    cpu.m_instructions++;
+    if (m_vectorOpcodes[opcode])
+    {
+        // Runs with the other lanes on this opcode at the end of the round,
+        // all of them are one byte and 4 cycles
+        m_pc[lane]++;
+        m_instrCycles[lane] = 4;
+        m_fetched[lane] = 0xFF;
+        if (m_opcodeLanes[opcode]++ == 0)
+        {
+            m_opcodes.push_back(opcode);
+        }
+        m_vectorInstrs++;
+    }
+    else if (opcode == 0x18 || opcode == 0x20 || opcode == 0x28 || opcode == 0x30 || opcode == 0x38)
+    {
+        // The flags of the previous instruction are already in m_regs
+        jr(lane, emu.mem().read(static_cast<uint16_t>(m_pc[lane] + 1)));
+        m_vectorInstrs++;
+    }
+    else
+    {
+        scatter(lane);
+        cpu.nextInstruction(emu);
+        gather(lane);
+        m_scalarInstrs++;
+    }
+}
+
+void LockstepEngine::execute(uint8_t opcode)
+{
+    uint8_t *mask = m_mask.data();
+    uint8_t *fetched = m_fetched.data();
+    const uint8_t *opcodes = m_opcode.data();
+#if defined(LIBDMG_LOCKSTEP_SSE2)
+    __m128i op = _mm_set1_epi8(static_cast<char>(opcode));
+    for (size_t i = 0; i < m_stride; i += 16)
+    {
+        __m128i m = _mm_and_si128(_mm_cmpeq_epi8(load(opcodes + i), op), load(fetched + i));
+        store(mask + i, m);
+        store(fetched + i, _mm_andnot_si128(m, load(fetched + i)));
+    }
+#else
+    for (size_t i = 0; i < m_stride; i++)
+    {
+        mask[i] = (fetched[i] != 0 && opcodes[i] == opcode) ? 0xFF : 0x00;
+        fetched[i] &= ~mask[i];
+    }
+#endif
+
+    int dest = (opcode >> 3) & 0x07;
+    int src = opcode & 0x07;
+    if (opcode >= 0x40 && opcode < 0x80)
+    {
+        ldReg8Reg8(dest, src);
+    }
+    else if (opcode >= 0x80 && opcode < 0xC0)
+    {
+        alu(dest, src);
+    }
+    else
+    {
+        incDecReg8(dest, (opcode & 0x01) != 0);
+    }
+    m_opcodeLanes[opcode] = 0;
+}
+
+void LockstepEngine::jr(size_t lane, uint8_t offset)
+{
+    // JR: always, JR NZ/Z/NC/C: on the flag or its complement
+    uint8_t opcode = m_opcode[lane];
+    uint8_t flag = (opcode >= 0x30) ? FLAG_C : FLAG_Z;
+    uint8_t expected = (opcode & 0x08) != 0 ? flag : 0;
+    if (opcode == 0x18)
+    {
+        flag = 0;
+        expected = 0;
+    }
+
+    m_param[lane] = offset;
+    m_pc[lane] = static_cast<uint16_t>(m_pc[lane] + 2);
+    if ((m_regs[Cpu::REG8_F][lane] & flag) == expected)
+    {
+        m_pc[lane] = static_cast<uint16_t>(m_pc[lane] + static_cast<int8_t>(offset));
+        m_instrCycles[lane] = 12;
+    }
+    else
+    {
+        m_instrCycles[lane] = 8;
+    }
+}
+
+void LockstepEngine::ldReg8Reg8(int dest, int src)
+{
+    uint8_t *d = m_regs[dest].data();
+    const uint8_t *s = m_regs[src].data();
+    const uint8_t *m = m_mask.data();
+#if defined(LIBDMG_LOCKSTEP_SSE2)
+    for (size_t i = 0; i < m_stride; i += 16)
+    {
+        store(d + i, blend(load(s + i), load(d + i), load(m + i)));
+    }
+#else
+    for (size_t i = 0; i < m_stride; i++)
+    {
+        d[i] = blend(s[i], d[i], m[i]);
+    }
+#endif
+}
+
+#if defined(LIBDMG_LOCKSTEP_SSE2)
+
+void LockstepEngine::alu(int operation, int src)
+{
+    // Flags are computed as by the CpuInstr handlers, see cpu_macros.hpp
+    uint8_t *a = m_regs[Cpu::REG8_A].data();
+    uint8_t *f = m_regs[Cpu::REG8_F].data();
+    const uint8_t *r = m_regs[src].data();
+    const uint8_t *m = m_mask.data();
+    bool useCarry = (operation == ALU_ADC || operation == ALU_SBC);
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    const __m128i carryMask = _mm_set1_epi8(useCarry ? 1 : 0);
+    for (size_t i = 0; i < m_stride; i += 16)
+    {
+        __m128i aVal = load(a + i);
+        __m128i regVal = load(r + i);
+        __m128i fVal = load(f + i);
+        __m128i mVal = load(m + i);
+        __m128i carryVal = _mm_and_si128(_mm_srli_epi16(fVal, 4), carryMask);
+        __m128i aLow = _mm_and_si128(aVal, nibble);
+        __m128i regLow = _mm_and_si128(regVal, nibble);
+        __m128i res = aVal;
+        __m128i flags = _mm_and_si128(fVal, nibble);
+
+        switch (operation)
+        {
+        case ALU_ADD:
+        case ALU_ADC:
+            res = _mm_add_epi8(_mm_add_epi8(aVal, regVal), carryVal);
+            flags = _mm_or_si128(flags, flagIf(_mm_cmpeq_epi8(res, zero), FLAG_Z));
+            flags = _mm_or_si128(flags, flagIf(_mm_cmpgt_epi8(_mm_add_epi8(_mm_add_epi8(aLow, regLow), carryVal),
+                                                              _mm_set1_epi8(16)), FLAG_H));
+            flags = _mm_or_si128(flags, flagIf(isCarry(aVal, regVal, carryVal), FLAG_C));
+            break;
+
+        case ALU_SUB:
+        case ALU_SBC:
+            res = _mm_sub_epi8(_mm_sub_epi8(aVal, regVal), carryVal);
+            flags = _mm_or_si128(flags, flagIf(_mm_cmpeq_epi8(res, zero), FLAG_Z));
+            flags = _mm_or_si128(flags, _mm_set1_epi8(FLAG_N));
+            flags = _mm_or_si128(flags, flagIf(_mm_cmpgt_epi8(_mm_add_epi8(regLow, carryVal), aLow), FLAG_H));
+            flags = _mm_or_si128(flags, flagIf(isBorrow(aVal, regVal, carryVal), FLAG_C));
+            break;
+
+        case ALU_XOR:
+            res = _mm_xor_si128(aVal, regVal);
+            flags = _mm_or_si128(flags, flagIf(_mm_cmpeq_epi8(res, zero), FLAG_Z));
+            break;
+
+        case ALU_CP:
+            flags = _mm_or_si128(flags, flagIf(_mm_cmpeq_epi8(aVal, regVal), FLAG_Z));
+            flags = _mm_or_si128(flags, _mm_set1_epi8(FLAG_N));
+            flags = _mm_or_si128(flags, flagIf(_mm_cmpgt_epi8(regLow, aLow), FLAG_H));
+            flags = _mm_or_si128(flags, flagIf(isBorrow(aVal, regVal, zero), FLAG_C));
+            break;
+
+        default:
+            // AND and OR never get here, see isVectorOpcode()
+            flags = fVal;
+            break;
+        }
+
+        store(a + i, blend(res, aVal, mVal));
+        store(f + i, blend(flags, fVal, mVal));
+    }
+}
+
+void LockstepEngine::incDecReg8(int reg, bool dec)
+{
+    uint8_t *v = m_regs[reg].data();
+    uint8_t *f = m_regs[Cpu::REG8_F].data();
+    const uint8_t *m = m_mask.data();
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    for (size_t i = 0; i < m_stride; i += 16)
+    {
+        __m128i regVal = load(v + i);
+        __m128i fVal = load(f + i);
+        __m128i mVal = load(m + i);
+        __m128i regLow = _mm_and_si128(regVal, nibble);
+
+        // C is left as is
+        __m128i res;
+        __m128i flags = _mm_and_si128(fVal, _mm_set1_epi8(0x1F));
+        if (dec)
+        {
+            res = _mm_sub_epi8(regVal, one);
+            flags = _mm_or_si128(flags, _mm_set1_epi8(FLAG_N));
+            flags = _mm_or_si128(flags, flagIf(_mm_cmpeq_epi8(regLow, zero), FLAG_H));
+        }
+        else
+        {
+            res = _mm_add_epi8(regVal, one);
+            flags = _mm_or_si128(flags, flagIf(_mm_cmpgt_epi8(_mm_add_epi8(regLow, one), _mm_set1_epi8(16)), FLAG_H));
+        }
+        flags = _mm_or_si128(flags, flagIf(_mm_cmpeq_epi8(res, zero), FLAG_Z));
+
+        store(v + i, blend(res, regVal, mVal));
+        store(f + i, blend(flags, fVal, mVal));
+    }
+}
+
+#else
+
+void LockstepEngine::alu(int operation, int src)
+{
+    // Flags are computed as by the CpuInstr handlers, with the same macros
+    uint8_t *a = m_regs[Cpu::REG8_A].data();
+    uint8_t *f = m_regs[Cpu::REG8_F].data();
+    const uint8_t *r = m_regs[src].data();
+    const uint8_t *m = m_mask.data();
+    uint8_t useCarry = (operation == ALU_ADC || operation == ALU_SBC) ? 1 : 0;
+
+    switch (operation)
+    {
+    case ALU_ADD:
+    case ALU_ADC:
+        for (size_t i = 0; i < m_stride; i++)
+        {
+            uint8_t aVal = a[i];
+            uint8_t regVal = r[i];
+            uint8_t carryVal = (f[i] >> 4) & useCarry;
+            uint8_t res = aVal + regVal + carryVal;
+            uint8_t flags = (IS_ZERO(res) ? FLAG_Z : 0) |
+                            (IS_HALF_CARRY3(aVal, regVal, carryVal) ? FLAG_H : 0) |
+                            (IS_CARRY3(aVal, regVal, carryVal) ? FLAG_C : 0) |
+                            (f[i] & 0x0F);
+            a[i] = blend(res, aVal, m[i]);
+            f[i] = blend(flags, f[i], m[i]);
+        }
+        break;
+
+    case ALU_SUB:
+    case ALU_SBC:
+        for (size_t i = 0; i < m_stride; i++)
+        {
+            uint8_t aVal = a[i];
+            uint8_t regVal = r[i];
+            uint8_t carryVal = (f[i] >> 4) & useCarry;
+            uint8_t res = aVal - regVal - carryVal;
+            uint8_t flags = (IS_ZERO(res) ? FLAG_Z : 0) | FLAG_N |
+                            (IS_HALF_BORROW3(aVal, regVal, carryVal) ? FLAG_H : 0) |
+                            (IS_BORROW3(aVal, regVal, carryVal) ? FLAG_C : 0) |
+                            (f[i] & 0x0F);
+            a[i] = blend(res, aVal, m[i]);
+            f[i] = blend(flags, f[i], m[i]);
+        }
+        break;
+
+    case ALU_XOR:
+        for (size_t i = 0; i < m_stride; i++)
+        {
+            uint8_t res = a[i] ^ r[i];
+            uint8_t flags = (IS_ZERO(res) ? FLAG_Z : 0) | (f[i] & 0x0F);
+            a[i] = blend(res, a[i], m[i]);
+            f[i] = blend(flags, f[i], m[i]);
+        }
+        break;
+
+    case ALU_CP:
+        for (size_t i = 0; i < m_stride; i++)
+        {
+            uint8_t aVal = a[i];
+            uint8_t regVal = r[i];
+            uint8_t flags = (IS_ZERO(aVal - regVal) ? FLAG_Z : 0) | FLAG_N |
+                            (IS_HALF_BORROW2(aVal, regVal) ? FLAG_H : 0) |
+                            (IS_BORROW2(aVal, regVal) ? FLAG_C : 0) |
+                            (f[i] & 0x0F);
+            f[i] = blend(flags, f[i], m[i]);
+        }
+        break;
+
+    default:
+        // AND and OR never get here, see isVectorOpcode()
+        break;
+    }
+}
+
+void LockstepEngine::incDecReg8(int reg, bool dec)
+{
+    uint8_t *v = m_regs[reg].data();
+    uint8_t *f = m_regs[Cpu::REG8_F].data();
+    const uint8_t *m = m_mask.data();
+
+    // C is left as is
+    if (dec)
+    {
+        for (size_t i = 0; i < m_stride; i++)
+        {
+            uint8_t regVal = v[i];
+            uint8_t res = regVal - 1;
+            uint8_t flags = (IS_ZERO(res) ? FLAG_Z : 0) | FLAG_N |
+                            (IS_HALF_BORROW2(regVal, 1) ? FLAG_H : 0) |
+                            (f[i] & 0x1F);
+            v[i] = blend(res, regVal, m[i]);
+            f[i] = blend(flags, f[i], m[i]);
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < m_stride; i++)
+        {
+            uint8_t regVal = v[i];
+            uint8_t res = regVal + 1;
+            uint8_t flags = (IS_ZERO(res) ? FLAG_Z : 0) |
+                            (IS_HALF_CARRY2(regVal, 1) ? FLAG_H : 0) |
+                            (f[i] & 0x1F);
+            v[i] = blend(res, regVal, m[i]);
+            f[i] = blend(flags, f[i], m[i]);
+        }
+    }
+}
+
+#endif
+
+bool LockstepEngine::isVectorOpcode(uint8_t opcode)
+{
+    int dest = (opcode >> 3) & 0x07;
+    int src = opcode & 0x07;
+    if (opcode >= 0x40 && opcode < 0x80)
+    {
+        // LD r,r'. LD B,B calls the debug trap
+        return opcode != 0x40 && dest != OPERAND_MEM_HL && src != OPERAND_MEM_HL;
+    }
+    if (opcode >= 0x80 && opcode < 0xC0)
+    {
+        // The CPU has no AND and OR yet, they stay on its warning path
+        return src != OPERAND_MEM_HL && dest != ALU_AND && dest != ALU_OR;
+    }
+    // INC r, DEC r
+    return opcode < 0x40 && (opcode & 0x06) == 0x04 && dest != OPERAND_MEM_HL;
+}
+
+void LockstepEngine::gather(size_t lane)
+{
+    const Cpu& cpu = *m_emus[lane]->cpu();
+    for (size_t reg = 0; reg < m_regs.size(); reg++)
+    {
+        m_regs[reg][lane] = cpu.m_reg8[reg];
+    }
+    m_pc[lane] = cpu.m_regPC;
+    m_sp[lane] = cpu.m_regSP;
+    m_opcode[lane] = cpu.m_opcode;
+    m_param[lane] = cpu.m_parameters[0];
+    m_instrCycles[lane] = cpu.m_instrCycles;
+}
+
+void LockstepEngine::scatter(size_t lane)
+{
+    Cpu& cpu = *m_emus[lane]->cpu();
+    for (size_t reg = 0; reg < m_regs.size(); reg++)
+    {
+        cpu.m_reg8[reg] = m_regs[reg][lane];
+    }
+    cpu.m_regPC = m_pc[lane];
+    cpu.m_regSP = m_sp[lane];
+    cpu.m_opcode = m_opcode[lane];
+    cpu.m_parameters[0] = m_param[lane];
+    cpu.m_instrCycles = m_instrCycles[lane];
+}
@@ -0,0 +1,94 @@
+#ifndef LIBDMG_LOCKSTEP_ENGINE_HPP
+#define LIBDMG_LOCKSTEP_ENGINE_HPP
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace LibDMG
+{
+    class Emulator;
+
+    // Experimental, only built with LIBDMG_BUILD_EXPERIMENTAL: it does not
+    // beat N scalar emulators yet, as the fetch, interrupt and stop checks
+    // of each lane are not batched.
+    //
+    // Runs N emulators of the same program in lockstep. The CPU registers
+    // of all lanes are kept in structure-of-arrays layout, and each round
+    // every lane runs its next instruction. Lanes whose opcode is a
+    // register-only load, 8-bit ALU operation or INC/DEC run it together,
+    // 16 lanes at a time with SSE2 (or a plain loop elsewhere). Converged
+    // lanes share their PC and so always run together. Relative jumps are
+    // resolved by the engine too, any other opcode runs on the lane's own
+    // Cpu, through the usual opcode handlers.
+    //
+    // step() gives every lane the same result as Emulator::step(), so lanes
+    // can be compared with, or handed over to, scalar emulators.
+    class LockstepEngine
+    {
+    public:
+        explicit LockstepEngine(size_t lanes);
+        ~LockstepEngine();
+
+        size_t laneCount() const { return m_lanes; }
+        // Set each lane up (program, state, inputs) between runs
+        Emulator& lane(size_t index) { return *m_emus[index]; }
+
+        // Emulator::step() on every lane, returns the fewest cycles run
+        int step(int cycles);
+        // Runs each lane to the start of its next VBlank, or until it stops
+        void runFrame();
+
+        // Instructions run by the engine (kernels and jumps), and by the lanes' Cpu
+        uint64_t vectorInstructions() const { return m_vectorInstrs; }
+        uint64_t scalarInstructions() const { return m_scalarInstrs; }
+
+    private:
+        size_t m_lanes;
+        // Lane arrays are padded to whole SIMD registers
+        size_t m_stride;
+        std::vector<std::unique_ptr<Emulator> > m_emus;
+
+        // Registers, indexed by Cpu::Reg8 then lane
+        std::array<std::vector<uint8_t>, 8> m_regs;
+        std::vector<uint16_t> m_pc;
+        std::vector<uint16_t> m_sp;
+        std::vector<uint8_t>  m_opcode;
+        std::vector<uint8_t>  m_param;
+        std::vector<int>      m_instrCycles;
+
+        // Per run
+        std::vector<int>      m_remaining;
+        std::vector<int>      m_ran;
+        std::vector<uint8_t>  m_stopped;
+        std::vector<uint8_t>  m_fetched;
+        std::vector<uint8_t>  m_mask;
+        std::array<bool, 256> m_vectorOpcodes;
+        std::array<size_t, 256> m_opcodeLanes;
+        std::vector<uint8_t>  m_opcodes;
+
+        uint64_t m_vectorInstrs;
+        uint64_t m_scalarInstrs;
+
+        void gather(size_t lane);
+        void scatter(size_t lane);
+        // Runs lane i for counts[i] cycles, then sets it to the cycles run
+        void runLanes(std::vector<int>& counts);
+        void runCpu();
+        void fetch(size_t lane);
+        void execute(uint8_t opcode);
+
+        // Kernels, over the lanes in m_mask
+        void ldReg8Reg8(int dest, int src);
+        void alu(int operation, int src);
+        void incDecReg8(int reg, bool dec);
+
+        // Relative jumps are resolved at fetch, from the flags in m_regs
+        void jr(size_t lane, uint8_t offset);
+
+        static bool isVectorOpcode(uint8_t opcode);
+    };
+}
+
+#endif // LIBDMG_LOCKSTEP_ENGINE_HPP
@@ -0,0 +1,656 @@
+// Command-line runner: loads a ROM and runs it without any display or
+// audio device, for servers and scripted runs. With --jobs, runs a list of
+// ROMs in parallel through a BatchRunner instead.
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "emulator.hpp"
+#include "batch_runner.hpp"
+#include "test_rom_monitor.hpp"
+#include "state/state_writer.hpp"
+
+using namespace LibDMG;
+using namespace std;
+
+namespace
+{
+    const double CPU_CLOCK = 4194304.0;
+
+    // Limit when neither frames nor cycles are given, one emulated minute
+    const uint64_t DEFAULT_FRAMES = 3600;
+
+    // Exit codes
+    const int EXIT_OK = 0;
+    const int EXIT_NOT_MET = 1;     // Test failed, or the stop condition was not reached
+    const int EXIT_ERROR = 2;
+
+    struct Options
+    {
+        string   romPath;
+        string   bootRomPath;
+        uint64_t frames = 0;
+        uint64_t cycles = 0;
+        bool     untilPc = false;
+        uint16_t pc = 0;
+        bool     untilTest = false;
+        bool     realTime = false;
+        string   inputPath;
+        string   dumpPath;
+        int      dumpEvery = 1;
+        string   serialPath;
+        string   loadStatePath;
+        string   saveStatePath;
+        bool     frameHashes = false;
+        string   jobsPath;
+        int      threads = 0;
+        bool     pinThreads = false;
+    };
+
+    void printUsage(ostream& out)
+    {
+        out << "Usage: dmg-headless [options] ROM\n"
+               "       dmg-headless [options] --jobs FILE\n"
+               "\n"
+               "Runs a ROM without display, until one of the stop conditions is met.\n"
+               "Without --frames or --cycles, runs for at most " << DEFAULT_FRAMES << " frames.\n"
+               "\n"
+               "  --boot-rom FILE     Boot through FILE, otherwise start at 0x100\n"
+               "  --frames N          Stop after N frames\n"
+               "  --cycles N          Stop after N cycles\n"
+               "  --until-pc ADDR     Stop before the instruction at ADDR\n"
+               "  --until-test        Stop on a test ROM verdict (serial \"Passed\"/\"Failed\"\n"
+               "                      or LD B,B with Mooneye's registers)\n"
+               "  --realtime          Run at the speed of a DMG, not as fast as possible\n"
+               "  --input FILE        Input script: lines of \"FRAME press|release BUTTONS\",\n"
+               "                      buttons among right,left,up,down,a,b,select,start\n"
+               "  --dump FILE         Write frames to FILE, YUV4MPEG2 if it ends in .y4m,\n"
+               "                      raw RGB24 otherwise\n"
+               "  --dump-every N      Only write every Nth frame\n"
+               "  --serial FILE       Write the bytes sent over serial to FILE, - for stdout\n"
+               "  --load-state FILE   Load a save state before running\n"
+               "  --save-state FILE   Save the state when the run ends\n"
+               "  --frame-hashes      Print the hash of every frame\n"
+               "  --help              Show this help\n"
+               "\n"
+               "Batch runs:\n"
+               "  --jobs FILE         Run the jobs of FILE in parallel, one per line:\n"
+               "                      \"ROM [frames=N] [cycles=N] [until-test]\", the\n"
+               "                      options above give the defaults\n"
+               "  --threads N         Worker threads, one per available core by default\n"
+               "  --pin-threads       Pin each worker to its own core (Linux only)\n"
+               "Only --boot-rom, --frames, --cycles, --until-test and --frame-hashes\n"
+               "apply to jobs, frames are run as cycles. Prints a line per job.\n"
+               "\n"
+               "Exits with 0 when done or the test passed, " << EXIT_NOT_MET << " when the test failed or\n"
+               "the --until condition was not reached, " << EXIT_ERROR << " on errors. With --jobs,\n"
+               "the worst of the jobs.\n";
+    }
+
+    uint64_t parseNumber(const string& option, const string& value)
+    {
+        try
+        {
+            size_t end = 0;
+            uint64_t number = stoull(value, &end, 0);
+            if (end == value.size())
+            {
+                return number;
+            }
+        }
+        catch (const exception&)
+        {
+        }
+        throw runtime_error("Invalid value for " + option + ": " + value);
+    }
+
+    // Returns false if the program should exit without running
+    bool parseArgs(int argc, char *argv[], Options& opts)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            string arg = argv[i];
+            if (arg == "--help" || arg == "-h")
+            {
+                printUsage(cout);
+                return false;
+            }
+            if (arg.compare(0, 2, "--") != 0)
+            {
+                if (!opts.romPath.empty())
+                {
+                    throw runtime_error("Only one ROM can be given");
+                }
+                opts.romPath = arg;
+                continue;
+            }
+
+            // Flags
+            if (arg == "--until-test")
+            {
+                opts.untilTest = true;
+                continue;
+            }
+            if (arg == "--realtime")
+            {
+                opts.realTime = true;
+                continue;
+            }
+            if (arg == "--frame-hashes")
+            {
+                opts.frameHashes = true;
+                continue;
+            }
+            if (arg == "--pin-threads")
+            {
+                opts.pinThreads = true;
+                continue;
+            }
+
+            // Options with a value
+            static const char * const WITH_VALUE[] = {
+                "--boot-rom", "--frames", "--cycles", "--until-pc", "--input", "--dump",
+                "--dump-every", "--serial", "--load-state", "--save-state", "--jobs", "--threads"
+            };
+            if (find(begin(WITH_VALUE), end(WITH_VALUE), arg) == end(WITH_VALUE))
+            {
+                throw runtime_error("Unknown option " + arg);
+            }
+            if (i + 1 >= argc)
+            {
+                throw runtime_error("Missing value for " + arg);
+            }
+            string value = argv[++i];
+            if (arg == "--boot-rom")
+            {
+                opts.bootRomPath = value;
+            }
+            else if (arg == "--frames")
+            {
+                opts.frames = parseNumber(arg, value);
+            }
+            else if (arg == "--cycles")
+            {
+                opts.cycles = parseNumber(arg, value);
+            }
+            else if (arg == "--until-pc")
+            {
+                uint64_t pc = parseNumber(arg, value);
+                if (pc > 0xFFFF)
+                {
+                    throw runtime_error("Invalid value for " + arg + ": " + value);
+                }
+                opts.untilPc = true;
+                opts.pc = static_cast<uint16_t>(pc);
+            }
+            else if (arg == "--input")
+            {
+                opts.inputPath = value;
+            }
+            else if (arg == "--dump")
+            {
+                opts.dumpPath = value;
+            }
+            else if (arg == "--dump-every")
+            {
+                opts.dumpEvery = static_cast<int>(max<uint64_t>(1, min<uint64_t>(parseNumber(arg, value), 1000000)));
+            }
+            else if (arg == "--serial")
+            {
+                opts.serialPath = value;
+            }
+            else if (arg == "--load-state")
+            {
+                opts.loadStatePath = value;
+            }
+            else if (arg == "--save-state")
+            {
+                opts.saveStatePath = value;
+            }
+            else if (arg == "--jobs")
+            {
+                opts.jobsPath = value;
+            }
+            else if (arg == "--threads")
+            {
+                opts.threads = static_cast<int>(min<uint64_t>(parseNumber(arg, value), 1024));
+            }
+        }
+
+        if (!opts.jobsPath.empty())
+        {
+            if (!opts.romPath.empty())
+            {
+                throw runtime_error("A ROM cannot be given with --jobs, list it in the jobs file");
+            }
+            if (opts.untilPc || opts.realTime || !opts.inputPath.empty() || !opts.dumpPath.empty() ||
+                !opts.serialPath.empty() || !opts.loadStatePath.empty() || !opts.saveStatePath.empty())
+            {
+                throw runtime_error("--until-pc, --realtime, --input, --dump, --serial and the states "
+                                    "cannot be used with --jobs");
+            }
+        }
+        else if (opts.romPath.empty())
+        {
+            throw runtime_error("No ROM given");
+        }
+        if (opts.frames == 0 && opts.cycles == 0)
+        {
+            opts.frames = DEFAULT_FRAMES;
+        }
+        return true;
+    }
+
+    uint8_t parseButtons(const string& names, const string& where)
+    {
+        static const struct { const char *name; Joypad::Button button; } BUTTONS[] = {
+            { "right", Joypad::BUTTON_RIGHT },
+            { "left", Joypad::BUTTON_LEFT },
+            { "up", Joypad::BUTTON_UP },
+            { "down", Joypad::BUTTON_DOWN },
+            { "a", Joypad::BUTTON_A },
+            { "b", Joypad::BUTTON_B },
+            { "select", Joypad::BUTTON_SELECT },
+            { "start", Joypad::BUTTON_START }
+        };
+
+        uint8_t mask = 0;
+        stringstream list(names);
+        string name;
+        while (getline(list, name, ','))
+        {
+            transform(name.begin(), name.end(), name.begin(), ::tolower);
+            bool found = false;
+            for (const auto& button : BUTTONS)
+            {
+                if (name == button.name)
+                {
+                    mask |= button.button;
+                    found = true;
+                }
+            }
+            if (!found)
+            {
+                throw runtime_error(where + ": unknown button \"" + name + "\"");
+            }
+        }
+        return mask;
+    }
+
+    // Frames are counted from the start of the run
+    vector<InputEvent> loadInputScript(const string& path, uint64_t startCycle)
+    {
+        ifstream in(path);
+        if (!in.good())
+        {
+            throw runtime_error("Cannot open input script " + path);
+        }
+
+        vector<InputEvent> events;
+        string line;
+        for (int lineNumber = 1; getline(in, line); lineNumber++)
+        {
+            line = line.substr(0, line.find('#'));
+            stringstream fields(line);
+            string frame, action, buttons, extra;
+            if (!(fields >> frame))
+            {
+                continue;
+            }
+
+            string where = path + ":" + to_string(lineNumber);
+            if (!(fields >> action >> buttons) || (fields >> extra) || (action != "press" && action != "release"))
+            {
+                throw runtime_error(where + ": expected \"FRAME press|release BUTTONS\"");
+            }
+
+            InputEvent event;
+            event.cycle = startCycle + parseNumber("frame", frame) * LcdController::FRAME_CYCLES;
+            event.buttons = parseButtons(buttons, where);
+            event.pressed = (action == "press");
+            events.push_back(event);
+        }
+
+        stable_sort(events.begin(), events.end(),
+                    [](const InputEvent& a, const InputEvent& b) { return a.cycle < b.cycle; });
+        return events;
+    }
+
+    vector<BatchJob> loadJobs(const Options& opts)
+    {
+        ifstream in(opts.jobsPath);
+        if (!in.good())
+        {
+            throw runtime_error("Cannot open jobs file " + opts.jobsPath);
+        }
+
+        // Each ROM is loaded once and shared by its jobs. A ROM that cannot
+        // be loaded only fails its jobs.
+        map<string, shared_ptr<const Cart> > carts;
+        map<string, string> cartErrors;
+
+        vector<BatchJob> jobs;
+        string line;
+        for (int lineNumber = 1; getline(in, line); lineNumber++)
+        {
+            line = line.substr(0, line.find('#'));
+            stringstream fields(line);
+            string romPath;
+            if (!(fields >> romPath))
+            {
+                continue;
+            }
+
+            string where = opts.jobsPath + ":" + to_string(lineNumber);
+            uint64_t frames = opts.frames;
+            uint64_t cycles = opts.cycles;
+            bool untilTest = opts.untilTest;
+            string field;
+            while (fields >> field)
+            {
+                size_t equals = field.find('=');
+                string key = field.substr(0, equals);
+                string value = (equals == string::npos) ? "" : field.substr(equals + 1);
+                if (key == "until-test" && equals == string::npos)
+                {
+                    untilTest = true;
+                }
+                else if (key == "frames" && equals != string::npos)
+                {
+                    frames = parseNumber(where + ": frames", value);
+                }
+                else if (key == "cycles" && equals != string::npos)
+                {
+                    cycles = parseNumber(where + ": cycles", value);
+                }
+                else
+                {
+                    throw runtime_error(where + ": unknown job setting \"" + field + "\"");
+                }
+            }
+            if (frames == 0 && cycles == 0)
+            {
+                frames = DEFAULT_FRAMES;
+            }
+
+            if (carts.count(romPath) == 0 && cartErrors.count(romPath) == 0)
+            {
+                try
+                {
+                    carts[romPath] = make_shared<Cart>(romPath);
+                }
+                catch (const exception& e)
+                {
+                    cartErrors[romPath] = e.what();
+                }
+            }
+
+            BatchJob job;
+            job.name = romPath;
+            job.defaultBootRom = false;
+            job.bootRomPath = opts.bootRomPath;
+            shared_ptr<const Cart> cart = carts.count(romPath) ? carts[romPath] : nullptr;
+            string cartError = cartErrors.count(romPath) ? cartErrors[romPath] : "";
+            job.setup = [cart, cartError](Emulator& emu)
+            {
+                if (cart == nullptr)
+                {
+                    throw runtime_error(cartError);
+                }
+                emu.insertCart(cart);
+                emu.setAudioEnabled(false);
+            };
+            uint64_t frameCycles = (frames > 0) ? frames * LcdController::FRAME_CYCLES : UINT64_MAX;
+            job.maxCycles = (cycles > 0) ? min(cycles, frameCycles) : frameCycles;
+            job.stopOnTestResult = untilTest;
+            job.frameHashes = opts.frameHashes;
+            jobs.push_back(job);
+        }
+        return jobs;
+    }
+
+    int runJobs(const Options& opts)
+    {
+        vector<BatchJob> jobs = loadJobs(opts);
+        BatchRunner runner(opts.threads, opts.pinThreads);
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        vector<BatchResult> results = runner.run(jobs);
+        double seconds = max(chrono::duration<double>(chrono::steady_clock::now() - start).count(), 1e-9);
+
+        static const char * const STATUS_NAMES[] = {
+            "done", "passed", "FAILED", "TIMEOUT", "breakpoint", "ERROR"
+        };
+        int exitCode = EXIT_OK;
+        uint64_t totalCycles = 0;
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const BatchResult& result = results[i];
+            printf("%-10s %10u frames %12llu cycles  %s\n", STATUS_NAMES[result.status], result.frames,
+                   static_cast<unsigned long long>(result.cycles), jobs[i].name.c_str());
+            if (opts.frameHashes)
+            {
+                for (size_t frame = 0; frame < result.frameHashes.size(); frame++)
+                {
+                    printf("  frame %llu %08x\n", static_cast<unsigned long long>(frame + 1), result.frameHashes[frame]);
+                }
+            }
+            if (result.status == BatchResult::STATUS_ERROR)
+            {
+                printf("  %s\n", result.error.c_str());
+                exitCode = EXIT_ERROR;
+            }
+            else if (result.status == BatchResult::STATUS_FAILED || result.status == BatchResult::STATUS_TIMEOUT)
+            {
+                exitCode = max(exitCode, EXIT_NOT_MET);
+            }
+            totalCycles += result.cycles;
+        }
+
+        fprintf(stderr, "Ran %u jobs, %llu cycles (%.2f s emulated) in %.3f s, %.1f times real time\n",
+                static_cast<unsigned>(results.size()), static_cast<unsigned long long>(totalCycles),
+                totalCycles / CPU_CLOCK, seconds, totalCycles / CPU_CLOCK / seconds);
+        return exitCode;
+    }
+
+    int run(const Options& opts)
+    {
+        shared_ptr<const Cart> cart = make_shared<Cart>(opts.romPath);
+        cerr << "Cart: " << cart->titleStr().c_str() << " (" << cart->typeStr() << ")\n";
+        if (cart->type() != Cart::ROM_ONLY)
+        {
+            cerr << "Warning: memory bank controllers are not supported, only the first 32 KB are mapped\n";
+        }
+
+        Emulator emu(opts.bootRomPath);
+        emu.insertCart(cart);
+        emu.setAudioEnabled(false);
+        if (!opts.loadStatePath.empty())
+        {
+            StateWriter::load(emu, opts.loadStatePath);
+        }
+
+        // Serial output
+        ofstream serialFile;
+        ostream *serialOut = nullptr;
+        if (opts.serialPath == "-")
+        {
+            serialOut = &cout;
+        }
+        else if (!opts.serialPath.empty())
+        {
+            serialFile.open(opts.serialPath, ios::binary);
+            if (!serialFile.good())
+            {
+                throw runtime_error("Cannot open " + opts.serialPath);
+            }
+            serialOut = &serialFile;
+        }
+        auto onSerial = [serialOut](uint8_t val)
+        {
+            if (serialOut != nullptr)
+            {
+                serialOut->put(static_cast<char>(val));
+                if (val == '\n')
+                {
+                    serialOut->flush();
+                }
+            }
+        };
+
+        unique_ptr<TestRomMonitor> monitor;
+        if (opts.untilTest)
+        {
+            monitor = make_unique<TestRomMonitor>(emu, onSerial);
+        }
+        else
+        {
+            emu.periph()->serial()->setOutputCallback(onSerial);
+        }
+        if (opts.untilPc)
+        {
+            emu.setBreakpoint(opts.pc);
+        }
+        emu.periph()->lcd()->setFrameHashEnabled(opts.frameHashes);
+
+        FrameDumper dumper;
+        if (!opts.dumpPath.empty())
+        {
+            bool y4m = opts.dumpPath.size() >= 4 && opts.dumpPath.compare(opts.dumpPath.size() - 4, 4, ".y4m") == 0;
+            dumper.open(opts.dumpPath, y4m ? FrameDumper::FORMAT_Y4M : FrameDumper::FORMAT_RGB24, opts.dumpEvery);
+            emu.setFrameDumper(&dumper);
+        }
+
+        uint64_t startCycle = emu.cycles();
+        vector<InputEvent> inputs;
+        if (!opts.inputPath.empty())
+        {
+            inputs = loadInputScript(opts.inputPath, startCycle);
+        }
+
+        uint64_t endCycle = (opts.cycles > 0) ? startCycle + opts.cycles : UINT64_MAX;
+        uint64_t startInstructions = emu.cpu()->instructions();
+        const chrono::duration<double> framePeriod(LcdController::FRAME_CYCLES / CPU_CLOCK);
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+        uint64_t frames = 0;
+        size_t nextInput = 0;
+        Emulator::StopReason reason = Emulator::STOP_CYCLE;
+        while (true)
+        {
+            // The input queue is bounded, it is fed as the run goes
+            while (nextInput < inputs.size() && emu.pushInput(inputs[nextInput].cycle, inputs[nextInput].buttons,
+                                                                inputs[nextInput].pressed))
+            {
+                nextInput++;
+            }
+
+            // Come back in time to push the events that did not fit
+            uint64_t target = endCycle;
+            if (nextInput < inputs.size())
+            {
+                target = min(target, max(inputs[nextInput].cycle, emu.cycles() + 1));
+            }
+
+            reason = emu.runUntil(target, true);
+            if (reason == Emulator::STOP_VBLANK)
+            {
+                frames++;
+                if (opts.frameHashes)
+                {
+                    printf("frame %llu %08x\n", static_cast<unsigned long long>(frames),
+                           emu.periph()->lcd()->frameHash());
+                }
+                if (opts.realTime)
+                {
+                    this_thread::sleep_until(start + chrono::duration_cast<chrono::steady_clock::duration>(framePeriod * frames));
+                }
+                if (opts.frames > 0 && frames >= opts.frames)
+                {
+                    break;
+                }
+                continue;
+            }
+            if (reason == Emulator::STOP_CYCLE && emu.cycles() < endCycle)
+            {
+                continue;
+            }
+            break;
+        }
+
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (!opts.dumpPath.empty())
+        {
+            emu.setFrameDumper(nullptr);
+            dumper.close();
+        }
+        if (serialOut != nullptr)
+        {
+            serialOut->flush();
+        }
+        if (!opts.saveStatePath.empty())
+        {
+            StateWriter writer;
+            writer.save(emu, opts.saveStatePath).get();
+        }
+
+        // Report
+        uint64_t cycles = emu.cycles() - startCycle;
+        uint64_t instructions = emu.cpu()->instructions() - startInstructions;
+        seconds = max(seconds, 1e-9);
+        fprintf(stderr, "Ran %llu frames, %llu cycles (%.2f s emulated) in %.3f s\n",
+                static_cast<unsigned long long>(frames), static_cast<unsigned long long>(cycles),
+                cycles / CPU_CLOCK, seconds);
+        fprintf(stderr, "%.1f frames/s, %.1f times real time, %.2f MIPS\n",
+                frames / seconds, cycles / CPU_CLOCK / seconds, instructions / seconds / 1e6);
+        if (!opts.dumpPath.empty())
+        {
+            fprintf(stderr, "Dumped %u frames, %u dropped\n", dumper.writtenFrames(), dumper.droppedFrames());
+        }
+
+        if (opts.untilTest)
+        {
+            TestRomMonitor::Result result = monitor->result();
+            fprintf(stderr, "Test %s\n", (result == TestRomMonitor::RESULT_PASSED) ? "passed" :
+                                         (result == TestRomMonitor::RESULT_FAILED) ? "failed" : "gave no verdict");
+            return (result == TestRomMonitor::RESULT_PASSED) ? EXIT_OK : EXIT_NOT_MET;
+        }
+        if (opts.untilPc)
+        {
+            bool reached = (reason == Emulator::STOP_BREAKPOINT);
+            fprintf(stderr, "PC 0x%04X %s\n", opts.pc, reached ? "reached" : "not reached");
+            return reached ? EXIT_OK : EXIT_NOT_MET;
+        }
+        return EXIT_OK;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        Options opts;
+        if (!parseArgs(argc, argv, opts))
+        {
+            return EXIT_OK;
+        }
+        return opts.jobsPath.empty() ? run(opts) : runJobs(opts);
+    }
+    catch (const exception& e)
+    {
+        cerr << "dmg-headless: " << e.what() << "\n";
+        return EXIT_ERROR;
+    }
+}
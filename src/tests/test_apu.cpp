@@ -0,0 +1,161 @@
+#include "audio/apu.hpp"
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+using namespace LibDMG;
+using namespace std;
+
+namespace {
+    class ApuTest : public ::testing::Test {
+    protected:
+        ApuTest() {
+            apu.setReg(Apu::APU_REG_NR52, 0x80);
+            apu.setReg(Apu::APU_REG_NR50, 0x77);
+            apu.setReg(Apu::APU_REG_NR51, 0xFF);
+        }
+
+        // Square 2 at about 1 kHz, full volume
+        void playSquare2(uint8_t nr21 = 0x80, uint8_t nr24 = 0x87) {
+            apu.setReg(Apu::APU_REG_NR21, nr21);
+            apu.setReg(Apu::APU_REG_NR22, 0xF0);
+            apu.setReg(Apu::APU_REG_NR23, 0x83);
+            apu.setReg(Apu::APU_REG_NR24, nr24);
+        }
+
+        Apu apu;
+    };
+
+    //
+    TEST_F(ApuTest, ApuPowerOffClearsRegisters) {
+        playSquare2();
+        EXPECT_EQ(0xF2, apu.reg(Apu::APU_REG_NR52));
+
+        apu.setReg(Apu::APU_REG_NR52, 0x00);
+        EXPECT_EQ(0x70, apu.reg(Apu::APU_REG_NR52));
+        EXPECT_EQ(0x00, apu.reg(Apu::APU_REG_NR50));
+        EXPECT_EQ(0x3F, apu.reg(Apu::APU_REG_NR21));
+
+        // Registers are read-only while powered off
+        apu.setReg(Apu::APU_REG_NR50, 0x77);
+        EXPECT_EQ(0x00, apu.reg(Apu::APU_REG_NR50));
+    }
+
+    //
+    TEST_F(ApuTest, ApuReadMasks) {
+        apu.setReg(Apu::APU_REG_NR10, 0x00);
+        EXPECT_EQ(0x80, apu.reg(Apu::APU_REG_NR10));
+        apu.setReg(Apu::APU_REG_NR13, 0x12);
+        EXPECT_EQ(0xFF, apu.reg(Apu::APU_REG_NR13));
+        apu.setReg(Apu::APU_REG_NR30, 0x00);
+        EXPECT_EQ(0x7F, apu.reg(Apu::APU_REG_NR30));
+        apu.setReg(Apu::APU_REG_NR32, 0x20);
+        EXPECT_EQ(0xBF, apu.reg(Apu::APU_REG_NR32));
+        apu.setReg(Apu::APU_WAVE_RAM + 3, 0x5A);
+        EXPECT_EQ(0x5A, apu.reg(Apu::APU_WAVE_RAM + 3));
+    }
+
+    //
+    TEST_F(ApuTest, ApuLengthCounterCatchUp) {
+        // 64 - 0x3E = 2 length ticks, the first one is at most 8192 cycles away
+        playSquare2(0xBE, 0xC7);
+        EXPECT_EQ(0x02, apu.reg(Apu::APU_REG_NR52) & 0x0F);
+
+        // Stepping alone does not simulate anything, reading NR52 catches up
+        apu.step(8192);
+        EXPECT_EQ(0x02, apu.reg(Apu::APU_REG_NR52) & 0x0F);
+        apu.step(2 * 8192);
+        EXPECT_EQ(0x00, apu.reg(Apu::APU_REG_NR52) & 0x0F);
+    }
+
+    //
+    TEST_F(ApuTest, ApuSweepOverflowDisablesChannel) {
+        // Sweep up by freq >> 1, 0x783 + 0x3C1 overflows at once on trigger
+        apu.setReg(Apu::APU_REG_NR10, 0x11);
+        apu.setReg(Apu::APU_REG_NR12, 0xF0);
+        apu.setReg(Apu::APU_REG_NR13, 0x83);
+        apu.setReg(Apu::APU_REG_NR14, 0x87);
+        EXPECT_EQ(0x00, apu.reg(Apu::APU_REG_NR52) & 0x01);
+
+        // 0x400 + 0x200 does not
+        apu.setReg(Apu::APU_REG_NR13, 0x00);
+        apu.setReg(Apu::APU_REG_NR14, 0x84);
+        EXPECT_EQ(0x01, apu.reg(Apu::APU_REG_NR52) & 0x01);
+        // It does at the first sweep clock, 0x600 + 0x300
+        apu.step(3 * 8192);
+        EXPECT_EQ(0x00, apu.reg(Apu::APU_REG_NR52) & 0x01);
+    }
+
+    //
+    TEST_F(ApuTest, ApuSquareWaveSamples) {
+        playSquare2();
+        apu.step(4194304 / 20);
+
+        size_t count = apu.samplesAvailable();
+        EXPECT_EQ(static_cast<size_t>(Apu::SAMPLE_RATE / 20), count);
+
+        vector<int16_t> samples(count * 2);
+        EXPECT_EQ(count, apu.readSamples(samples.data(), count));
+        EXPECT_EQ(0u, apu.samplesAvailable());
+
+        // Count the sign changes of the left channel, once settled
+        int crossings = 0;
+        int peak = 0;
+        for (size_t i = count / 2 + 1; i < count; i++) {
+            if ((samples[2 * i] < 0) != (samples[2 * (i - 1)] < 0)) {
+                crossings++;
+            }
+            peak = max(peak, abs(samples[2 * i]));
+            EXPECT_EQ(samples[2 * i], samples[2 * i + 1]);
+        }
+
+        // 131072 / (2048 - 0x783) Hz, two crossings per period over 25 ms
+        int expected = 2 * (131072 / (2048 - 0x783)) / 40;
+        EXPECT_NEAR(expected, crossings, 2);
+        EXPECT_GT(peak, 4000);
+    }
+
+    //
+    TEST_F(ApuTest, ApuBufferDropsOldestSamples) {
+        playSquare2();
+        for (int i = 0; i < 60; i++) {
+            apu.step(70224);
+        }
+        EXPECT_LT(apu.samplesAvailable(), BlipBuffer::CAPACITY);
+        EXPECT_GT(apu.samplesAvailable(), BlipBuffer::CAPACITY - 300);
+    }
+
+    //
+    TEST_F(ApuTest, ApuSynthesisOff) {
+        apu.setSynthesisEnabled(false);
+        playSquare2(0xBE, 0xC7);
+        apu.step(8192);
+        EXPECT_EQ(0x02, apu.reg(Apu::APU_REG_NR52) & 0x0F);
+        EXPECT_EQ(0u, apu.samplesAvailable());
+
+        // Length counters keep running
+        apu.step(2 * 8192);
+        EXPECT_EQ(0x00, apu.reg(Apu::APU_REG_NR52) & 0x0F);
+
+        // Sweep overflow still disables square 1
+        apu.setReg(Apu::APU_REG_NR10, 0x11);
+        apu.setReg(Apu::APU_REG_NR12, 0xF0);
+        apu.setReg(Apu::APU_REG_NR13, 0x00);
+        apu.setReg(Apu::APU_REG_NR14, 0x84);
+        EXPECT_EQ(0x01, apu.reg(Apu::APU_REG_NR52) & 0x0F);
+        // The sequencer is at step 3, the next sweep clock is step 6
+        apu.step(4 * 8192);
+        EXPECT_EQ(0x00, apu.reg(Apu::APU_REG_NR52) & 0x0F);
+
+        // Turning synthesis back on picks up the playing channels
+        playSquare2();
+        apu.setSynthesisEnabled(true);
+        apu.step(8192);
+        EXPECT_EQ(8192u / BlipBuffer::CLOCKS_PER_SAMPLE, apu.samplesAvailable());
+        vector<int16_t> samples(2 * apu.samplesAvailable());
+        apu.readSamples(samples.data(), samples.size() / 2);
+        EXPECT_NE(0, *max_element(samples.begin(), samples.end()));
+    }
+}
@@ -0,0 +1,152 @@
+#include "audio/apu.hpp"
+#include "audio/audio_output.hpp"
+#include "audio/resampler.hpp"
+#include "audio/wav_writer.hpp"
+#include "utils/spsc_ring.hpp"
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+using namespace LibDMG;
+using namespace std;
+
+namespace {
+    class AudioOutputTest : public ::testing::Test {
+    protected:
+        ~AudioOutputTest() override {
+            remove("audio_test.wav");
+        }
+
+        // Full volume square wave on channel 2, both sides
+        void playSquare(Apu& apu) {
+            apu.setReg(Apu::APU_REG_NR52, 0x80);
+            apu.setReg(Apu::APU_REG_NR50, 0x77);
+            apu.setReg(Apu::APU_REG_NR51, 0xFF);
+            apu.setReg(Apu::APU_REG_NR21, 0x80);
+            apu.setReg(Apu::APU_REG_NR22, 0xF0);
+            apu.setReg(Apu::APU_REG_NR23, 0x83);
+            apu.setReg(Apu::APU_REG_NR24, 0x87);
+        }
+    };
+
+    //
+    TEST_F(AudioOutputTest, SpscRingWrapsAround) {
+        SpscRing<int, 8> ring;
+        int in[6] = { 1, 2, 3, 4, 5, 6 };
+        int out[8];
+
+        EXPECT_EQ(6u, ring.write(in, 6));
+        EXPECT_EQ(4u, ring.read(out, 4));
+        EXPECT_EQ(6u, ring.write(in, 6));
+        EXPECT_EQ(8u, ring.size());
+        EXPECT_EQ(0u, ring.write(in, 1));
+
+        EXPECT_EQ(8u, ring.read(out, 8));
+        int expected[8] = { 5, 6, 1, 2, 3, 4, 5, 6 };
+        for (int i = 0; i < 8; i++) {
+            EXPECT_EQ(expected[i], out[i]);
+        }
+    }
+
+    //
+    TEST_F(AudioOutputTest, ResamplerKeepsFrequency) {
+        const int inRate = 131072;
+        const int outRate = 48000;
+        const size_t inFrames = inRate / 2;
+        Resampler resampler(inRate, outRate);
+
+        vector<int16_t> in(inFrames * 2);
+        for (size_t i = 0; i < inFrames; i++) {
+            in[2 * i] = static_cast<int16_t>(10000 * sin(2 * 3.14159265358979 * 1000 * i / inRate));
+            in[2 * i + 1] = -in[2 * i];
+        }
+
+        // Feed uneven blocks
+        vector<int16_t> out(resampler.maxOutput(inFrames) * 2);
+        size_t produced = 0;
+        for (size_t pos = 0; pos < inFrames; pos += 1000) {
+            size_t count = min<size_t>(1000, inFrames - pos);
+            produced += resampler.process(in.data() + 2 * pos, count, out.data() + 2 * produced);
+        }
+        EXPECT_NEAR(outRate / 2, static_cast<int>(produced), 2);
+
+        // 1 kHz over the last 0.25 s, left and right stay opposite
+        int crossings = 0;
+        for (size_t i = produced / 2 + 1; i < produced; i++) {
+            if ((out[2 * i] < 0) != (out[2 * (i - 1)] < 0)) {
+                crossings++;
+            }
+            EXPECT_NEAR(out[2 * i], -out[2 * i + 1], 1);
+        }
+        EXPECT_NEAR(500, crossings, 2);
+    }
+
+    //
+    TEST_F(AudioOutputTest, AudioOutputDropsWhenFull) {
+        Apu apu;
+        AudioOutput output(48000);
+        playSquare(apu);
+
+        // About 1.4 s of audio, more than the ring holds
+        for (int i = 0; i < 80; i++) {
+            apu.step(70224);
+            output.update(apu);
+        }
+        EXPECT_EQ(AudioOutput::CAPACITY, output.framesAvailable());
+        EXPECT_GT(output.droppedFrames(), 0u);
+
+        vector<int16_t> buf(1000 * 2);
+        EXPECT_EQ(1000u, output.read(buf.data(), 1000));
+        EXPECT_EQ(AudioOutput::CAPACITY - 1000, output.framesAvailable());
+    }
+
+    //
+    TEST_F(AudioOutputTest, AudioOutputRateControl) {
+        Apu apu;
+        AudioOutput output(48000);
+        output.setRateControl(true, 2048);
+        playSquare(apu);
+
+        // Start above the target
+        for (int i = 0; i < 4; i++) {
+            apu.step(70224);
+            output.update(apu);
+        }
+        EXPECT_GT(output.framesAvailable(), 3000u);
+
+        // Consume at exactly 48 kHz, the ring should move toward the target
+        vector<int16_t> buf(1000 * 2);
+        for (int i = 0; i < 2000; i++) {
+            apu.step(70224);
+            output.update(apu);
+            long long due = 48000LL * 70224 * (i + 1) / 4194304 - 48000LL * 70224 * i / 4194304;
+            output.read(buf.data(), static_cast<size_t>(due));
+        }
+        EXPECT_EQ(0u, output.droppedFrames());
+        EXPECT_GT(output.framesAvailable(), 2048u - 200);
+        EXPECT_LT(output.framesAvailable(), 2048u + 200);
+    }
+
+    //
+    TEST_F(AudioOutputTest, WavWriterDrain) {
+        Apu apu;
+        AudioOutput output(44100);
+        playSquare(apu);
+        apu.step(4194304 / 10);
+        output.update(apu);
+        size_t frames = output.framesAvailable();
+
+        WavWriter wav;
+        wav.open("audio_test.wav", output.sampleRate());
+        wav.drain(output);
+        EXPECT_EQ(frames, wav.frames());
+        EXPECT_EQ(0u, output.framesAvailable());
+        wav.close();
+
+        ifstream in("audio_test.wav", ios::binary | ios::ate);
+        EXPECT_EQ(static_cast<streamoff>(44 + frames * 4), static_cast<streamoff>(in.tellg()));
+    }
+}
@@ -0,0 +1,119 @@
+#include "batch_runner.hpp"
+#include "emulator.hpp"
+#include "logger.hpp"
+#include "test_programs.hpp"
+#include "gtest/gtest.h"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace LibDMG;
+using namespace LibDMG::TestPrograms;
+using namespace std;
+
+namespace {
+    // Test that every job runs once, on several workers, with its own results
+    TEST(BatchRunnerTest, BatchRunAllJobs) {
+        vector<BatchJob> jobs;
+        for (int i = 0; i < 32; i++) {
+            BatchJob job;
+            job.name = "job" + to_string(i);
+            job.setup = [i](Emulator& emu) {
+                loadProgram(emu, printProgram(""));
+                emu.mem().write(0xD000, static_cast<uint8_t>(i));
+                Logger::instance()->logWarn("setup " + to_string(i));
+            };
+            job.maxCycles = (1 + i % 4) * LcdController::FRAME_CYCLES;
+            job.frameHashes = true;
+            job.ramDumpStart = 0xD000;
+            job.ramDumpSize = 2;
+            jobs.push_back(job);
+        }
+
+        BatchRunner runner(4, false);
+        vector<BatchResult> results = runner.run(jobs);
+        ASSERT_EQ(results.size(), jobs.size());
+        for (int i = 0; i < 32; i++) {
+            EXPECT_EQ(results[i].status, BatchResult::STATUS_COMPLETED);
+            EXPECT_EQ(results[i].cycles, jobs[i].maxCycles);
+            EXPECT_EQ(results[i].frames, static_cast<uint32_t>(1 + i % 4));
+            EXPECT_EQ(results[i].frameHashes.size(), results[i].frames);
+            ASSERT_EQ(results[i].ram.size(), 2u);
+            EXPECT_EQ(results[i].ram[0], i);
+            EXPECT_EQ(results[i].log, "[WARN ] setup " + to_string(i) + "\n");
+            EXPECT_GE(results[i].worker, 0);
+            EXPECT_LT(results[i].worker, 4);
+        }
+    }
+
+    // Test the verdicts of test ROM jobs, timeouts and errors
+    TEST(BatchRunnerTest, BatchStatus) {
+        vector<BatchJob> jobs(4);
+        jobs[0].setup = [](Emulator& emu) { loadProgram(emu, printProgram("Passed")); };
+        jobs[1].setup = [](Emulator& emu) { loadProgram(emu, printProgram("Failed")); };
+        jobs[2].setup = [](Emulator& emu) { loadProgram(emu, printProgram("Running")); };
+        jobs[3].setup = [](Emulator& emu) { throw runtime_error("no ROM"); };
+        for (BatchJob& job : jobs) {
+            job.stopOnTestResult = true;
+            job.maxCycles = 100000;
+        }
+
+        vector<BatchResult> results = BatchRunner(2).run(jobs);
+        EXPECT_EQ(results[0].status, BatchResult::STATUS_PASSED);
+        EXPECT_EQ(results[0].serial, "Passed");
+        EXPECT_LT(results[0].cycles, 100000u);
+        EXPECT_EQ(results[1].status, BatchResult::STATUS_FAILED);
+        EXPECT_EQ(results[2].status, BatchResult::STATUS_TIMEOUT);
+        EXPECT_EQ(results[2].serial, "Running");
+        EXPECT_EQ(results[2].cycles, 100000u);
+        EXPECT_EQ(results[3].status, BatchResult::STATUS_ERROR);
+        EXPECT_EQ(results[3].error, "no ROM");
+    }
+
+    // Test that input events reach the emulator at their cycle
+    TEST(BatchRunnerTest, BatchInputs) {
+        BatchJob job;
+        job.setup = [](Emulator& emu) {
+            loadProgram(emu, printProgram(""));
+            emu.periph()->joypad()->setRegP1(0x20);
+        };
+        for (int i = 0; i < 600; i++) {
+            job.inputs.push_back({ static_cast<uint64_t>(i) * 100, Joypad::BUTTON_LEFT, (i % 2) == 0 });
+        }
+        job.inputs.push_back({ 70000, Joypad::BUTTON_RIGHT, true });
+        job.maxCycles = 80000;
+        job.ramDumpStart = 0xFF00;
+        job.ramDumpSize = 1;
+
+        BatchResult result = BatchRunner::runJob(job);
+        EXPECT_EQ(result.status, BatchResult::STATUS_COMPLETED);
+        EXPECT_EQ(result.ram[0] & 0x0F, 0x0E);
+    }
+
+    // Test that a job puts back the logger its caller had installed
+    TEST(BatchRunnerTest, BatchRestoresThreadLogger) {
+        Logger logger;
+        Logger::setThreadLogger(&logger);
+
+        BatchJob job;
+        job.setup = [](Emulator& emu) { loadProgram(emu, printProgram("")); };
+        job.maxCycles = 1000;
+        BatchRunner::runJob(job);
+
+        EXPECT_EQ(Logger::threadLogger(), &logger);
+        EXPECT_EQ(Logger::instance(), &logger);
+        Logger::setThreadLogger(nullptr);
+    }
+
+    // Test that a job can start without a boot ROM
+    TEST(BatchRunnerTest, BatchWithoutBootRom) {
+        BatchJob job;
+        job.defaultBootRom = false;
+        uint16_t pc = 0;
+        job.setup = [&pc](Emulator& emu) { pc = emu.cpu()->reg16(Cpu::REG16_PC); };
+        job.maxCycles = 0;
+        BatchRunner::runJob(job);
+        EXPECT_EQ(pc, 0x100);
+    }
+}
@@ -0,0 +1,41 @@
+#include "utils/crc32c.hpp"
+#include "gtest/gtest.h"
+
+#include <cstring>
+#include <vector>
+
+using namespace LibDMG;
+using namespace std;
+
+namespace {
+    // Test the check value of the CRC-32C catalogue
+    TEST(Crc32cTest, Crc32cCheckValue) {
+        const char *check = "123456789";
+        EXPECT_EQ(crc32c(check, strlen(check)), 0xE3069283u);
+        EXPECT_EQ(detail::crc32cTable(0, check, strlen(check)), 0xE3069283u);
+        EXPECT_EQ(crc32c(check, 0), 0u);
+    }
+
+    // Test that the SSE4.2 path, when built, agrees with the table at any
+    // alignment and length, and when fed in pieces
+    TEST(Crc32cTest, Crc32cMatchesTable) {
+        vector<uint8_t> data(300);
+        for (size_t i = 0; i < data.size(); i++) {
+            data[i] = static_cast<uint8_t>(i * 131 + 7);
+        }
+
+        for (size_t offset = 0; offset < 8; offset++) {
+            for (size_t size = 0; size + offset <= data.size(); size += (size < 40) ? 1 : 37) {
+                const uint8_t *p = data.data() + offset;
+                uint32_t expected = detail::crc32cTable(0, p, size);
+                ASSERT_EQ(crc32c(p, size), expected) << "offset " << offset << ", size " << size;
+
+                size_t half = size / 2 + 1;
+                if (half <= size) {
+                    ASSERT_EQ(crc32c(crc32c(p, half), p + half, size - half), expected)
+                        << "offset " << offset << ", size " << size;
+                }
+            }
+        }
+    }
+}
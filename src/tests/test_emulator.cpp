@@ -1,6 +1,7 @@
 #include "emulator.hpp"
 #include "gtest/gtest.h"
 
+#include <cstring>
 #include <fstream>
 
 using namespace LibDMG;
@@ -32,6 +33,7 @@ namespace {
         void TearDown() override {
             // Code here will be called immediately after each test (right
             // before the destructor).
+            remove("emulator_test.gb");
         }
 
         // Objects declared here can be used by all tests in the test case for Foo.
@@ -46,7 +48,7 @@ namespace {
 			}
 		}
 
-        ofstream out("save_state.xml", ios::binary);
+        ofstream out("save_state.bin", ios::binary);
         emu.saveState(out);
 
         EXPECT_EQ(emu.cpu()->reg16(Cpu::REG16_PC), 100);
@@ -68,9 +70,441 @@ namespace {
 	TEST_F(EmulatorTest, EmuLoadState) {
 		Emulator emu;
 
-        ifstream in("save_state.xml", ios::binary);
+        ifstream in("save_state.bin", ios::binary);
         emu.loadState(in);
 
 		EXPECT_EQ(emu.cpu()->reg16(Cpu::REG16_PC), 100);
 	}
-}
\ No newline at end of file
+
+    // Test sprite rendering from an OAM DMA
+    TEST_F(EmulatorTest, EmuRenderSpriteFromDma) {
+        Emulator emu;
+        static uint8_t frame[Framebuffer::WIDTH * Framebuffer::HEIGHT];
+        emu.framebuffer()->attach(frame, Framebuffer::FORMAT_INDEX2);
+
+        // Tile 1 is solid color 3, sprite 0 uses it at (8, 16) on screen
+        for (int i = 0; i < 16; i++) {
+            emu.mem().write(0x8010 + i, 0xFF);
+        }
+        emu.mem().write(0xC000, 16 + 16);
+        emu.mem().write(0xC001, 8 + 8);
+        emu.mem().write(0xC002, 1);
+        emu.mem().write(0xC003, 0);
+
+        emu.periph()->setReg(Peripherals::PERIPH_REG_DMA, 0xC0);
+        emu.periph()->setReg(Peripherals::PERIPH_REG_OBP0, 0xE4);
+        emu.periph()->setReg(Peripherals::PERIPH_REG_BGP, 0x00);
+        emu.periph()->setReg(Peripherals::PERIPH_REG_LCDC, 0x83);
+        emu.periph()->step(LcdController::FRAME_CYCLES);
+
+        EXPECT_EQ(emu.mem().read(0xFE02), 1);
+        EXPECT_EQ(frame[16 * Framebuffer::WIDTH + 8], 3);
+        EXPECT_EQ(frame[23 * Framebuffer::WIDTH + 15], 3);
+        EXPECT_EQ(frame[24 * Framebuffer::WIDTH + 8], 0);
+        EXPECT_EQ(frame[16 * Framebuffer::WIDTH + 7], 0);
+    }
+
+    // Test that only lines depending on modified VRAM are redrawn
+    TEST_F(EmulatorTest, EmuDirtyLines) {
+        Emulator emu;
+        static uint8_t frame[Framebuffer::WIDTH * Framebuffer::HEIGHT];
+        emu.framebuffer()->attach(frame, Framebuffer::FORMAT_INDEX2);
+
+        emu.periph()->setReg(Peripherals::PERIPH_REG_BGP, 0xE4);
+        emu.periph()->setReg(Peripherals::PERIPH_REG_LCDC, 0x91);
+        emu.periph()->step(LcdController::FRAME_CYCLES);
+        EXPECT_EQ(emu.framebuffer()->dirtyLines().count(), 144u);
+
+        emu.periph()->step(LcdController::FRAME_CYCLES);
+        EXPECT_EQ(emu.framebuffer()->dirtyLines().count(), 0u);
+
+        // Tile map row 1 covers lines 8 to 15
+        emu.mem().write(0x9820, 1);
+        emu.periph()->step(LcdController::FRAME_CYCLES);
+        EXPECT_EQ(emu.framebuffer()->dirtyLines().count(), 8u);
+        EXPECT_TRUE(emu.framebuffer()->isLineDirty(8));
+
+        // Tile 1 is only used by that row
+        emu.mem().write(0x8010, 0xFF);
+        emu.periph()->step(LcdController::FRAME_CYCLES);
+        EXPECT_EQ(emu.framebuffer()->dirtyLines().count(), 8u);
+        EXPECT_EQ(frame[8 * Framebuffer::WIDTH], 1);
+        EXPECT_EQ(frame[8 * Framebuffer::WIDTH + 8], 0);
+
+        // Scrolling changes every line
+        emu.periph()->setReg(Peripherals::PERIPH_REG_SCX, 4);
+        emu.periph()->step(LcdController::FRAME_CYCLES);
+        EXPECT_EQ(emu.framebuffer()->dirtyLines().count(), 144u);
+    }
+
+    // Test the binary save state round trip
+    TEST_F(EmulatorTest, EmuStateRoundTrip) {
+        Emulator emu;
+        emu.cpu()->setReg16(Cpu::REG16_PC, 0x1234);
+        emu.cpu()->setReg8(Cpu::REG8_A, 0x56);
+        emu.mem().write(0x8000, 0xAB);
+        emu.mem().write(0xC100, 0xCD);
+        emu.periph()->setReg(Peripherals::PERIPH_REG_SCX, 7);
+        emu.periph()->setReg(Peripherals::PERIPH_REG_TMA, 0x42);
+
+        vector<uint8_t> state;
+        emu.saveState(state);
+        EXPECT_LT(state.size(), 32u * 1024u);
+
+        Emulator other;
+        other.loadState(state.data(), state.size());
+        EXPECT_EQ(other.cpu()->reg16(Cpu::REG16_PC), 0x1234);
+        EXPECT_EQ(other.cpu()->reg8(Cpu::REG8_A), 0x56);
+        EXPECT_EQ(other.mem().read(0x8000), 0xAB);
+        EXPECT_EQ(other.mem().read(0xC100), 0xCD);
+        EXPECT_EQ(other.periph()->reg(Peripherals::PERIPH_REG_SCX), 7);
+        EXPECT_EQ(other.periph()->reg(Peripherals::PERIPH_REG_TMA), 0x42);
+
+        vector<uint8_t> again;
+        other.saveState(again);
+        EXPECT_EQ(again, state);
+    }
+
+    // Test that states from an older layout still load
+    TEST_F(EmulatorTest, EmuStateCompatibility) {
+        Emulator emu;
+        emu.cpu()->setReg16(Cpu::REG16_PC, 0x0150);
+        vector<uint8_t> state;
+        emu.saveState(state);
+
+        // Append an unknown section, as a newer minor layout would
+        const uint8_t extra[] = { 'X', 'T', 'R', 'A', 2, 0, 0, 0, 0xFF, 0xFF };
+        state.insert(state.end(), extra, extra + sizeof(extra));
+
+        Emulator other;
+        other.loadState(state.data(), state.size());
+        EXPECT_EQ(other.cpu()->reg16(Cpu::REG16_PC), 0x0150);
+
+        // A CPU section without its last field, SP, as an older layout
+        // would write it: SP keeps its value and the next sections still load
+        emu.mem().write(0xC000, 0x5A);
+        vector<uint8_t> older;
+        emu.saveState(older);
+        ASSERT_EQ(memcmp(older.data() + 8, "CPU ", 4), 0);
+        uint32_t cpuLength = older[12] | (older[13] << 8) | (older[14] << 16) | (older[15] << 24);
+        older.erase(older.begin() + 16 + cpuLength - 2, older.begin() + 16 + cpuLength);
+        older[12] = static_cast<uint8_t>(cpuLength - 2);
+        older[13] = static_cast<uint8_t>((cpuLength - 2) >> 8);
+
+        Emulator old;
+        old.cpu()->setReg16(Cpu::REG16_SP, 0x1234);
+        old.loadState(older.data(), older.size());
+        EXPECT_EQ(old.cpu()->reg16(Cpu::REG16_PC), 0x0150);
+        EXPECT_EQ(old.cpu()->reg16(Cpu::REG16_SP), 0x1234);
+        EXPECT_EQ(old.mem().read(0xC000), 0x5A);
+
+        // A foreign file or a newer version is refused
+        vector<uint8_t> bad(state);
+        bad[0] = 'X';
+        EXPECT_THROW(other.loadState(bad.data(), bad.size()), StateException);
+        bad = state;
+        bad[4] = Emulator::STATE_VERSION + 1;
+        EXPECT_THROW(other.loadState(bad.data(), bad.size()), StateException);
+    }
+
+    // Test that a truncated state is refused without changing anything
+    TEST_F(EmulatorTest, EmuTruncatedState) {
+        Emulator emu;
+        emu.cpu()->setReg16(Cpu::REG16_PC, 0x1234);
+        emu.mem().write(0xC000, 0x22);
+        vector<uint8_t> state;
+        emu.saveState(state);
+
+        Emulator other;
+        other.cpu()->setReg16(Cpu::REG16_PC, 0x0100);
+        other.mem().write(0xC000, 0x11);
+        for (size_t size : { state.size() / 2, state.size() - 1, static_cast<size_t>(13) }) {
+            EXPECT_THROW(other.loadState(state.data(), size), StateException);
+            EXPECT_EQ(other.cpu()->reg16(Cpu::REG16_PC), 0x0100);
+            EXPECT_EQ(other.mem().read(0xC000), 0x11);
+        }
+    }
+
+    // Test that restoring a snapshot undoes any change
+    TEST_F(EmulatorTest, EmuSnapshotRestore) {
+        Emulator emu;
+        emu.cpu()->setReg16(Cpu::REG16_PC, 0x0200);
+        emu.mem().write(0xC000, 0x11);
+        emu.periph()->setReg(Peripherals::PERIPH_REG_LCDC, 0x91);
+        emu.periph()->step(1000);
+
+        vector<uint8_t> snap(emu.snapshotSize());
+        emu.snapshot(snap.data());
+        vector<uint8_t> state;
+        emu.saveState(state);
+
+        emu.cpu()->setReg16(Cpu::REG16_PC, 0x0300);
+        emu.mem().write(0xC000, 0x22);
+        emu.mem().write(0x9800, 0x33);
+        emu.periph()->step(50000);
+
+        emu.restore(snap.data());
+        EXPECT_EQ(emu.cpu()->reg16(Cpu::REG16_PC), 0x0200);
+        EXPECT_EQ(emu.mem().read(0xC000), 0x11);
+        EXPECT_EQ(emu.mem().read(0x9800), 0x00);
+
+        vector<uint8_t> restored;
+        emu.saveState(restored);
+        EXPECT_EQ(restored, state);
+    }
+
+    // Test that incremental states only carry the written pages
+    TEST_F(EmulatorTest, EmuIncrementalState) {
+        Emulator emu;
+        emu.mem().write(0xC000, 0x11);
+        vector<uint8_t> base;
+        emu.saveState(base);
+        emu.checkpoint();
+
+        emu.mem().write(0xC010, 0x22);
+        emu.mem().write(0xD234, 0x33);
+        // A full save in the middle of the chain does not break it
+        vector<uint8_t> full;
+        emu.saveState(full);
+        emu.mem().write(0xFF90, 0x44);
+        emu.cpu()->setReg16(Cpu::REG16_PC, 0x0400);
+        vector<uint8_t> inc;
+        emu.saveIncremental(inc);
+        EXPECT_LT(inc.size(), base.size() / 10);
+
+        // Nothing written since
+        vector<uint8_t> empty;
+        emu.saveIncremental(empty);
+        EXPECT_LT(empty.size(), inc.size() - 2 * MemControllerBase::PAGE_SIZE);
+
+        Emulator other;
+        other.loadState(base.data(), base.size());
+        other.loadState(inc.data(), inc.size());
+        other.loadState(empty.data(), empty.size());
+        EXPECT_EQ(other.cpu()->reg16(Cpu::REG16_PC), 0x0400);
+        EXPECT_EQ(other.mem().read(0xC000), 0x11);
+        EXPECT_EQ(other.mem().read(0xC010), 0x22);
+        EXPECT_EQ(other.mem().read(0xD234), 0x33);
+        EXPECT_EQ(other.mem().read(0xFF90), 0x44);
+
+        vector<uint8_t> expected, actual;
+        emu.saveState(expected);
+        other.saveState(actual);
+        EXPECT_EQ(actual, expected);
+    }
+
+    // Test that the state hash follows the state
+    TEST_F(EmulatorTest, EmuStateHash) {
+        Emulator a, b;
+        EXPECT_EQ(a.stateHash(), b.stateHash());
+
+        a.mem().write(0xC800, 0x12);
+        EXPECT_NE(a.stateHash(), b.stateHash());
+        b.mem().write(0xC800, 0x12);
+        EXPECT_EQ(a.stateHash(), b.stateHash());
+
+        // Writing a page back to its previous content
+        uint32_t hash = a.stateHash();
+        a.mem().write(0x8000, 0x34);
+        EXPECT_NE(a.stateHash(), hash);
+        a.mem().write(0x8000, 0x00);
+        EXPECT_EQ(a.stateHash(), hash);
+
+        a.cpu()->setReg8(Cpu::REG8_B, 1);
+        EXPECT_NE(a.stateHash(), b.stateHash());
+        a.cpu()->setReg8(Cpu::REG8_B, 0);
+        a.periph()->setReg(Peripherals::PERIPH_REG_SCY, 9);
+        EXPECT_NE(a.stateHash(), b.stateHash());
+
+        // Restoring memory by any means is taken into account
+        vector<uint8_t> snap(b.snapshotSize());
+        b.snapshot(snap.data());
+        a.restore(snap.data());
+        EXPECT_EQ(a.stateHash(), b.stateHash());
+
+        vector<uint8_t> base;
+        a.saveState(base);
+        a.checkpoint();
+        a.mem().write(0xD000, 0x56);
+        vector<uint8_t> inc;
+        a.saveIncremental(inc);
+        b.loadState(inc.data(), inc.size());
+        EXPECT_EQ(a.stateHash(), b.stateHash());
+    }
+
+    // Test that runFrame() stops at the start of VBlank
+    TEST_F(EmulatorTest, EmuRunFrame) {
+        Emulator emu;
+        emu.periph()->setReg(Peripherals::PERIPH_REG_LCDC, 0x91);
+        emu.setBreakpoint(0x0000, false);
+        uint32_t frames = emu.periph()->lcd()->frameCount();
+
+        EXPECT_EQ(emu.runFrame(), Emulator::STOP_VBLANK);
+        EXPECT_EQ(emu.periph()->lcd()->frameCount(), frames + 1);
+        EXPECT_EQ(emu.periph()->lcd()->regLY(), LcdController::SCREEN_HEIGHT);
+        EXPECT_EQ(emu.periph()->lcd()->frameCycle(), LcdController::SCREEN_HEIGHT * LcdController::LINE_CYCLES);
+
+        uint64_t start = emu.cycles();
+        EXPECT_EQ(emu.runFrame(), Emulator::STOP_VBLANK);
+        EXPECT_EQ(emu.cycles() - start, static_cast<uint64_t>(LcdController::FRAME_CYCLES));
+        EXPECT_EQ(emu.periph()->lcd()->frameCount(), frames + 2);
+
+        EXPECT_EQ(emu.runUntilCycle(emu.cycles() + 1234), Emulator::STOP_CYCLE);
+        EXPECT_EQ(emu.cycles(), start + LcdController::FRAME_CYCLES + 1234);
+    }
+
+    // Test that a program polling LY and STAT sees them move during runFrame()
+    TEST_F(EmulatorTest, EmuRunFramePollsLcd) {
+        Emulator emu("");
+        const uint8_t program[] = {
+            0x26, 0xD0,     // LD H,0xD0
+            0xF0, 0x44,     // LDH A,(LY)
+            0x6F,           // LD L,A
+            0x74,           // LD (HL),H
+            0x26, 0xD1,     // LD H,0xD1
+            0xF0, 0x41,     // LDH A,(STAT)
+            0x6F,           // LD L,A
+            0x74,           // LD (HL),H
+            0x18, 0xF2      // JR -14
+        };
+        for (size_t i = 0; i < sizeof(program); i++) {
+            emu.mem().write(static_cast<uint16_t>(0xC000 + i), program[i]);
+        }
+        emu.cpu()->setReg16(Cpu::REG16_PC, 0xC000);
+
+        EXPECT_EQ(emu.runFrame(), Emulator::STOP_VBLANK);
+        emu.runFrame();
+
+        int lines = 0;
+        for (uint16_t ly = 0; ly < LcdController::SCREEN_HEIGHT; ly++) {
+            lines += (emu.mem().read(0xD000 + ly) == 0xD0) ? 1 : 0;
+        }
+        EXPECT_EQ(lines, LcdController::SCREEN_HEIGHT);
+
+        bool modes[4] = {};
+        for (uint16_t stat = 0; stat < 0x100; stat++) {
+            if (emu.mem().read(0xD100 + stat) == 0xD1) {
+                modes[stat & 0x03] = true;
+            }
+        }
+        EXPECT_TRUE(modes[0]);
+        EXPECT_TRUE(modes[1]);
+        EXPECT_TRUE(modes[2]);
+        EXPECT_TRUE(modes[3]);
+    }
+
+    // Test that the LCD requests no interrupt while it is off
+    TEST_F(EmulatorTest, EmuLcdOffNoInterrupts) {
+        Emulator emu("");
+        emu.periph()->setReg(Peripherals::PERIPH_REG_LCDC, 0x11);
+        emu.periph()->setReg(Peripherals::PERIPH_REG_STAT, 0x78);
+        emu.periph()->setReg(Peripherals::PERIPH_REG_LYC, 0);
+        emu.periph()->setRegIF(0);
+        emu.periph()->step(2 * LcdController::FRAME_CYCLES);
+        EXPECT_EQ(emu.periph()->regIF() & 0x03, 0);
+        EXPECT_EQ(emu.periph()->reg(Peripherals::PERIPH_REG_LY), 0);
+
+        emu.periph()->setReg(Peripherals::PERIPH_REG_LCDC, 0x91);
+        emu.periph()->step(LcdController::FRAME_CYCLES);
+        EXPECT_EQ(emu.periph()->regIF() & 0x03, 0x03);
+    }
+
+    // Test stopping at a PC breakpoint and resuming from it
+    TEST_F(EmulatorTest, EmuRunBreakpoint) {
+        Emulator emu;
+        for (uint16_t addr = 0xC000; addr < 0xC100; addr++) {
+            emu.mem().write(addr, 0x00);    // NOP
+        }
+        emu.mem().write(0xC100, 0x18);      // JR -2
+        emu.mem().write(0xC101, 0xFE);
+        emu.cpu()->setReg16(Cpu::REG16_PC, 0xC000);
+        emu.setBreakpoint(0xC010);
+
+        EXPECT_EQ(emu.runUntilCycle(emu.cycles() + 100000), Emulator::STOP_BREAKPOINT);
+        EXPECT_EQ(emu.cpu()->reg16(Cpu::REG16_PC), 0xC010);
+
+        // Stays there while the breakpoint is set, and leaves it on the next run
+        EXPECT_EQ(emu.step(100), 0);
+        EXPECT_EQ(emu.runUntilCycle(emu.cycles() + 8), Emulator::STOP_CYCLE);
+        EXPECT_GT(emu.cpu()->reg16(Cpu::REG16_PC), 0xC010);
+
+        emu.setBreakpoint(0xC100);
+        EXPECT_EQ(emu.runFrame(), Emulator::STOP_BREAKPOINT);
+        EXPECT_EQ(emu.cpu()->reg16(Cpu::REG16_PC), 0xC100);
+        EXPECT_EQ(emu.runFrame(), Emulator::STOP_BREAKPOINT);
+        EXPECT_EQ(emu.cpu()->reg16(Cpu::REG16_PC), 0xC100);
+
+        emu.clearBreakpoints();
+        EXPECT_EQ(emu.runFrame(), Emulator::STOP_VBLANK);
+        emu.requestStop();
+        EXPECT_EQ(emu.runFrame(), Emulator::STOP_REQUESTED);
+    }
+
+    // Test that a clone starts from the same state and then lives on its own
+    TEST_F(EmulatorTest, EmuClone) {
+        Emulator parent;
+        parent.mem().write(0xC000, 0x18);   // JR -2
+        parent.mem().write(0xC001, 0xFE);
+        parent.mem().write(0xD000, 0x12);
+        parent.cpu()->setReg16(Cpu::REG16_PC, 0xC000);
+        parent.step(1000);
+
+        // Page of 0xD000, main RAM starts at page 32
+        const size_t PAGE = 32 + 0x1000 / MemControllerBase::PAGE_SIZE;
+        unique_ptr<Emulator> clone = parent.clone();
+        EXPECT_EQ(clone->cycles(), parent.cycles());
+        EXPECT_EQ(clone->stateHash(), parent.stateHash());
+        EXPECT_EQ(clone->mem().page(PAGE), parent.mem().page(PAGE));
+
+        // Writes on either side copy the page
+        clone->mem().write(0xD000, 0x34);
+        EXPECT_EQ(parent.mem().read(0xD000), 0x12);
+        parent.mem().write(0xD001, 0x56);
+        EXPECT_EQ(clone->mem().read(0xD001), 0x00);
+        EXPECT_NE(clone->mem().page(PAGE), parent.mem().page(PAGE));
+
+        clone->mem().write(0xD000, 0x12);
+        clone->mem().write(0xD001, 0x56);
+        parent.runFrame();
+        clone->runFrame();
+        EXPECT_EQ(clone->cycles(), parent.cycles());
+        EXPECT_EQ(clone->stateHash(), parent.stateHash());
+    }
+
+    // Test running a cart without boot ROM, and the boot ROM disable register
+    TEST_F(EmulatorTest, EmuCartWithoutBootRom) {
+        vector<char> rom(0x8000, 0);
+        const uint8_t program[] = {
+            0x3E, 0x42,         // LD A,0x42
+            0xEA, 0x00, 0xC0,   // LD (0xC000),A
+            0x18, 0xFE          // JR -2
+        };
+        memcpy(&rom[0x100], program, sizeof(program));
+        rom[0x0000] = 0x5A;
+        rom[0x7FFF] = 0x24;
+        {
+            ofstream out("emulator_test.gb", ios::binary);
+            out.write(rom.data(), rom.size());
+        }
+        shared_ptr<const Cart> cart = make_shared<Cart>("emulator_test.gb");
+
+        Emulator emu("");
+        emu.insertCart(cart);
+        EXPECT_EQ(emu.cpu()->reg16(Cpu::REG16_PC), 0x100);
+        EXPECT_EQ(emu.cpu()->reg16(Cpu::REG16_SP), 0xFFFE);
+        EXPECT_EQ(emu.mem().read(0x0000), 0x5A);
+        EXPECT_EQ(emu.mem().read(0x7FFF), 0x24);
+
+        emu.runFrame();
+        EXPECT_EQ(emu.mem().read(0xC000), 0x42);
+        EXPECT_EQ(emu.cpu()->reg16(Cpu::REG16_PC), 0x105);
+        EXPECT_GT(emu.cpu()->instructions(), 0u);
+
+        // The boot ROM covers the cart until it is written off
+        Emulator boot;
+        boot.insertCart(cart);
+        EXPECT_NE(boot.mem().read(0x0000), 0x5A);
+        boot.mem().write(0xFF50, 0x01);
+        EXPECT_EQ(boot.mem().read(0x0000), 0x5A);
+    }
+}
@@ -0,0 +1,85 @@
+#include "video/frame_dumper.hpp"
+#include "gtest/gtest.h"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+using namespace LibDMG;
+using namespace std;
+
+namespace {
+    class FrameDumperTest : public ::testing::Test {
+    protected:
+        FrameDumperTest() {
+            for (int i = 0; i < FrameDumper::WIDTH * FrameDumper::HEIGHT; i++) {
+                frame[i] = i % 4;
+            }
+        }
+
+        ~FrameDumperTest() override {
+            remove("dump_test.y4m");
+            remove("dump_test.rgb");
+            remove("dump_test.png");
+        }
+
+        static streamoff fileSize(const char *path) {
+            ifstream in(path, ios::binary | ios::ate);
+            return in.tellg();
+        }
+
+        uint8_t frame[FrameDumper::WIDTH * FrameDumper::HEIGHT];
+    };
+
+    TEST_F(FrameDumperTest, FrameDumperInvalidFile) {
+        FrameDumper dumper;
+        ASSERT_THROW(dumper.open("no_such_dir/dump.y4m", FrameDumper::FORMAT_Y4M), FrameDumperException);
+    }
+
+    TEST_F(FrameDumperTest, FrameDumperY4mEveryOtherFrame) {
+        FrameDumper dumper;
+        dumper.open("dump_test.y4m", FrameDumper::FORMAT_Y4M, 2);
+        for (int i = 0; i < 4; i++) {
+            dumper.pushFrame(frame);
+        }
+        dumper.close();
+
+        EXPECT_EQ(dumper.writtenFrames() + dumper.droppedFrames(), 2u);
+        // Half the frame rate
+        string header = "YUV4MPEG2 W160 H144 F4194304:140448 Ip A1:1 Cmono\n";
+        EXPECT_EQ(fileSize("dump_test.y4m"),
+                  static_cast<streamoff>(header.size() + dumper.writtenFrames() * (6 + 160 * 144)));
+        ifstream in("dump_test.y4m", ios::binary);
+        string firstLine;
+        getline(in, firstLine);
+        EXPECT_EQ(firstLine + "\n", header);
+    }
+
+    TEST_F(FrameDumperTest, FrameDumperRgb24) {
+        FrameDumper dumper;
+        dumper.open("dump_test.rgb", FrameDumper::FORMAT_RGB24);
+        dumper.pushFrame(frame);
+        dumper.close();
+
+        ifstream in("dump_test.rgb", ios::binary);
+        uint8_t pixels[6];
+        in.read(reinterpret_cast<char *>(pixels), sizeof(pixels));
+        EXPECT_EQ(pixels[0], 0xFF);
+        EXPECT_EQ(pixels[3], 0xAA);
+    }
+
+    TEST_F(FrameDumperTest, FrameDumperSnapshot) {
+        FrameDumper dumper;
+        dumper.open("", FrameDumper::FORMAT_Y4M);
+        dumper.requestSnapshot("dump_test.png");
+        dumper.pushFrame(frame);
+        dumper.close();
+
+        ifstream in("dump_test.png", ios::binary);
+        char signature[4] = {};
+        in.read(signature, sizeof(signature));
+        EXPECT_EQ(signature[1], 'P');
+        EXPECT_EQ(signature[2], 'N');
+        EXPECT_EQ(signature[3], 'G');
+    }
+}
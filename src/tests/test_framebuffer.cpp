@@ -0,0 +1,92 @@
+#include "video/framebuffer.hpp"
+#include "gtest/gtest.h"
+
+#include <vector>
+
+using namespace LibDMG;
+
+namespace {
+    class FramebufferTest : public ::testing::Test {
+    protected:
+        FramebufferTest() {
+            for (int x = 0; x < Framebuffer::WIDTH; x++) {
+                shades[x] = x % 4;
+            }
+        }
+
+        uint8_t shades[Framebuffer::WIDTH];
+    };
+
+    TEST_F(FramebufferTest, FramebufferDetachedIgnoresLines) {
+        Framebuffer fb;
+        ASSERT_FALSE(fb.isAttached());
+        fb.writeLine(0, shades);
+    }
+
+    TEST_F(FramebufferTest, FramebufferRgba8888) {
+        std::vector<uint8_t> buf(Framebuffer::WIDTH * Framebuffer::HEIGHT * 4, 0);
+        Framebuffer fb;
+        fb.attach(buf.data(), Framebuffer::FORMAT_RGBA8888);
+        fb.writeLine(1, shades);
+
+        const uint8_t *row = buf.data() + Framebuffer::WIDTH * 4;
+        EXPECT_EQ(row[0], 0xFF);
+        EXPECT_EQ(row[3], 0xFF);
+        EXPECT_EQ(row[4], 0xAA);
+        EXPECT_EQ(row[12], 0x00);
+        EXPECT_EQ(row[15], 0xFF);
+        EXPECT_EQ(buf[0], 0x00);
+    }
+
+    TEST_F(FramebufferTest, FramebufferRgb565Pitch) {
+        const size_t pitch = 512;
+        std::vector<uint8_t> buf(pitch * Framebuffer::HEIGHT, 0x12);
+        Framebuffer fb;
+        fb.attach(buf.data(), Framebuffer::FORMAT_RGB565, pitch);
+        fb.writeLine(2, shades);
+
+        const uint16_t *row = reinterpret_cast<const uint16_t *>(buf.data() + 2 * pitch);
+        EXPECT_EQ(row[0], 0xFFFF);
+        EXPECT_EQ(row[3], 0x0000);
+        EXPECT_EQ(buf[2 * pitch + Framebuffer::WIDTH * 2], 0x12);
+    }
+
+    TEST_F(FramebufferTest, FramebufferGray8CustomPalette) {
+        std::vector<uint8_t> buf(Framebuffer::WIDTH * Framebuffer::HEIGHT, 0);
+        const uint32_t palette[4] = { 0x000000FF, 0x404040FF, 0x808080FF, 0xFFFFFFFF };
+        Framebuffer fb;
+        fb.setPalette(palette);
+        fb.attach(buf.data(), Framebuffer::FORMAT_GRAY8);
+        fb.writeLine(0, shades);
+
+        EXPECT_EQ(buf[0], 0x00);
+        EXPECT_EQ(buf[3], 0xFF);
+    }
+
+    TEST_F(FramebufferTest, FramebufferPaletteMakesLinesStale) {
+        std::vector<uint8_t> buf(Framebuffer::WIDTH * Framebuffer::HEIGHT, 0);
+        Framebuffer fb;
+        fb.attach(buf.data(), Framebuffer::FORMAT_GRAY8);
+        fb.writeLine(0, shades);
+        EXPECT_FALSE(fb.isLineStale(0));
+        EXPECT_TRUE(fb.isLineStale(1));
+
+        const uint32_t palette[4] = { 0x000000FF, 0x404040FF, 0x808080FF, 0xFFFFFFFF };
+        fb.setPalette(palette);
+        EXPECT_TRUE(fb.isLineStale(0));
+        fb.writeLine(0, shades);
+        EXPECT_FALSE(fb.isLineStale(0));
+    }
+
+    TEST_F(FramebufferTest, FramebufferIndex2) {
+        std::vector<uint8_t> buf(Framebuffer::WIDTH * Framebuffer::HEIGHT, 0);
+        Framebuffer fb;
+        fb.attach(buf.data(), Framebuffer::FORMAT_INDEX2);
+        fb.writeLine(143, shades);
+
+        const uint8_t *row = buf.data() + 143 * Framebuffer::WIDTH;
+        for (int x = 0; x < Framebuffer::WIDTH; x++) {
+            ASSERT_EQ(row[x], x % 4);
+        }
+    }
+}
@@ -0,0 +1,138 @@
+#include "emulator.hpp"
+#include "gtest/gtest.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace LibDMG;
+using namespace std;
+
+namespace {
+    class JoypadTest : public ::testing::Test {
+    protected:
+        JoypadTest() {
+            emu.periph()->setRegIF(0);
+        }
+
+        bool joypadInterrupt() const {
+            return (emu.periph()->regIF() & Joypad::INT_JOYPAD) != 0;
+        }
+
+        Emulator emu;
+    };
+
+    //
+    TEST_F(JoypadTest, JoypadSelectLines) {
+        Joypad *joypad = emu.periph()->joypad();
+        joypad->setButtons(Joypad::BUTTON_LEFT | Joypad::BUTTON_START, true);
+
+        // Nothing selected
+        EXPECT_EQ(0xFF, joypad->regP1());
+        EXPECT_FALSE(joypadInterrupt());
+
+        // Directions, selecting them pulls LEFT low
+        joypad->setRegP1(0x20);
+        EXPECT_EQ(0xED, joypad->regP1());
+        EXPECT_TRUE(joypadInterrupt());
+
+        // Buttons
+        joypad->setRegP1(0x10);
+        EXPECT_EQ(0xD7, joypad->regP1());
+
+        // Both
+        joypad->setRegP1(0x00);
+        EXPECT_EQ(0xC5, joypad->regP1());
+    }
+
+    //
+    TEST_F(JoypadTest, JoypadEventAtExactCycle) {
+        Joypad *joypad = emu.periph()->joypad();
+        joypad->setRegP1(0x10);
+
+        EXPECT_TRUE(emu.pushInput(1000, Joypad::BUTTON_A, true));
+        EXPECT_TRUE(emu.pushInput(3000, Joypad::BUTTON_A, false));
+
+        // A single step is split at the event
+        emu.step(999);
+        EXPECT_EQ(0, joypad->buttons());
+        EXPECT_FALSE(joypadInterrupt());
+        emu.step(1);
+        EXPECT_EQ(0, joypad->buttons());
+        emu.step(1);
+        EXPECT_EQ(Joypad::BUTTON_A, joypad->buttons());
+        EXPECT_TRUE(joypadInterrupt());
+
+        emu.step(10000);
+        EXPECT_EQ(0, joypad->buttons());
+        EXPECT_EQ(11001u, emu.cycles());
+        EXPECT_EQ(0u, joypad->lateEvents());
+
+        // Pushed after its cycle
+        emu.pushInput(5000, Joypad::BUTTON_B, true);
+        emu.step(4);
+        EXPECT_EQ(Joypad::BUTTON_B, joypad->buttons());
+        EXPECT_EQ(1u, joypad->lateEvents());
+    }
+
+    // Test that events not applied yet are kept by states, snapshots and clones
+    TEST_F(JoypadTest, JoypadPendingEventsInState) {
+        emu.pushInput(1000, Joypad::BUTTON_A, true);
+        emu.pushInput(2000, Joypad::BUTTON_A, false);
+        emu.step(500);
+        // Still in the queue
+        emu.pushInput(3000, Joypad::BUTTON_B, true);
+
+        vector<uint8_t> state;
+        emu.saveState(state);
+        vector<uint8_t> snap(emu.snapshotSize());
+        emu.snapshot(snap.data());
+
+        Emulator loaded;
+        loaded.loadState(state.data(), state.size());
+        Emulator restored;
+        restored.restore(snap.data());
+        unique_ptr<Emulator> clone = emu.clone();
+
+        for (Emulator *copy : { &loaded, &restored, clone.get() }) {
+            Joypad *joypad = copy->periph()->joypad();
+            EXPECT_EQ(500u, copy->cycles());
+            copy->step(501);
+            EXPECT_EQ(Joypad::BUTTON_A, joypad->buttons());
+            copy->step(1000);
+            EXPECT_EQ(0, joypad->buttons());
+            copy->step(1000);
+            EXPECT_EQ(Joypad::BUTTON_B, joypad->buttons());
+            EXPECT_EQ(0u, joypad->lateEvents());
+        }
+    }
+
+    //
+    TEST_F(JoypadTest, JoypadEventsFromManyThreads) {
+        Joypad *joypad = emu.periph()->joypad();
+        const int threads = 4;
+        const int events = 50;
+
+        // Thread t toggles its own button at cycles 100 + t + 16 * k, pushed
+        // from the last one to the first one
+        vector<thread> producers;
+        for (int t = 0; t < threads; t++) {
+            producers.emplace_back([this, t]() {
+                for (int i = 0; i < events; i++) {
+                    emu.pushInput(100 + (events - 1 - i) * 4 * threads + t, 1 << t, (i % 2) == 1);
+                }
+            });
+        }
+        for (auto& producer : producers) {
+            producer.join();
+        }
+
+        // The earliest event of each button presses it
+        emu.step(100 + threads);
+        EXPECT_EQ(0x0F, joypad->buttons());
+        emu.step(4 * threads * events);
+        EXPECT_EQ(0x00, joypad->buttons());
+        EXPECT_EQ(UINT64_MAX, joypad->nextEventCycle());
+        EXPECT_EQ(0u, joypad->lateEvents());
+    }
+}
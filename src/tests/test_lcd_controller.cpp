@@ -0,0 +1,113 @@
+#include "emulator.hpp"
+#include "peripherals/lcd_controller.hpp"
+#include "utils/crc32c.hpp"
+#include "gtest/gtest.h"
+
+using namespace LibDMG;
+
+namespace {
+    class LcdControllerTest : public ::testing::Test {
+    protected:
+        LcdControllerTest() {
+            lcd.setRegLCDC(0x80);
+        }
+
+        LcdController lcd;
+    };
+
+    TEST_F(LcdControllerTest, LcdModesOnFirstLine) {
+        EXPECT_EQ(lcd.regLY(), 0);
+        EXPECT_EQ(lcd.mode(), 2);
+        EXPECT_EQ(lcd.nextEventCycle(), 80);
+
+        lcd.step(80);
+        EXPECT_EQ(lcd.mode(), 3);
+        EXPECT_EQ(lcd.cyclesUntilNextEvent(), 172);
+
+        lcd.step(172);
+        EXPECT_EQ(lcd.mode(), 0);
+        EXPECT_EQ(lcd.regSTAT() & 0x03, 0);
+
+        lcd.step(204);
+        EXPECT_EQ(lcd.regLY(), 1);
+        EXPECT_EQ(lcd.mode(), 2);
+    }
+
+    TEST_F(LcdControllerTest, LcdVBlank) {
+        lcd.step(LcdController::LINE_CYCLES * 144);
+        EXPECT_EQ(lcd.regLY(), 144);
+        EXPECT_EQ(lcd.mode(), 1);
+        EXPECT_EQ(lcd.nextEventCycle(), LcdController::FRAME_CYCLES);
+
+        lcd.setRegLYC(150);
+        EXPECT_EQ(lcd.nextEventCycle(), LcdController::LINE_CYCLES * 150);
+
+        lcd.step(LcdController::LINE_CYCLES * 6);
+        EXPECT_EQ(lcd.regLY(), 150);
+        EXPECT_EQ(lcd.regSTAT() & 0x04, 0x04);
+    }
+
+    TEST_F(LcdControllerTest, LcdLargeStepWrapsFrames) {
+        lcd.step(LcdController::FRAME_CYCLES * 3 + LcdController::LINE_CYCLES * 10 + 100);
+        EXPECT_EQ(lcd.frameCycle(), LcdController::LINE_CYCLES * 10 + 100);
+        EXPECT_EQ(lcd.regLY(), 10);
+        EXPECT_EQ(lcd.mode(), 3);
+    }
+
+    TEST_F(LcdControllerTest, LcdSmallStepsMatchLargeStep) {
+        LcdController other;
+        other.setRegLCDC(0x80);
+        for (int i = 0; i < LcdController::FRAME_CYCLES + 1234; i += 4) {
+            other.step(4);
+        }
+        lcd.step(LcdController::FRAME_CYCLES + 1236);
+        EXPECT_EQ(lcd.frameCycle(), other.frameCycle());
+        EXPECT_EQ(lcd.regLY(), other.regLY());
+        EXPECT_EQ(lcd.regSTAT(), other.regSTAT());
+    }
+
+    TEST_F(LcdControllerTest, LcdFrameHashAtVBlank) {
+        lcd.setFrameHashEnabled(true);
+        lcd.step(LcdController::LINE_CYCLES * 144 - 1);
+        EXPECT_EQ(lcd.frameCount(), 0u);
+        EXPECT_EQ(lcd.frameHash(), 0u);
+
+        lcd.step(1);
+        EXPECT_EQ(lcd.frameCount(), 1u);
+
+        uint8_t blank[LcdController::SCREEN_HEIGHT * LcdController::SCREEN_WIDTH] = {};
+        EXPECT_EQ(lcd.frameHash(), crc32c(blank, sizeof(blank)));
+
+        lcd.step(LcdController::FRAME_CYCLES * 9);
+        EXPECT_EQ(lcd.frameCount(), 10u);
+    }
+
+    TEST_F(LcdControllerTest, LcdOff) {
+        // Attached to an emulator, to see the interrupts
+        Emulator emu("");
+        LcdController& emuLcd = *emu.periph()->lcd();
+        emuLcd.step(LcdController::LINE_CYCLES * 10 + 100);
+        emuLcd.setRegLCDC(0x00);
+        EXPECT_EQ(emuLcd.regLY(), 0);
+        EXPECT_EQ(emuLcd.mode(), 0);
+
+        // Frames go on, without anything to see in LY or STAT
+        uint32_t frames = emuLcd.frameCount();
+        emuLcd.setRegLYC(0);
+        emuLcd.setRegSTAT(0x40);
+        emu.periph()->setRegIF(0);
+        emuLcd.step(LcdController::FRAME_CYCLES);
+        EXPECT_EQ(emuLcd.frameCount(), frames + 1);
+        EXPECT_EQ(emuLcd.regLY(), 0);
+        EXPECT_EQ(emuLcd.regSTAT() & 0x03, 0);
+        EXPECT_EQ(emu.periph()->regIF() & 0x03, 0);
+
+        // Back on, from the start of a frame, where LY matches LYC
+        emuLcd.setRegLCDC(0x80);
+        EXPECT_EQ(emuLcd.frameCycle(), 0);
+        EXPECT_EQ(emuLcd.mode(), 2);
+        EXPECT_EQ(emu.periph()->regIF() & 0x02, 0x02);
+        emuLcd.step(LcdController::LINE_CYCLES * 3);
+        EXPECT_EQ(emuLcd.regLY(), 3);
+    }
+}
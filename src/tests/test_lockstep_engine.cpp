@@ -0,0 +1,90 @@
+#include "emulator.hpp"
+#include "lockstep_engine.hpp"
+#include "gtest/gtest.h"
+
+#include <memory>
+#include <vector>
+
+using namespace LibDMG;
+using namespace std;
+
+namespace {
+    class LockstepEngineTest : public ::testing::Test {
+    protected:
+        // ALU loop whose branch depends on the lane's seed
+        static void setup(Emulator& emu, size_t seed) {
+            const uint8_t program[] = {
+                0x77,           // LD (HL),A
+                0x80,           // ADD A,B
+                0x04,           // INC B
+                0x4F,           // LD C,A
+                0xA9,           // XOR C
+                0x89,           // ADC A,C
+                0x0D,           // DEC C
+                0x20, 0x03,     // JR NZ,+3
+                0x3C,           // INC A
+                0x57,           // LD D,A
+                0x9A,           // SBC A,D
+                0xB8,           // CP B
+                0x18, 0xF1      // JR -15
+            };
+            for (size_t i = 0; i < sizeof(program); i++) {
+                emu.mem().write(static_cast<uint16_t>(0xC000 + i), program[i]);
+            }
+            emu.cpu()->setReg16(Cpu::REG16_PC, 0xC000);
+            emu.cpu()->setReg8(Cpu::REG8_A, static_cast<uint8_t>(seed * 3));
+            emu.cpu()->setReg8(Cpu::REG8_B, static_cast<uint8_t>(seed));
+            emu.cpu()->setReg16(Cpu::REG16_HL, 0xD000);
+        }
+
+        static void expectSameState(Emulator& a, Emulator& b) {
+            EXPECT_EQ(a.cycles(), b.cycles());
+            EXPECT_EQ(a.cpu()->reg16(Cpu::REG16_PC), b.cpu()->reg16(Cpu::REG16_PC));
+            EXPECT_EQ(a.cpu()->reg16(Cpu::REG16_AF), b.cpu()->reg16(Cpu::REG16_AF));
+            EXPECT_EQ(a.cpu()->reg16(Cpu::REG16_BC), b.cpu()->reg16(Cpu::REG16_BC));
+            EXPECT_EQ(a.cpu()->reg16(Cpu::REG16_DE), b.cpu()->reg16(Cpu::REG16_DE));
+            EXPECT_EQ(a.cpu()->instructions(), b.cpu()->instructions());
+            EXPECT_EQ(a.stateHash(), b.stateHash());
+        }
+    };
+
+    // Test that each lane ends up as a scalar emulator run the same way
+    TEST_F(LockstepEngineTest, LockstepMatchesScalar) {
+        const size_t LANES = 16;
+        LockstepEngine engine(LANES);
+        vector<unique_ptr<Emulator> > scalar;
+        for (size_t i = 0; i < LANES; i++) {
+            setup(engine.lane(i), i);
+            scalar.push_back(make_unique<Emulator>());
+            setup(*scalar.back(), i);
+        }
+
+        EXPECT_EQ(engine.step(20001), 20001);
+        engine.runFrame();
+        for (size_t i = 0; i < LANES; i++) {
+            scalar[i]->step(20001);
+            scalar[i]->runFrame();
+            expectSameState(engine.lane(i), *scalar[i]);
+        }
+
+        // Converged lanes share the kernels, the branches run on each Cpu
+        EXPECT_GT(engine.vectorInstructions(), engine.scalarInstructions());
+        EXPECT_GT(engine.scalarInstructions(), 0u);
+    }
+
+    // Test that a stopped lane does not hold the others back
+    TEST_F(LockstepEngineTest, LockstepLaneStop) {
+        LockstepEngine engine(4);
+        for (size_t i = 0; i < engine.laneCount(); i++) {
+            setup(engine.lane(i), i);
+        }
+        engine.lane(1).requestStop();
+        engine.lane(2).setBreakpoint(0xC00C);
+
+        EXPECT_EQ(engine.step(10000), 0);
+        EXPECT_EQ(engine.lane(0).cycles(), 10000u);
+        EXPECT_EQ(engine.lane(1).cycles(), 0u);
+        EXPECT_EQ(engine.lane(2).cpu()->reg16(Cpu::REG16_PC), 0xC00C);
+        EXPECT_EQ(engine.lane(3).cycles(), 10000u);
+    }
+}
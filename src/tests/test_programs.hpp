@@ -0,0 +1,39 @@
+#ifndef LIBDMG_TEST_PROGRAMS_HPP
+#define LIBDMG_TEST_PROGRAMS_HPP
+
+#include "emulator.hpp"
+
+#include <string>
+#include <vector>
+
+// Small programs shared by the tests
+namespace LibDMG
+{
+    namespace TestPrograms
+    {
+        // Runs a program from main RAM
+        inline void loadProgram(Emulator& emu, const std::vector<uint8_t>& program) {
+            for (size_t i = 0; i < program.size(); i++) {
+                emu.mem().write(static_cast<uint16_t>(0xC000 + i), program[i]);
+            }
+            emu.cpu()->setReg16(Cpu::REG16_PC, 0xC000);
+        }
+
+        // Prints text over serial, then loops forever
+        inline std::vector<uint8_t> printProgram(const std::string& text) {
+            std::vector<uint8_t> program;
+            for (char c : text) {
+                uint8_t bytes[] = { 0x3E, static_cast<uint8_t>(c),  // LD A,c
+                                    0xE0, 0x01,                     // LDH (SB),A
+                                    0x3E, 0x81,                     // LD A,$81
+                                    0xE0, 0x02 };                   // LDH (SC),A
+                program.insert(program.end(), bytes, bytes + sizeof(bytes));
+            }
+            program.push_back(0x18);    // JR -2
+            program.push_back(0xFE);
+            return program;
+        }
+    }
+}
+
+#endif
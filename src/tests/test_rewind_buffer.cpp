@@ -0,0 +1,121 @@
+#include "emulator.hpp"
+#include "state/delta_codec.hpp"
+#include "state/rewind_buffer.hpp"
+#include "gtest/gtest.h"
+
+#include <vector>
+
+using namespace LibDMG;
+using namespace std;
+
+namespace {
+    class RewindBufferTest : public ::testing::Test {
+    protected:
+        RewindBufferTest() {
+            emu.periph()->setReg(Peripherals::PERIPH_REG_LCDC, 0x91);
+        }
+
+        // Runs a frame, leaving a mark of it in RAM
+        void runFrame(int frame) {
+            emu.mem().write(0xC000 + (frame % 64), static_cast<uint8_t>(frame + 1));
+            emu.periph()->step(LcdController::FRAME_CYCLES);
+        }
+
+        Emulator emu;
+    };
+
+    // Test that a delta turns each buffer into the other
+    TEST_F(RewindBufferTest, DeltaRoundTrip) {
+        vector<uint8_t> a(4096), b(4096);
+        for (size_t i = 0; i < a.size(); i++) {
+            a[i] = static_cast<uint8_t>(i * 7);
+        }
+        b = a;
+        b[0] ^= 1;
+        b[100] ^= 0xFF;
+        b[103] ^= 0x10;
+        for (size_t i = 2000; i < 2100; i++) {
+            b[i] = 0;
+        }
+        b[4095] ^= 0x80;
+
+        vector<uint8_t> delta(xorDeltaBound(a.size()));
+        size_t size = encodeXorDelta(a.data(), b.data(), a.size(), delta.data());
+        EXPECT_LT(size, 200u);
+
+        vector<uint8_t> c(a);
+        EXPECT_TRUE(applyXorDelta(delta.data(), size, c.data(), c.size()));
+        EXPECT_EQ(c, b);
+        EXPECT_TRUE(applyXorDelta(delta.data(), size, c.data(), c.size()));
+        EXPECT_EQ(c, a);
+
+        // A cut delta, or one for a smaller buffer, is refused
+        EXPECT_FALSE(applyXorDelta(delta.data(), size - 1, c.data(), c.size()));
+        EXPECT_FALSE(applyXorDelta(delta.data(), size, c.data(), 4000));
+
+        // Identical buffers give an empty delta
+        EXPECT_EQ(encodeXorDelta(a.data(), a.data(), a.size(), delta.data()), 0u);
+    }
+
+    // Test that the worst case fits in the bound
+    TEST_F(RewindBufferTest, DeltaBound) {
+        vector<uint8_t> a(1000, 0), b(1000, 0);
+        for (size_t i = 0; i < b.size(); i += 9) {
+            b[i] = 1;
+        }
+        vector<uint8_t> delta(xorDeltaBound(a.size()));
+        size_t size = encodeXorDelta(a.data(), b.data(), a.size(), delta.data());
+        EXPECT_LE(size, xorDeltaBound(a.size()));
+
+        for (size_t i = 0; i < b.size(); i++) {
+            b[i] = 0xFF;
+        }
+        size = encodeXorDelta(a.data(), b.data(), a.size(), delta.data());
+        EXPECT_LE(size, xorDeltaBound(a.size()));
+    }
+
+    // Test rewinding to each stored point
+    TEST_F(RewindBufferTest, RewindRestoresFrames) {
+        RewindBuffer rewind(emu, 64 * 1024, 1);
+        for (int frame = 0; frame < 20; frame++) {
+            runFrame(frame);
+            rewind.update();
+        }
+        EXPECT_EQ(rewind.count(), 20u);
+        uint32_t last = emu.periph()->lcd()->frameCount();
+
+        EXPECT_TRUE(rewind.rewind(0));
+        EXPECT_EQ(emu.periph()->lcd()->frameCount(), last);
+
+        EXPECT_TRUE(rewind.rewind(5));
+        EXPECT_EQ(emu.periph()->lcd()->frameCount(), last - 5);
+        EXPECT_EQ(emu.mem().read(0xC000 + 14), 15);
+        EXPECT_EQ(emu.mem().read(0xC000 + 15), 0);
+        EXPECT_EQ(rewind.count(), 15u);
+
+        EXPECT_FALSE(rewind.rewind(15));
+        EXPECT_TRUE(rewind.rewind(14));
+        EXPECT_EQ(emu.mem().read(0xC000), 1);
+        EXPECT_EQ(emu.mem().read(0xC001), 0);
+        EXPECT_EQ(rewind.count(), 1u);
+    }
+
+    // Test that the oldest snapshots are dropped when the ring is full
+    TEST_F(RewindBufferTest, RewindBounded) {
+        RewindBuffer rewind(emu, 2048, 2);
+        for (int frame = 0; frame < 600; frame++) {
+            runFrame(frame);
+            rewind.update();
+        }
+        EXPECT_LE(rewind.memoryUsed(), 2048u);
+        EXPECT_GT(rewind.count(), 2u);
+        EXPECT_LT(rewind.count(), 300u);
+
+        // The oldest snapshot left is still intact
+        EXPECT_TRUE(rewind.rewind(0));
+        uint32_t last = emu.periph()->lcd()->frameCount();
+        size_t steps = rewind.count() - 1;
+        EXPECT_TRUE(rewind.rewind(steps));
+        EXPECT_EQ(emu.periph()->lcd()->frameCount(), last - 2 * steps);
+    }
+}
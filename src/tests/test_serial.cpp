@@ -0,0 +1,181 @@
+#include "emulator.hpp"
+#include "peripherals/link_cable.hpp"
+#include "test_rom_monitor.hpp"
+#include "test_programs.hpp"
+#include "gtest/gtest.h"
+
+#include <thread>
+#include <vector>
+
+using namespace LibDMG;
+using namespace LibDMG::TestPrograms;
+using namespace std;
+
+namespace {
+    class SerialTest : public ::testing::Test {
+    protected:
+        struct Exchange {
+            uint8_t  received;
+            uint64_t cycle;
+        };
+
+        // Master sends 0, 1, 2... and the slave answers with the last byte
+        // it received plus 100
+        static void runMaster(Emulator& emu, vector<Exchange>& log, int count) {
+            Serial *serial = emu.periph()->serial();
+            uint8_t next = 0;
+            serial->setRegSB(next++);
+            serial->setRegSC(0x81);
+            while (static_cast<int>(log.size()) < count) {
+                emu.step(64);
+                if (!serial->isTransferring()) {
+                    log.push_back({ serial->regSB(), serial->cycles() });
+                    serial->setRegSB(next++);
+                    serial->setRegSC(0x81);
+                }
+            }
+        }
+
+        static void runSlave(Emulator& emu, int cycles) {
+            Serial *serial = emu.periph()->serial();
+            serial->setRegSB(100);
+            serial->setRegSC(0x80);
+            while (serial->cycles() < static_cast<uint64_t>(cycles)) {
+                emu.step(64);
+                if (!serial->isTransferring()) {
+                    serial->setRegSB(serial->regSB() + 100);
+                    serial->setRegSC(0x80);
+                }
+            }
+        }
+
+        static vector<Exchange> runThreaded(int count) {
+            Emulator master;
+            Emulator slave;
+            ThreadedLinkCable cable(1024);
+            cable.connect(master, slave);
+
+            vector<Exchange> log;
+            thread slaveThread([&]() {
+                runSlave(slave, count * (Serial::TRANSFER_CYCLES + 4096));
+                cable.finish(1);
+            });
+            runMaster(master, log, count);
+            cable.finish(0);
+            slaveThread.join();
+            return log;
+        }
+    };
+
+    //
+    TEST_F(SerialTest, SerialNoCable) {
+        Emulator emu;
+        Serial *serial = emu.periph()->serial();
+        emu.periph()->setRegIF(0);
+
+        emu.periph()->setReg(Peripherals::PERIPH_REG_SB, 0x42);
+        emu.periph()->setReg(Peripherals::PERIPH_REG_SC, 0x81);
+        EXPECT_EQ(0xFF, emu.periph()->reg(Peripherals::PERIPH_REG_SC));
+
+        emu.step(Serial::TRANSFER_CYCLES - 4);
+        EXPECT_TRUE(serial->isTransferring());
+        emu.step(4);
+        EXPECT_FALSE(serial->isTransferring());
+        EXPECT_EQ(0xFF, emu.periph()->reg(Peripherals::PERIPH_REG_SB));
+        EXPECT_EQ(0x7F, emu.periph()->reg(Peripherals::PERIPH_REG_SC));
+        EXPECT_EQ(Serial::INT_SERIAL, emu.periph()->regIF() & Serial::INT_SERIAL);
+    }
+
+    //
+    TEST_F(SerialTest, SerialDirectCable) {
+        Emulator master;
+        Emulator slave;
+        LinkCable cable;
+        cable.connect(master, slave);
+        master.periph()->setRegIF(0);
+        slave.periph()->setRegIF(0);
+
+        master.periph()->serial()->setRegSB(0x42);
+        master.periph()->serial()->setRegSC(0x81);
+        slave.periph()->serial()->setRegSB(0x99);
+        slave.periph()->serial()->setRegSC(0x80);
+
+        LinkCable::run(master, slave, Serial::TRANSFER_CYCLES);
+        EXPECT_EQ(0x99, master.periph()->serial()->regSB());
+        EXPECT_EQ(0x42, slave.periph()->serial()->regSB());
+        EXPECT_FALSE(master.periph()->serial()->isTransferring());
+        EXPECT_FALSE(slave.periph()->serial()->isTransferring());
+        EXPECT_EQ(Serial::INT_SERIAL, master.periph()->regIF() & Serial::INT_SERIAL);
+        EXPECT_EQ(Serial::INT_SERIAL, slave.periph()->regIF() & Serial::INT_SERIAL);
+    }
+
+    //
+    TEST_F(SerialTest, SerialThreadedCableDeterministic) {
+        vector<Exchange> first = runThreaded(20);
+        vector<Exchange> second = runThreaded(20);
+
+        ASSERT_EQ(20u, first.size());
+        ASSERT_EQ(20u, second.size());
+        EXPECT_EQ(100, first[0].received);
+        for (int i = 1; i < 20; i++) {
+            EXPECT_EQ(100 + i - 1, first[i].received);
+        }
+        for (int i = 0; i < 20; i++) {
+            EXPECT_EQ(first[i].received, second[i].received);
+            EXPECT_EQ(first[i].cycle, second[i].cycle);
+        }
+    }
+
+    //
+    TEST_F(SerialTest, MonitorSerialPassed) {
+        Emulator emu;
+        string forwarded;
+        TestRomMonitor monitor(emu, [&](uint8_t c) { forwarded.push_back(c); });
+        loadProgram(emu, printProgram("cpu_instrs\n\nPassed\nmore"));
+
+        uint64_t cycles = emu.runUntilStop(4194304);
+        EXPECT_LT(cycles, 4096u);
+        EXPECT_EQ(TestRomMonitor::RESULT_PASSED, monitor.result());
+        EXPECT_EQ("cpu_instrs\n\nPassed", monitor.output());
+        EXPECT_EQ(monitor.output(), forwarded);
+    }
+
+    //
+    TEST_F(SerialTest, MonitorSerialFailed) {
+        Emulator emu;
+        TestRomMonitor monitor(emu);
+        monitor.setPatterns("OK", "KO");
+        loadProgram(emu, printProgram("Failed KO"));
+
+        emu.runUntilStop(4194304);
+        EXPECT_EQ(TestRomMonitor::RESULT_FAILED, monitor.result());
+        EXPECT_EQ("Failed KO", monitor.output());
+    }
+
+    //
+    TEST_F(SerialTest, MonitorRegisterTrap) {
+        Emulator emu;
+        TestRomMonitor monitor(emu);
+        loadProgram(emu, { 0x40,            // LD B,B, not a verdict yet
+                           0x06, 3,  0x0E, 5,  0x16, 8,     // LD B/C/D,n
+                           0x1E, 13, 0x26, 21, 0x2E, 34,    // LD E/H/L,n
+                           0x40,            // LD B,B
+                           0x18, 0xFE });   // JR -2
+
+        uint64_t cycles = emu.runUntilStop(4194304);
+        EXPECT_LT(cycles, 100u);
+        EXPECT_EQ(TestRomMonitor::RESULT_PASSED, monitor.result());
+        EXPECT_TRUE(emu.stopRequested());
+    }
+
+    //
+    TEST_F(SerialTest, MonitorNoVerdict) {
+        Emulator emu;
+        TestRomMonitor monitor(emu);
+        monitor.setRegisterTrap(false);
+        loadProgram(emu, { 0x06, 3,  0x0E, 5,  0x16, 8, 0x1E, 13, 0x26, 21, 0x2E, 34, 0x40, 0x18, 0xFE });
+
+        EXPECT_EQ(100000u, emu.runUntilStop(100000));
+        EXPECT_EQ(TestRomMonitor::RESULT_NONE, monitor.result());
+    }
+}
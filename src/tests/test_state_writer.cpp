@@ -0,0 +1,102 @@
+#include "emulator.hpp"
+#include "state/state_writer.hpp"
+#include "gtest/gtest.h"
+
+#include <cstdio>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <vector>
+
+using namespace LibDMG;
+using namespace std;
+
+namespace {
+    class StateWriterTest : public ::testing::Test {
+    protected:
+        ~StateWriterTest() override {
+            remove("state_writer_a.state");
+            remove("state_writer_b.state");
+        }
+    };
+
+    // Test that saved states load back identical, and are compressed
+    TEST_F(StateWriterTest, StateWriterRoundTrip) {
+        Emulator emu;
+        emu.cpu()->setReg16(Cpu::REG16_PC, 0x0150);
+        emu.mem().write(0xC123, 0x45);
+        vector<uint8_t> expected;
+        emu.saveState(expected);
+
+        StateWriter writer;
+        future<void> done = writer.save(emu, "state_writer_a.state");
+
+        // The emulator can move on while the file is written
+        emu.mem().write(0xC123, 0x67);
+        future<void> second = writer.save(emu, "state_writer_b.state");
+        done.get();
+        second.get();
+
+        ifstream file("state_writer_a.state", ios::binary | ios::ate);
+        EXPECT_LT(static_cast<size_t>(file.tellg()), expected.size() / 4);
+
+        Emulator other;
+        StateWriter::load(other, "state_writer_a.state");
+        vector<uint8_t> actual;
+        other.saveState(actual);
+        EXPECT_EQ(actual, expected);
+
+        StateWriter::load(other, "state_writer_b.state");
+        EXPECT_EQ(other.mem().read(0xC123), 0x67);
+    }
+
+    // Test that write errors reach the future
+    TEST_F(StateWriterTest, StateWriterError) {
+        Emulator emu;
+        StateWriter writer;
+        future<void> done = writer.save(emu, "no_such_dir/state.state");
+        EXPECT_THROW(done.get(), StateException);
+
+        writer.save(emu, "state_writer_a.state");
+        writer.flush();
+        Emulator other;
+        EXPECT_NO_THROW(StateWriter::load(other, "state_writer_a.state"));
+    }
+
+    // Test that a truncated or corrupt file is refused without changing the
+    // emulator
+    TEST_F(StateWriterTest, StateWriterCorruptFile) {
+        Emulator emu;
+        emu.cpu()->setReg16(Cpu::REG16_PC, 0x1234);
+        emu.mem().write(0xC000, 0x22);
+        StateWriter writer;
+        writer.save(emu, "state_writer_a.state").get();
+
+        ifstream in("state_writer_a.state", ios::binary);
+        vector<char> data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        in.close();
+
+        Emulator other;
+        other.cpu()->setReg16(Cpu::REG16_PC, 0x0100);
+        other.mem().write(0xC000, 0x11);
+        auto expectRefused = [&other](const vector<char>& file) {
+            ofstream out("state_writer_b.state", ios::binary | ios::trunc);
+            out.write(file.data(), file.size());
+            out.close();
+            EXPECT_THROW(StateWriter::load(other, "state_writer_b.state"), StateException);
+            EXPECT_EQ(other.cpu()->reg16(Cpu::REG16_PC), 0x0100);
+            EXPECT_EQ(other.mem().read(0xC000), 0x11);
+        };
+
+        // Cut in half
+        expectRefused(vector<char>(data.begin(), data.begin() + data.size() / 2));
+        // One byte flipped
+        vector<char> flipped(data);
+        flipped[flipped.size() - 3] ^= 0x01;
+        expectRefused(flipped);
+        // Huge size in the header
+        vector<char> huge(data);
+        huge[7] = static_cast<char>(0xFF);
+        expectRefused(huge);
+    }
+}
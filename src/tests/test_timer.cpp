@@ -1,6 +1,8 @@
 #include "peripherals/timer.hpp"
 #include "gtest/gtest.h"
 
+#include <limits>
+
 using namespace LibDMG;
 
 namespace {
@@ -331,15 +333,110 @@ namespace {
         timer.step(255);
         ASSERT_EQ(timer.regDIV(), 0);
         ASSERT_EQ(timer.regTIMA(), 15);
+        // Bit 3 of the counter is set, so resetting it clocks TIMA once
         timer.setRegDIV(34);
+        ASSERT_EQ(timer.regTIMA(), 16);
         timer.step(1);
         ASSERT_EQ(timer.regDIV(), 0);
-        ASSERT_EQ(timer.regTIMA(), 15);
+        ASSERT_EQ(timer.regTIMA(), 16);
         timer.step(254);
         ASSERT_EQ(timer.regDIV(), 0);
-        ASSERT_EQ(timer.regTIMA(), 30);
+        ASSERT_EQ(timer.regTIMA(), 31);
         timer.step(1);
         ASSERT_EQ(timer.regDIV(), 1);
-        ASSERT_EQ(timer.regTIMA(), 31);
+        ASSERT_EQ(timer.regTIMA(), 32);
+    }
+
+    TEST_F(TimerTest, TimerLargeStepMatchesSmallSteps) {
+        Timer small;
+        Timer large;
+        small.setRegTMA(0xF0);
+        large.setRegTMA(0xF0);
+        small.setRegTAC(0x05);
+        large.setRegTAC(0x05);
+
+        for (int i = 0; i < 100000; i++) {
+            small.step(4);
+        }
+        large.step(400000);
+
+        ASSERT_EQ(large.regTIMA(), small.regTIMA());
+        ASSERT_EQ(large.regDIV(), small.regDIV());
+        ASSERT_EQ(large.intTimaPending(), small.intTimaPending());
+        ASSERT_EQ(large.cyclesUntilOverflow(), small.cyclesUntilOverflow());
+    }
+
+    TEST_F(TimerTest, TimerCyclesUntilOverflow) {
+        Timer timer;
+        ASSERT_EQ(timer.cyclesUntilOverflow(), std::numeric_limits<int>::max());
+
+        // 256 increments, then one M-cycle before TMA is loaded
+        timer.setRegTAC(0x05);
+        ASSERT_EQ(timer.cyclesUntilOverflow(), 256 * 16 + 4);
+
+        timer.step(10);
+        ASSERT_EQ(timer.cyclesUntilOverflow(), 256 * 16 + 4 - 10);
+
+        timer.step(timer.cyclesUntilOverflow() - 1);
+        ASSERT_FALSE(timer.intTimaPending());
+        timer.step(1);
+        ASSERT_TRUE(timer.intTimaPending());
+        ASSERT_EQ(timer.regTIMA(), 0);
+    }
+
+    TEST_F(TimerTest, TimerOverflowReloadDelay) {
+        Timer timer;
+        timer.setRegTMA(0x80);
+        timer.setRegTIMA(0xFF);
+        timer.setRegTAC(0x05);
+
+        timer.step(16);
+        ASSERT_EQ(timer.regTIMA(), 0);
+        ASSERT_FALSE(timer.intTimaPending());
+
+        timer.step(3);
+        ASSERT_EQ(timer.regTIMA(), 0);
+        timer.step(1);
+        ASSERT_EQ(timer.regTIMA(), 0x80);
+        ASSERT_TRUE(timer.intTimaPending());
+    }
+
+    TEST_F(TimerTest, TimerWriteTIMACancelsReload) {
+        Timer timer;
+        timer.setRegTMA(0x80);
+        timer.setRegTIMA(0xFF);
+        timer.setRegTAC(0x05);
+
+        timer.step(17);
+        timer.setRegTIMA(0x10);
+        timer.step(10);
+        ASSERT_EQ(timer.regTIMA(), 0x10);
+        ASSERT_FALSE(timer.intTimaPending());
+    }
+
+    TEST_F(TimerTest, TimerDIVWriteGlitch) {
+        Timer timer;
+        timer.setRegTAC(0x05);
+
+        // Bit 3 of the counter is set, resetting DIV makes it fall
+        timer.step(8);
+        ASSERT_EQ(timer.regTIMA(), 0);
+        timer.setRegDIV(0);
+        ASSERT_EQ(timer.regTIMA(), 1);
+
+        // Bit 3 is clear, no glitch
+        timer.step(4);
+        timer.setRegDIV(0);
+        ASSERT_EQ(timer.regTIMA(), 1);
+    }
+
+    TEST_F(TimerTest, TimerTACWriteGlitch) {
+        Timer timer;
+        timer.setRegTAC(0x05);
+        timer.step(8);
+
+        // Disabling the timer while the selected bit is set
+        timer.setRegTAC(0x01);
+        ASSERT_EQ(timer.regTIMA(), 1);
     }
-}
\ No newline at end of file
+}